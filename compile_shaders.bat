@@ -7,4 +7,38 @@ glslc.exe src\shaders\shader.frag -o bin\shaders\frag.spv
 
 glslc.exe src\shaders\compute.vert -o bin\shaders\compute.vert.spv
 glslc.exe src\shaders\compute.frag -o bin\shaders\compute.frag.spv
-glslc.exe src\shaders\compute.comp -o bin\shaders\compute.comp.spv
\ No newline at end of file
+glslc.exe src\shaders\compute.comp -o bin\shaders\compute.comp.spv
+glslc.exe src\shaders\grid_count.comp -o bin\shaders\grid_count.comp.spv
+glslc.exe src\shaders\grid_scan.comp -o bin\shaders\grid_scan.comp.spv
+glslc.exe src\shaders\grid_scatter.comp -o bin\shaders\grid_scatter.comp.spv
+glslc.exe src\shaders\grid_interact.comp -o bin\shaders\grid_interact.comp.spv
+glslc.exe src\shaders\nbody.comp -o bin\shaders\nbody.comp.spv
+glslc.exe src\shaders\nbody_naive.comp -o bin\shaders\nbody_naive.comp.spv
+glslc.exe src\shaders\barnes_hut.comp -o bin\shaders\barnes_hut.comp.spv
+glslc.exe --target-env=vulkan1.2 src\shaders\sort_keys.comp -o bin\shaders\sort_keys.comp.spv
+glslc.exe --target-env=vulkan1.2 src\shaders\radix_count.comp -o bin\shaders\radix_count.comp.spv
+glslc.exe --target-env=vulkan1.2 src\shaders\radix_scan.comp -o bin\shaders\radix_scan.comp.spv
+glslc.exe --target-env=vulkan1.2 src\shaders\radix_scatter.comp -o bin\shaders\radix_scatter.comp.spv
+glslc.exe --target-env=vulkan1.2 src\shaders\sort_permute.comp -o bin\shaders\sort_permute.comp.spv
+glslc.exe src\shaders\particle_stats_shared.comp -o bin\shaders\particle_stats_shared.comp.spv
+glslc.exe --target-env=vulkan1.2 src\shaders\particle_stats_subgroup.comp -o bin\shaders\particle_stats_subgroup.comp.spv
+glslc.exe src\shaders\particle_cull.comp -o bin\shaders\particle_cull.comp.spv
+glslc.exe src\shaders\particle_quad.vert -o bin\shaders\particle_quad.vert.spv
+glslc.exe src\shaders\particle_quad.frag -o bin\shaders\particle_quad.frag.spv
+glslc.exe src\shaders\particle_init.comp -o bin\shaders\particle_init.comp.spv
+glslc.exe -DPARTICLE_HALF src\shaders\compute.comp -o bin\shaders\compute_half.comp.spv
+glslc.exe -DPARTICLE_HALF -DPARTICLE_STORAGE16 src\shaders\compute.comp -o bin\shaders\compute_half16.comp.spv
+glslc.exe -DPARTICLE_HALF src\shaders\particle_cull.comp -o bin\shaders\particle_cull_half.comp.spv
+glslc.exe -DPARTICLE_HALF -DPARTICLE_STORAGE16 src\shaders\particle_cull.comp -o bin\shaders\particle_cull_half16.comp.spv
+glslc.exe -DPARTICLE_HALF src\shaders\particle_quad.vert -o bin\shaders\particle_quad_half.vert.spv
+glslc.exe -DPARTICLE_HALF -DPARTICLE_STORAGE16 src\shaders\particle_quad.vert -o bin\shaders\particle_quad_half16.vert.spv
+glslc.exe src\shaders\instance_cull.comp -o bin\shaders\instance_cull.comp.spv
+glslc.exe -DOCCLUSION_CULLING src\shaders\instance_cull.comp -o bin\shaders\instance_cull_occlusion.comp.spv
+glslc.exe src\shaders\hiz_build.comp -o bin\shaders\hiz_build.comp.spv
+glslc.exe -DDEPTH_MULTISAMPLE src\shaders\hiz_build.comp -o bin\shaders\hiz_build_ms.comp.spv
+glslc.exe src\shaders\meshlet_cull.comp -o bin\shaders\meshlet_cull.comp.spv
+glslc.exe -DMESH_SHADER src\shaders\meshlet_cull.comp -o bin\shaders\meshlet_cull_mesh.comp.spv
+glslc.exe --target-env=vulkan1.2 src\shaders\meshlet.mesh -o bin\shaders\meshlet.mesh.spv
+glslc.exe -DBINDLESS src\shaders\shader.vert -o bin\shaders\vert_bindless.spv
+glslc.exe -DBINDLESS src\shaders\shader.frag -o bin\shaders\frag_bindless.spv
+glslc.exe --target-env=vulkan1.2 -DBINDLESS src\shaders\meshlet.mesh -o bin\shaders\meshlet_bindless.mesh.spv
\ No newline at end of file
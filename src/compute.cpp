@@ -7,31 +7,124 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <optional>
-#include <random>
 #include <set>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 constexpr bool LOG_TO_README = true;
 const char* logFileName = LOG_TO_README ? "compute.md" : "compute.hpp";
 #include "logger.h"
+#include "mapped_file.h"
 std::unordered_set<std::string> OneTimeLogger::loggedFunctions;
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 const uint32_t PARTICLE_COUNT = 8192;
-
-const int MAX_FRAMES_IN_FLIGHT = 2;
+const uint32_t DEFAULT_SEED = 0;
+// Initial state, keep in sync with src/shaders/particle_init.comp like INITIAL_DISK_RADIUS
+const float INITIAL_SPEED = 0.00025f;
+// Default particle size in pixels, every particle scales it by its color's alpha
+const float PARTICLE_SIZE = 14.0f;
+
+// Uniform grid for the short-range interaction mode. The grid is sized so that the initial particle disk holds
+// roughly GRID_PARTICLES_PER_CELL particles per cell, the interaction radius is one cell.
+const float GRID_PARTICLES_PER_CELL = 16.0f;
+const float INITIAL_DISK_RADIUS = 0.25f;
+const uint32_t MIN_GRID_DIM = 8;
+const uint32_t MAX_GRID_DIM = 4096;
+const uint32_t GRID_SCAN_BLOCK_SIZE = 1024;
+
+// Short-range interaction constants, keep in sync with src/shaders/particle.glsl
+const float INTERACTION_REPULSION = 4.0e-6f;
+const float INTERACTION_PRESSURE = 2.0e-7f;
+const float INTERACTION_COHESION = 1.0e-6f;
+const float MAX_SPEED = 1.0e-3f;
+
+// N-body gravity constants, keep in sync with src/shaders/particle.glsl
+const float NBODY_GRAVITY = 1.5e-8f;
+const float NBODY_SOFTENING = 0.01f;
+// gravityAcceleration in particle.glsl plus the accumulate, one flop per scalar operation and rsqrt as one:
+// 2 sub (d), 3 for dot(d, d), 1 add (softening), 1 rsqrt, 2 mul (cube), 2 mul (scale d), 2 add (accumulate)
+const double NBODY_FLOPS_PER_INTERACTION = 13.0;
+const uint32_t NBODY_DEFAULT_TILE_SIZE = 256;
+
+// Barnes-Hut quadtree, the end marker is mirrored in src/shaders/barnes_hut.comp
+const uint32_t QUADTREE_END = 0xFFFFFFFF;
+const uint32_t QUADTREE_LEAF_CAPACITY = 8;
+const uint32_t MORTON_BITS_PER_AXIS = 16;
+const float BARNES_HUT_DEFAULT_THETA = 0.5f;
+
+const std::vector<uint32_t> BENCHMARK_PARTICLE_COUNTS = {16384, 65536, 262144, 1048576, 4194304};
+const uint32_t BENCHMARK_STEPS = 32;
+const float BENCHMARK_DELTA_TIME = 33.0f;
+const std::vector<uint32_t> NBODY_BENCHMARK_PARTICLE_COUNTS = {4096, 16384, 65536, 131072};
+const std::vector<uint32_t> NBODY_BENCHMARK_TILE_SIZES = {64, 128, 256, 512, 1024};
+// The O(N^2) CPU reference is only run up to this many particles
+const uint32_t NBODY_REFERENCE_LIMIT = 16384;
+const std::vector<uint32_t> BARNES_HUT_BENCHMARK_PARTICLE_COUNTS = {16384, 65536, 131072, 524288};
+const std::vector<float> BARNES_HUT_BENCHMARK_THETAS = {0.25f, 0.5f, 0.75f, 1.0f};
+// The exact kernel is only timed up to this many particles, and with fewer steps to stay clear of device timeouts
+const uint32_t BARNES_HUT_EXACT_LIMIT = 131072;
+const uint32_t BARNES_HUT_EXACT_STEPS = 4;
+const uint32_t BARNES_HUT_BUILD_REPEATS = 4;
+
+// GPU radix sort, keep in sync with src/shaders/radix_sort.glsl and radix_scan.comp
+const uint32_t RADIX_BITS = 4;
+const uint32_t RADIX_DIGITS = 1u << RADIX_BITS;
+const uint32_t RADIX_PASSES = 32 / RADIX_BITS;
+const uint32_t RADIX_BLOCK_SIZE = 256;
+const uint32_t RADIX_SCAN_BLOCK_SIZE = 1024;
+
+// Particle statistics reduction, keep in sync with src/shaders/particle_stats.glsl
+const uint32_t STATS_GROUP_SIZE = 256;
+const uint32_t STATS_MAX_GROUPS = 256;
+const double STATS_PRINT_INTERVAL = 1.0;  // seconds
+
+// Particle snapshots, see SnapshotHeader
+const char SNAPSHOT_MAGIC[8] = {'I', 'V', 'P', 'A', 'R', 'T', 'S', '\0'};
+const uint32_t SNAPSHOT_VERSION = 1;
+const uint64_t SNAPSHOT_DATA_OFFSET = 4096;
+const VkDeviceSize SNAPSHOT_CHUNK_SIZE = 16 * 1024 * 1024;
+const uint32_t SNAPSHOT_RING_SIZE = 4;
+
+// Half precision drift report, the error against the fp32 reference is printed this many times over the run
+const uint32_t DRIFT_REPORT_ROWS = 8;
+
+// Defaults of --frames-in-flight and --state-buffers. A frame in flight owns its command buffers, uniform buffer and
+// render copy, the simulation steps through the ring of state buffers independently of the frame slots.
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+const uint32_t DEFAULT_STATE_BUFFERS = 2;
+
+// --latency-sweep runs the frame loop for every pair of these, this many frames each unless --frames says otherwise
+const std::vector<uint32_t> LATENCY_SWEEP_FRAMES_IN_FLIGHT = {1, 2, 3};
+const std::vector<uint32_t> LATENCY_SWEEP_STATE_BUFFERS = {2, 3, 4};
+const uint64_t LATENCY_SWEEP_FRAMES = 600;
+
+// Uniform buffer, particles in/out, grid, quadtree, radix sort and the statistics partials and result
+const uint32_t COMPUTE_BINDING_COUNT = 18;
 
 const std::vector<const char*> validationLayers = {"VK_LAYER_KHRONOS_validation"};
 
@@ -67,6 +160,8 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
 struct QueueFamilyIndices {
   std::optional<uint32_t> graphicsAndComputeFamily;
   std::optional<uint32_t> presentFamily;
+  // Family with compute but without graphics, used for async compute when the device has one
+  std::optional<uint32_t> asyncComputeFamily;
 
   bool isComplete() { return graphicsAndComputeFamily.has_value() && presentFamily.has_value(); }
 };
@@ -79,11 +174,83 @@ struct SwapChainSupportDetails {
 
 struct UniformBufferObject {
   float deltaTime = 1.0f;
+  uint32_t particleCount = 0;
+  uint32_t gridDim = 0;
+  float cellSize = 0.0f;
+  float theta = BARNES_HUT_DEFAULT_THETA;
+  float particleSize = PARTICLE_SIZE;
+  glm::vec2 viewportSize = glm::vec2(WIDTH, HEIGHT);
+};
+
+enum class SimulationMode { Integrate, Grid, NBody, BarnesHut };
+
+const char* simulationModeName(SimulationMode mode) {
+  switch (mode) {
+    case SimulationMode::Integrate:
+      return "integrate";
+    case SimulationMode::Grid:
+      return "grid";
+    case SimulationMode::NBody:
+      return "nbody";
+    case SimulationMode::BarnesHut:
+      return "barnes-hut";
+  }
+  return "unknown";
+}
+
+// Points are the original point sprites, quads are instanced and culled by a compute pre-pass
+enum class RenderMode { Points, Quads };
+
+// Additive blending gives the same image whatever order the particles are drawn in
+enum class BlendMode { Alpha, Additive };
+
+struct Options {
+  SimulationMode mode = SimulationMode::Integrate;
+  RenderMode renderMode = RenderMode::Quads;
+  BlendMode blendMode = BlendMode::Alpha;
+  float particleSize = PARTICLE_SIZE;
+  uint32_t particleCount = PARTICLE_COUNT;
+  // The initial state only depends on the seed, whether it is generated on the CPU or with particle_init.comp
+  uint32_t seed = DEFAULT_SEED;
+  bool gpuInit = false;
+  // Store the state as half floats, see HalfParticle. Only the integrate mode and the render paths support it.
+  bool halfPrecision = false;
+  // Run the half precision state this many steps next to the fp32 CPU reference and report the drift
+  uint32_t driftSteps = 0;
+  uint32_t tileSize = NBODY_DEFAULT_TILE_SIZE;
+  float theta = BARNES_HUT_DEFAULT_THETA;
+  bool asyncCompute = true;
+  uint32_t stepsPerFrame = 1;
+  uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+  // At least 2, every step reads the state buffer the step before wrote
+  uint32_t stateBuffers = DEFAULT_STATE_BUFFERS;
+  // Leave the main loop after this many frames, 0 runs until the window is closed
+  uint64_t frameLimit = 0;
+  // Reorder the particles by Morton code every this many frames, 0 never does
+  uint32_t sortInterval = 0;
+  // Write a snapshot of the state to snapshotFile every this many frames, 0 never does
+  uint32_t snapshotInterval = 0;
+  std::string snapshotFile = "particles.snapshot";
+  // Start from this snapshot instead of the random initialization
+  std::string restoreFile;
+  // Print kinetic energy, bounds and live count of the simulation about once a second
+  bool stats = false;
+  bool benchmark = false;
+  bool sortBenchmark = false;
+  bool reduceBenchmark = false;
+  bool latencySweep = false;
+};
+
+// Throughput and latency of one frame loop run, what --latency-sweep compares across configurations
+struct FrameLoopResult {
+  double msPerFrame = 0.0;
+  double latencyMs = 0.0;
 };
 
 struct Particle {
   glm::vec2 position;
   glm::vec2 velocity;
+  // rgb is the color, a the size relative to the particle size option
   glm::vec4 color;
 
   static VkVertexInputBindingDescription getBindingDescription() {
@@ -112,18 +279,439 @@ struct Particle {
   }
 };
 
+// A Particle stored as half floats for --half, every pair of halves packed like GLSL's packHalf2x16. This is the layout
+// of both StoredParticle variants in src/shaders/particle.glsl with PARTICLE_HALF.
+struct HalfParticle {
+  uint32_t position;
+  uint32_t velocity;
+  uint32_t color[2];
+
+  static HalfParticle pack(const Particle& particle) {
+    const glm::vec4& color = particle.color;
+    return {glm::packHalf2x16(particle.position),
+            glm::packHalf2x16(particle.velocity),
+            {glm::packHalf2x16(glm::vec2(color.r, color.g)), glm::packHalf2x16(glm::vec2(color.b, color.a))}};
+  }
+
+  Particle unpack() const {
+    return {glm::unpackHalf2x16(position), glm::unpackHalf2x16(velocity),
+            glm::vec4(glm::unpackHalf2x16(color[0]), glm::unpackHalf2x16(color[1]))};
+  }
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(HalfParticle);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return bindingDescription;
+  }
+
+  static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
+
+    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = VK_FORMAT_R16G16_SFLOAT;
+    attributeDescriptions[0].offset = offsetof(HalfParticle, position);
+
+    attributeDescriptions[1].binding = 0;
+    attributeDescriptions[1].location = 1;
+    attributeDescriptions[1].format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    attributeDescriptions[1].offset = offsetof(HalfParticle, color);
+
+    return attributeDescriptions;
+  }
+};
+static_assert(sizeof(HalfParticle) * 2 == sizeof(Particle), "half precision particle layout changed");
+
+// A snapshot file is this header, zero padding up to dataOffset and then the raw particle array exactly as it is laid
+// out in the storage buffers. The data can be memory mapped as a Particle array and is written and read in chunks of
+// SNAPSHOT_CHUNK_SIZE, so states larger than the host memory stream through.
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t particleSize;
+  uint64_t particleCount;
+  uint64_t frame;
+  uint64_t dataOffset;
+  uint64_t reserved[3];
+};
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout changed");
+
+// Moves `from` over `to` in one step, so `to` is either the old or the new file and never missing. std::rename does
+// not replace an existing file on Windows.
+static bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+  return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Result of the statistics reduction, std430 layout of ParticleStats in src/shaders/particle_stats.glsl
+struct ParticleStats {
+  glm::vec2 boundsMin;
+  glm::vec2 boundsMax;
+  float kineticEnergy;
+  uint32_t liveCount;
+};
+
+// Same statistics on the host, every particle has mass 1 / particle count
+ParticleStats computeParticleStatsReference(const std::vector<Particle>& particles) {
+  ParticleStats stats{glm::vec2(std::numeric_limits<float>::max()), glm::vec2(-std::numeric_limits<float>::max()),
+                      0.0f, 0};
+  double kineticEnergy = 0.0;
+  for (const auto& particle : particles) {
+    stats.boundsMin = glm::min(stats.boundsMin, particle.position);
+    stats.boundsMax = glm::max(stats.boundsMax, particle.position);
+    kineticEnergy += 0.5 * glm::dot(particle.velocity, particle.velocity);
+    if (std::abs(particle.position.x) <= 1.0f && std::abs(particle.position.y) <= 1.0f) {
+      stats.liveCount++;
+    }
+  }
+  stats.kineticEnergy = static_cast<float>(kineticEnergy / particles.size());
+  return stats;
+}
+
+// Philox 2x32 with 10 rounds, a counter-based generator: the output only depends on the counter and the key, so every
+// particle draws its own numbers in any order and on any thread. Keep in sync with src/shaders/particle_init.comp.
+std::array<uint32_t, 2> philox2x32(std::array<uint32_t, 2> counter, uint32_t key) {
+  for (int round = 0; round < 10; round++) {
+    uint64_t product = static_cast<uint64_t>(0xD256D345u) * counter[0];
+    counter = {static_cast<uint32_t>(product >> 32) ^ key ^ counter[1], static_cast<uint32_t>(product)};
+    key += 0x9E3779B9u;
+  }
+  return counter;
+}
+
+// Uniform float in [0, 1) from the top 24 bits, exact in single precision
+float uniformFloat(uint32_t bits) { return (bits >> 8) * (1.0f / 16777216.0f); }
+
+// Particle `index` of the initial disk for `seed`
+Particle initialParticle(uint32_t index, uint32_t seed) {
+  std::array<uint32_t, 2> shape = philox2x32({index, 0}, seed);
+  std::array<uint32_t, 2> red = philox2x32({index, 1}, seed);
+  std::array<uint32_t, 2> blue = philox2x32({index, 2}, seed);
+
+  float r = INITIAL_DISK_RADIUS * sqrt(uniformFloat(shape[0]));
+  float theta = uniformFloat(shape[1]) * 2.0f * 3.14159265358979323846f;
+  float x = r * cos(theta) * HEIGHT / WIDTH;
+  float y = r * sin(theta);
+
+  Particle particle;
+  particle.position = glm::vec2(x, y);
+  particle.velocity = glm::normalize(glm::vec2(x, y)) * INITIAL_SPEED;
+  particle.color = glm::vec4(uniformFloat(red[0]), uniformFloat(red[1]), uniformFloat(blue[0]),
+                             0.5f + uniformFloat(blue[1]));
+  return particle;
+}
+
+// CPU reference of the integrate step in compute.comp
+void simulateIntegrateStepReference(const std::vector<Particle>& particlesIn, std::vector<Particle>& particlesOut,
+                                    float deltaTime) {
+  particlesOut.resize(particlesIn.size());
+  for (size_t i = 0; i < particlesIn.size(); i++) {
+    const Particle& particleIn = particlesIn[i];
+
+    Particle& particleOut = particlesOut[i];
+    particleOut.position = particleIn.position + particleIn.velocity * deltaTime;
+    particleOut.velocity = particleIn.velocity;
+    if ((particleOut.position.x <= -1.0f) || (particleOut.position.x >= 1.0f)) {
+      particleOut.velocity.x = -particleOut.velocity.x;
+    }
+    if ((particleOut.position.y <= -1.0f) || (particleOut.position.y >= 1.0f)) {
+      particleOut.velocity.y = -particleOut.velocity.y;
+    }
+    particleOut.color = particleIn.color;
+  }
+}
+
+// Grid resolution for a given particle count, see GRID_PARTICLES_PER_CELL
+uint32_t gridDimForParticleCount(uint32_t particleCount) {
+  // The initial disk is squashed by the aspect ratio and the domain is [-1, 1]^2
+  const float diskCoverage = 3.14159265358979323846f * INITIAL_DISK_RADIUS * INITIAL_DISK_RADIUS * HEIGHT / WIDTH / 4.0f;
+  float dim = std::ceil(std::sqrt(particleCount / (GRID_PARTICLES_PER_CELL * diskCoverage)));
+  return std::clamp(static_cast<uint32_t>(dim), MIN_GRID_DIM, MAX_GRID_DIM);
+}
+
+// CPU reference of the grid interaction step. Mirrors grid_count/grid_scan/grid_scatter/grid_interact.comp, only the
+// order in which neighbours are visited differs (the GPU fills cells with atomics), so results match up to rounding.
+void simulateGridStepReference(const std::vector<Particle>& particlesIn, std::vector<Particle>& particlesOut,
+                               uint32_t gridDim, float deltaTime) {
+  const float cellSize = 2.0f / gridDim;
+  const uint32_t particleCount = static_cast<uint32_t>(particlesIn.size());
+
+  auto cellCoord = [&](glm::vec2 position) {
+    glm::ivec2 coord = glm::ivec2(glm::floor((position + 1.0f) / cellSize));
+    return glm::clamp(coord, glm::ivec2(0), glm::ivec2(static_cast<int>(gridDim) - 1));
+  };
+
+  // Counting sort of the particles by cell
+  std::vector<uint32_t> cellStart(gridDim * gridDim + 1, 0);
+  std::vector<uint32_t> particleCell(particleCount);
+  for (uint32_t i = 0; i < particleCount; i++) {
+    glm::ivec2 coord = cellCoord(particlesIn[i].position);
+    particleCell[i] = coord.y * gridDim + coord.x;
+    cellStart[particleCell[i] + 1]++;
+  }
+  for (size_t c = 1; c < cellStart.size(); c++) {
+    cellStart[c] += cellStart[c - 1];
+  }
+  std::vector<uint32_t> cellFill(cellStart.begin(), cellStart.end() - 1);
+  std::vector<uint32_t> sortedIndices(particleCount);
+  for (uint32_t i = 0; i < particleCount; i++) {
+    sortedIndices[cellFill[particleCell[i]]++] = i;
+  }
+
+  particlesOut.resize(particleCount);
+  for (uint32_t i = 0; i < particleCount; i++) {
+    const Particle& particleIn = particlesIn[i];
+    glm::ivec2 cell = cellCoord(particleIn.position);
+
+    auto forEachNeighbour = [&](auto&& visit) {
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          glm::ivec2 neighbour = cell + glm::ivec2(dx, dy);
+          if (neighbour.x < 0 || neighbour.y < 0 || neighbour.x >= (int)gridDim || neighbour.y >= (int)gridDim) {
+            continue;
+          }
+          uint32_t c = neighbour.y * gridDim + neighbour.x;
+          for (uint32_t k = cellStart[c]; k < cellStart[c + 1]; k++) {
+            if (sortedIndices[k] != i) {
+              visit(particlesIn[sortedIndices[k]]);
+            }
+          }
+        }
+      }
+    };
+
+    float density = 0.0f;
+    forEachNeighbour([&](const Particle& other) {
+      float r = glm::distance(particleIn.position, other.position);
+      if (r < cellSize) {
+        float q = 1.0f - r / cellSize;
+        density += q * q;
+      }
+    });
+
+    glm::vec2 force(0.0f);
+    forEachNeighbour([&](const Particle& other) {
+      glm::vec2 d = particleIn.position - other.position;
+      float r = glm::length(d);
+      if (r < cellSize && r > 0.0f) {
+        float q = 1.0f - r / cellSize;
+        float push = q * (INTERACTION_REPULSION + INTERACTION_PRESSURE * density);
+        float pull = INTERACTION_COHESION * q * (1.0f - q);
+        force += (d / r) * (push - pull);
+      }
+    });
+
+    glm::vec2 velocity = particleIn.velocity + force * deltaTime;
+    float speed = glm::length(velocity);
+    if (speed > MAX_SPEED) {
+      velocity *= MAX_SPEED / speed;
+    }
+
+    Particle& particleOut = particlesOut[i];
+    particleOut.position = particleIn.position + velocity * deltaTime;
+    if ((particleOut.position.x <= -1.0f) || (particleOut.position.x >= 1.0f)) {
+      velocity.x = -velocity.x;
+    }
+    if ((particleOut.position.y <= -1.0f) || (particleOut.position.y >= 1.0f)) {
+      velocity.y = -velocity.y;
+    }
+    particleOut.velocity = velocity;
+    particleOut.color = particleIn.color;
+  }
+}
+
+// CPU reference of the all-pairs gravity step in nbody.comp and nbody_naive.comp
+void simulateNBodyStepReference(const std::vector<Particle>& particlesIn, std::vector<Particle>& particlesOut,
+                                float deltaTime) {
+  const size_t particleCount = particlesIn.size();
+  const float softening2 = NBODY_SOFTENING * NBODY_SOFTENING;
+
+  particlesOut.resize(particleCount);
+  for (size_t i = 0; i < particleCount; i++) {
+    const Particle& particleIn = particlesIn[i];
+
+    glm::vec2 acceleration(0.0f);
+    for (size_t j = 0; j < particleCount; j++) {
+      glm::vec2 d = particlesIn[j].position - particleIn.position;
+      float invDistance = 1.0f / std::sqrt(glm::dot(d, d) + softening2);
+      acceleration += d * (invDistance * invDistance * invDistance);
+    }
+
+    glm::vec2 velocity = particleIn.velocity + acceleration * (NBODY_GRAVITY / particleCount) * deltaTime;
+
+    Particle& particleOut = particlesOut[i];
+    particleOut.position = particleIn.position + velocity * deltaTime;
+    if ((particleOut.position.x <= -1.0f) || (particleOut.position.x >= 1.0f)) {
+      velocity.x = -velocity.x;
+    }
+    if ((particleOut.position.y <= -1.0f) || (particleOut.position.y >= 1.0f)) {
+      velocity.y = -velocity.y;
+    }
+    particleOut.velocity = velocity;
+    particleOut.color = particleIn.color;
+  }
+}
+
+// Quadtree node as read by barnes_hut.comp (std430). Nodes are stored depth first: the first child of an internal
+// node directly follows it and `next` is the node after the whole subtree. Leaves have bodyCount > 0.
+struct QuadNode {
+  glm::vec2 centerOfMass;
+  float mass;
+  float size;
+  uint32_t next;
+  uint32_t firstBody;
+  uint32_t bodyCount;
+  uint32_t pad;
+};
+
+struct Quadtree {
+  std::vector<QuadNode> nodes;
+  // Particle positions in Morton order, leaves index into this
+  std::vector<glm::vec2> bodies;
+};
+
+// Splits [0, count) into one contiguous chunk per hardware thread
+template <typename Function>
+void parallelFor(size_t count, Function function) {
+  size_t threadCount = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), count / 4096 + 1));
+  size_t chunkSize = (count + threadCount - 1) / threadCount;
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < threadCount; t++) {
+    size_t begin = t * chunkSize;
+    size_t end = std::min(count, begin + chunkSize);
+    threads.emplace_back([=]() {
+      for (size_t i = begin; i < end; i++) {
+        function(i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// Interleaves the bits of the quantized x and y coordinate in the [-1, 1] domain, x in the even bits
+uint32_t mortonCode(glm::vec2 position) {
+  auto spreadBits = [](uint32_t x) {
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+  };
+
+  const uint32_t maxCoord = (1u << MORTON_BITS_PER_AXIS) - 1;
+  glm::vec2 unit = glm::clamp((position + 1.0f) * 0.5f, 0.0f, 1.0f);
+  uint32_t x = std::min(static_cast<uint32_t>(unit.x * (maxCoord + 1)), maxCoord);
+  uint32_t y = std::min(static_cast<uint32_t>(unit.y * (maxCoord + 1)), maxCoord);
+  return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+// Emits the node for the sorted key range [begin, end) at `level` and its subtree, returns the node index
+uint32_t buildQuadtreeNode(const std::vector<std::pair<uint32_t, uint32_t>>& keys, Quadtree& tree, uint32_t begin,
+                           uint32_t end, uint32_t level) {
+  uint32_t index = static_cast<uint32_t>(tree.nodes.size());
+  tree.nodes.push_back({});
+
+  QuadNode node{};
+  node.size = 2.0f / static_cast<float>(1u << level);
+
+  glm::vec2 weightedPosition(0.0f);
+  if (end - begin <= QUADTREE_LEAF_CAPACITY || level == MORTON_BITS_PER_AXIS) {
+    node.firstBody = begin;
+    node.bodyCount = end - begin;
+    for (uint32_t i = begin; i < end; i++) {
+      weightedPosition += tree.bodies[i];
+    }
+    node.mass = static_cast<float>(end - begin);
+  } else {
+    // Keys in the range share their top `level` quadrant digits, so the children are consecutive sub-ranges
+    uint32_t shift = 2 * (MORTON_BITS_PER_AXIS - 1 - level);
+    uint32_t childBegin = begin;
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+      auto childEndIt = std::partition_point(keys.begin() + childBegin, keys.begin() + end, [&](const auto& key) {
+        return ((key.first >> shift) & 3) <= quadrant;
+      });
+      uint32_t childEnd = static_cast<uint32_t>(childEndIt - keys.begin());
+      if (childEnd > childBegin) {
+        uint32_t child = buildQuadtreeNode(keys, tree, childBegin, childEnd, level + 1);
+        weightedPosition += tree.nodes[child].centerOfMass * tree.nodes[child].mass;
+        node.mass += tree.nodes[child].mass;
+      }
+      childBegin = childEnd;
+    }
+  }
+
+  node.centerOfMass = weightedPosition / node.mass;
+  node.next = static_cast<uint32_t>(tree.nodes.size());
+  tree.nodes[index] = node;
+  return index;
+}
+
+// Builds the Barnes-Hut quadtree of the particle positions. Morton codes and the gather into Morton order run on all
+// cores, the sort and the depth-first emission of the nodes are serial.
+void buildQuadtree(const std::vector<Particle>& particles, Quadtree& tree) {
+  const uint32_t particleCount = static_cast<uint32_t>(particles.size());
+
+  std::vector<std::pair<uint32_t, uint32_t>> keys(particleCount);
+  parallelFor(particleCount, [&](size_t i) {
+    keys[i] = {mortonCode(particles[i].position), static_cast<uint32_t>(i)};
+  });
+  std::sort(keys.begin(), keys.end());
+
+  tree.bodies.resize(particleCount);
+  parallelFor(particleCount, [&](size_t i) { tree.bodies[i] = particles[keys[i].second].position; });
+
+  tree.nodes.clear();
+  if (particleCount == 0) {
+    return;
+  }
+  buildQuadtreeNode(keys, tree, 0, particleCount, 0);
+
+  // The last subtree on every path ends the traversal
+  for (auto& node : tree.nodes) {
+    if (node.next == tree.nodes.size()) {
+      node.next = QUADTREE_END;
+    }
+  }
+}
+
 class App {
  public:
+  explicit App(const Options& options)
+      : options(options), particleCount(options.particleCount), restorePending(!options.restoreFile.empty()) {}
+
   void run() {
     LOGFN;
 
     initWindow();
     initVulkan();
-    mainLoop();
+    if (options.driftSteps > 0) {
+      runDriftReport();
+    } else if (options.sortBenchmark) {
+      runSortBenchmark();
+    } else if (options.reduceBenchmark) {
+      runReduceBenchmark();
+    } else if (options.benchmark) {
+      runBenchmark();
+    } else {
+      mainLoop();
+    }
     cleanup();
   }
 
+  const FrameLoopResult& frameLoopResult() const { return frameLoop; }
+
  private:
+  Options options;
+
   GLFWwindow* window;
 
   VkInstance instance;
@@ -131,12 +719,20 @@ class App {
   VkSurfaceKHR surface;
 
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+  // 16-bit types in storage buffers, the half precision state then uses the _half16 shader variants
+  bool storage16Supported = false;
   VkDevice device;
 
   VkQueue graphicsQueue;
   VkQueue computeQueue;
   VkQueue presentQueue;
 
+  uint32_t graphicsQueueFamily;
+  uint32_t computeQueueFamily;
+  // The simulation runs on its own queue family and hands every new state over to the graphics family
+  bool asyncCompute = false;
+
   VkSwapchainKHR swapChain;
   std::vector<VkImage> swapChainImages;
   VkFormat swapChainImageFormat;
@@ -145,34 +741,160 @@ class App {
   std::vector<VkFramebuffer> swapChainFramebuffers;
 
   VkRenderPass renderPass;
+  VkDescriptorSetLayout renderDescriptorSetLayout;
   VkPipelineLayout pipelineLayout;
   VkPipeline graphicsPipeline;
+  // Quad path only, runs on the graphics queue with the graphics pipeline layout
+  VkPipeline particleCullPipeline = VK_NULL_HANDLE;
 
   VkDescriptorSetLayout computeDescriptorSetLayout;
   VkPipelineLayout computePipelineLayout;
   VkPipeline computePipeline;
 
+  VkPipeline gridCountPipeline;
+  std::array<VkPipeline, 3> gridScanPipelines;
+  VkPipeline gridScatterPipeline;
+  VkPipeline gridInteractPipeline;
+
+  VkPipeline nbodyPipeline;
+  VkPipeline nbodyNaivePipeline;
+  uint32_t nbodyGroupSize = NBODY_DEFAULT_TILE_SIZE;
+
+  VkPipeline barnesHutPipeline;
+
+  VkPipeline particleInitPipeline;
+
+  // The radix sort needs subgroup ballots and arithmetic, its pipelines are only created when both are available
+  bool subgroupSortSupported = false;
+  VkPipeline sortKeysPipeline = VK_NULL_HANDLE;
+  VkPipeline radixCountPipeline = VK_NULL_HANDLE;
+  std::array<VkPipeline, 3> radixScanPipelines = {VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE};
+  VkPipeline radixScatterPipeline = VK_NULL_HANDLE;
+  VkPipeline sortPermutePipeline = VK_NULL_HANDLE;
+
+  // Both phases of the statistics reduction, the subgroup variant only exists where subgroups support it
+  std::array<VkPipeline, 2> sharedStatsPipelines = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+  std::array<VkPipeline, 2> subgroupStatsPipelines = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+  std::array<VkPipeline, 2> statsPipelines;
+
   VkCommandPool commandPool;
+  VkCommandPool computeCommandPool;
 
+  uint32_t particleCount;
+  bool restorePending;
+  bool gpuInitPending = false;
   std::vector<VkBuffer> shaderStorageBuffers;
   std::vector<VkDeviceMemory> shaderStorageBuffersMemory;
 
+  // Async compute only: copies of the state that the graphics queue draws while the next step is simulated
+  std::vector<VkBuffer> renderBuffers;
+  std::vector<VkDeviceMemory> renderBuffersMemory;
+  std::vector<bool> renderBufferReleased;
+
+  // Output of the quad path's culling pre-pass, one pair per frame
+  std::vector<VkBuffer> visibleIndexBuffers;
+  std::vector<VkDeviceMemory> visibleIndexBuffersMemory;
+  std::vector<VkBuffer> drawIndirectBuffers;
+  std::vector<VkDeviceMemory> drawIndirectBuffersMemory;
+
+  uint32_t gridDim = 0;
+  VkBuffer cellCountBuffer;
+  VkDeviceMemory cellCountBufferMemory;
+  VkBuffer cellRangeBuffer;
+  VkDeviceMemory cellRangeBufferMemory;
+  VkBuffer particleCellBuffer;
+  VkDeviceMemory particleCellBufferMemory;
+  VkBuffer sortedIndexBuffer;
+  VkDeviceMemory sortedIndexBufferMemory;
+  VkBuffer blockSumBuffer;
+  VkDeviceMemory blockSumBufferMemory;
+
+  VkBuffer sortKeysBuffer;
+  VkDeviceMemory sortKeysBufferMemory;
+  VkBuffer sortValuesBuffer;
+  VkDeviceMemory sortValuesBufferMemory;
+  VkBuffer sortHistogramBuffer;
+  VkDeviceMemory sortHistogramBufferMemory;
+  VkBuffer sortBlockSumBuffer;
+  VkDeviceMemory sortBlockSumBufferMemory;
+  VkBuffer sortStateBuffer;
+  VkDeviceMemory sortStateBufferMemory;
+  VkBuffer sortedParticlesBuffer;
+  VkDeviceMemory sortedParticlesBufferMemory;
+
+  Quadtree quadtree;
+  std::vector<uint32_t> quadtreeNodeCapacity;
+  std::vector<VkBuffer> quadtreeNodeBuffers;
+  std::vector<VkDeviceMemory> quadtreeNodeBuffersMemory;
+  std::vector<void*> quadtreeNodeBuffersMapped;
+  std::vector<VkBuffer> quadtreeBodyBuffers;
+  std::vector<VkDeviceMemory> quadtreeBodyBuffersMemory;
+  std::vector<void*> quadtreeBodyBuffersMapped;
+
+  VkBuffer statsPartialsBuffer;
+  VkDeviceMemory statsPartialsBufferMemory;
+  std::vector<VkBuffer> statsBuffers;
+  std::vector<VkDeviceMemory> statsBuffersMemory;
+  std::vector<void*> statsBuffersMapped;
+  double lastStatsTime = 0.0;
+
+  // Snapshots copy the state to snapshotBuffer on the GPU, then read it back a chunk at a time through a small ring of
+  // mapped buffers. A chunk's data is ready once the compute timeline reaches its ring value, the file is written on
+  // another thread, one chunk at a time in order.
+  VkBuffer snapshotBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory snapshotBufferMemory;
+  std::vector<VkBuffer> snapshotRingBuffers;
+  std::vector<VkDeviceMemory> snapshotRingBuffersMemory;
+  std::vector<void*> snapshotRingBuffersMapped;
+  std::vector<uint64_t> snapshotRingValues;
+  bool snapshotActive = false;
+  std::ofstream snapshotFile;
+  uint64_t snapshotChunkCount = 0;
+  uint64_t snapshotChunksCopied = 0;
+  uint64_t snapshotChunksWritten = 0;
+  std::future<void> snapshotWrite;
+
+  VkQueryPool timestampQueryPool;
+  float timestampPeriod = 1.0f;
+
+  // Fragment shader invocations of every frame's draw, when the device supports pipeline statistics
+  bool pipelineStatisticsSupported = false;
+  VkQueryPool fragmentQueryPool = VK_NULL_HANDLE;
+  std::vector<bool> fragmentQueryWritten;
+  uint64_t fragmentInvocations = 0;
+  uint64_t fragmentQueryFrames = 0;
+
   std::vector<VkBuffer> uniformBuffers;
   std::vector<VkDeviceMemory> uniformBuffersMemory;
   std::vector<void*> uniformBuffersMapped;
 
   VkDescriptorPool descriptorPool;
   std::vector<VkDescriptorSet> computeDescriptorSets;
+  std::vector<VkDescriptorSet> renderDescriptorSets;
 
   std::vector<VkCommandBuffer> commandBuffers;
   std::vector<VkCommandBuffer> computeCommandBuffers;
 
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkSemaphore> computeFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
-  std::vector<VkFence> computeInFlightFences;
+  // One timeline per queue, every submission signals the next value
+  VkSemaphore computeTimeline;
+  uint64_t computeTimelineValue = 0;
+  VkSemaphore graphicsTimeline;
+  uint64_t graphicsTimelineValue = 0;
   uint32_t currentFrame = 0;
+  // Simulation steps recorded by the frame loop, the newest state is in buffer (simulationStep - 1) % stateBuffers
+  uint64_t simulationStep = 0;
+  // Start times of the submitted frames latencyThread has not seen finish yet, by graphics timeline value. The
+  // thread waits on the timeline for each in turn, so a finish time does not depend on when drawFrame() next runs.
+  std::deque<std::pair<uint64_t, double>> pendingFrameStarts;
+  std::thread latencyThread;
+  std::mutex latencyMutex;
+  std::condition_variable latencyCondition;
+  bool latencyThreadDone = false;
+  double frameLatencySum = 0.0;
+  uint64_t frameLatencyCount = 0;
+  FrameLoopResult frameLoop;
 
   float lastFrameTime = 0.0f;
 
@@ -180,6 +902,8 @@ class App {
 
   double lastTime = 0.0f;
 
+  uint64_t frameCount = 0;
+
   void initWindow() {
     LOGFN;
 
@@ -211,33 +935,73 @@ class App {
     createImageViews();
     createRenderPass();
     createComputeDescriptorSetLayout();
+    createRenderDescriptorSetLayout();
     createGraphicsPipeline();
-    createComputePipeline();
+    createComputePipelines();
     createFramebuffers();
     createCommandPool();
     createShaderStorageBuffers();
+    createGridBuffers();
+    createQuadtreeBuffers();
+    createSortBuffers();
+    createStatsBuffers();
+    createCullBuffers();
+    createSnapshotBuffers();
     createUniformBuffers();
     createDescriptorPool();
     createComputeDescriptorSets();
+    createRenderDescriptorSets();
+    if (gpuInitPending) {
+      initializeParticlesOnGpu();
+    }
     createCommandBuffers();
     createComputeCommandBuffers();
     createSyncObjects();
+    createTimestampQueryPool();
+    createFragmentQueryPool();
   }
 
   void mainLoop() {
     LOGFN;
 
-    while (!glfwWindowShouldClose(window)) {
-      glfwPollEvents();
-      drawFrame();
-      // We want to animate the particle system using the last frames time to get smooth, frame-rate independent
-      // animation
-      double currentTime = glfwGetTime();
-      lastFrameTime = (currentTime - lastTime) * 1000.0;
-      lastTime = currentTime;
+    LOG("Frame latencies are timed on their own thread, which waits for each frame's graphics timeline value");
+    latencyThread = std::thread(&App::measureFrameLatencies, this);
+
+    double startTime = glfwGetTime();
+    try {
+      while (!glfwWindowShouldClose(window) && (options.frameLimit == 0 || frameCount < options.frameLimit)) {
+        glfwPollEvents();
+        drawFrame();
+        frameCount++;
+        // We want to animate the particle system using the last frames time to get smooth, frame-rate independent
+        // animation
+        double currentTime = glfwGetTime();
+        lastFrameTime = (currentTime - lastTime) * 1000.0;
+        lastTime = currentTime;
+      }
+    } catch (...) {
+      stopLatencyThread();
+      throw;
     }
 
-    vkDeviceWaitIdle(device);
+    stopLatencyThread();
+    completeSnapshot();
+
+    if (frameCount > 0) {
+      frameLoop.msPerFrame = (glfwGetTime() - startTime) * 1000.0 / frameCount;
+      std::cout << frameCount << " frames, " << frameLoop.msPerFrame << " ms per frame ("
+                << (asyncCompute ? "async compute" : "single queue") << ")" << std::endl;
+    }
+    if (frameLatencyCount > 0) {
+      frameLoop.latencyMs = frameLatencySum * 1000.0 / frameLatencyCount;
+      std::cout << frameLoop.latencyMs << " ms from frame start to finished rendering ("
+                << options.framesInFlight << " frames in flight, " << options.stateBuffers << " state buffers)"
+                << std::endl;
+    }
+    if (fragmentQueryFrames > 0) {
+      std::cout << fragmentInvocations / fragmentQueryFrames << " fragment shader invocations per frame ("
+                << (options.renderMode == RenderMode::Quads ? "quads" : "points") << ")" << std::endl;
+    }
   }
 
   void cleanupSwapChain() {
@@ -260,14 +1024,36 @@ class App {
     cleanupSwapChain();
 
     vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    vkDestroyPipeline(device, particleCullPipeline, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
     vkDestroyPipeline(device, computePipeline, nullptr);
+    vkDestroyPipeline(device, gridCountPipeline, nullptr);
+    for (auto pipeline : gridScanPipelines) {
+      vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    vkDestroyPipeline(device, gridScatterPipeline, nullptr);
+    vkDestroyPipeline(device, gridInteractPipeline, nullptr);
+    vkDestroyPipeline(device, nbodyPipeline, nullptr);
+    vkDestroyPipeline(device, nbodyNaivePipeline, nullptr);
+    vkDestroyPipeline(device, barnesHutPipeline, nullptr);
+    vkDestroyPipeline(device, particleInitPipeline, nullptr);
+    vkDestroyPipeline(device, sortKeysPipeline, nullptr);
+    vkDestroyPipeline(device, radixCountPipeline, nullptr);
+    for (auto pipeline : radixScanPipelines) {
+      vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    vkDestroyPipeline(device, radixScatterPipeline, nullptr);
+    vkDestroyPipeline(device, sortPermutePipeline, nullptr);
+    for (size_t i = 0; i < statsPipelines.size(); i++) {
+      vkDestroyPipeline(device, sharedStatsPipelines[i], nullptr);
+      vkDestroyPipeline(device, subgroupStatsPipelines[i], nullptr);
+    }
     vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
 
     vkDestroyRenderPass(device, renderPass, nullptr);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < options.framesInFlight; i++) {
       vkDestroyBuffer(device, uniformBuffers[i], nullptr);
       vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
     }
@@ -275,21 +1061,42 @@ class App {
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
     vkDestroyDescriptorSetLayout(device, computeDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, renderDescriptorSetLayout, nullptr);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-      vkDestroyBuffer(device, shaderStorageBuffers[i], nullptr);
-      vkFreeMemory(device, shaderStorageBuffersMemory[i], nullptr);
+    destroyParticleBuffers();
+
+    if (snapshotBuffer != VK_NULL_HANDLE) {
+      vkDestroyBuffer(device, snapshotBuffer, nullptr);
+      vkFreeMemory(device, snapshotBufferMemory, nullptr);
+      for (size_t i = 0; i < snapshotRingBuffers.size(); i++) {
+        vkUnmapMemory(device, snapshotRingBuffersMemory[i]);
+        vkDestroyBuffer(device, snapshotRingBuffers[i], nullptr);
+        vkFreeMemory(device, snapshotRingBuffersMemory[i], nullptr);
+      }
+    }
+
+    vkDestroyBuffer(device, statsPartialsBuffer, nullptr);
+    vkFreeMemory(device, statsPartialsBufferMemory, nullptr);
+    for (size_t i = 0; i < options.framesInFlight; i++) {
+      vkUnmapMemory(device, statsBuffersMemory[i]);
+      vkDestroyBuffer(device, statsBuffers[i], nullptr);
+      vkFreeMemory(device, statsBuffersMemory[i], nullptr);
     }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+    if (fragmentQueryPool != VK_NULL_HANDLE) {
+      vkDestroyQueryPool(device, fragmentQueryPool, nullptr);
+    }
+
+    for (size_t i = 0; i < options.framesInFlight; i++) {
       vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
       vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-      vkDestroySemaphore(device, computeFinishedSemaphores[i], nullptr);
-      vkDestroyFence(device, inFlightFences[i], nullptr);
-      vkDestroyFence(device, computeInFlightFences[i], nullptr);
     }
+    vkDestroySemaphore(device, computeTimeline, nullptr);
+    vkDestroySemaphore(device, graphicsTimeline, nullptr);
 
     vkDestroyCommandPool(device, commandPool, nullptr);
+    vkDestroyCommandPool(device, computeCommandPool, nullptr);
 
     vkDestroyDevice(device, nullptr);
 
@@ -337,7 +1144,8 @@ class App {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    LOG("Timeline semaphores are core in Vulkan 1.2");
+    appInfo.apiVersion = VK_API_VERSION_1_2;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -423,6 +1231,14 @@ class App {
     if (physicalDevice == VK_NULL_HANDLE) {
       throw std::runtime_error("failed to find a suitable GPU!");
     }
+
+    LOG("Query the subgroup properties once, they decide which kernel variants get created");
+    subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &subgroupProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+    LOG("Subgroup size:", subgroupProperties.subgroupSize);
   }
 
   void createLogicalDevice() {
@@ -430,8 +1246,13 @@ class App {
 
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
+    asyncCompute = options.asyncCompute && indices.asyncComputeFamily.has_value();
+    graphicsQueueFamily = indices.graphicsAndComputeFamily.value();
+    computeQueueFamily = asyncCompute ? indices.asyncComputeFamily.value() : graphicsQueueFamily;
+    LOG("Async compute:", asyncCompute ? "on" : "off");
+
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsAndComputeFamily.value(), indices.presentFamily.value()};
+    std::set<uint32_t> uniqueQueueFamilies = {graphicsQueueFamily, indices.presentFamily.value(), computeQueueFamily};
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -443,10 +1264,38 @@ class App {
       queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures{};
+    LOG("Pipeline statistics are optional, they only feed the fragment invocation count");
+    pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery;
+    deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+
+    VkPhysicalDeviceVulkan11Features supportedVulkan11Features{};
+    supportedVulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+    VkPhysicalDeviceFeatures2 supportedFeatures2{};
+    supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures2.pNext = &supportedVulkan11Features;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+
+    VkPhysicalDeviceVulkan11Features vulkan11Features{};
+    vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+    if (options.halfPrecision) {
+      LOG("The half precision state converts to fp32 on load, it only needs 16-bit storage and not shaderFloat16");
+      storage16Supported = supportedVulkan11Features.storageBuffer16BitAccess;
+      vulkan11Features.storageBuffer16BitAccess = supportedVulkan11Features.storageBuffer16BitAccess;
+      LOG("16-bit storage:", storage16Supported ? "yes" : "no, halves are packed into uints");
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.pNext = &vulkan11Features;
+    LOGCALL(vulkan12Features.timelineSemaphore = VK_TRUE);
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &vulkan12Features;
 
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
@@ -460,8 +1309,8 @@ class App {
       throw std::runtime_error("failed to create logical device!");
     }
 
-    vkGetDeviceQueue(device, indices.graphicsAndComputeFamily.value(), 0, &graphicsQueue);
-    vkGetDeviceQueue(device, indices.graphicsAndComputeFamily.value(), 0, &computeQueue);
+    vkGetDeviceQueue(device, graphicsQueueFamily, 0, &graphicsQueue);
+    vkGetDeviceQueue(device, computeQueueFamily, 0, &computeQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
   }
 
@@ -592,28 +1441,26 @@ class App {
   void createComputeDescriptorSetLayout() {
     LOGFN;
 
-    std::array<VkDescriptorSetLayoutBinding, 3> layoutBindings{};
+    std::array<VkDescriptorSetLayoutBinding, COMPUTE_BINDING_COUNT> layoutBindings{};
     layoutBindings[0].binding = 0;
     layoutBindings[0].descriptorCount = 1;
     layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     layoutBindings[0].pImmutableSamplers = nullptr;
     layoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
-    layoutBindings[1].binding = 1;
-    layoutBindings[1].descriptorCount = 1;
-    layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    layoutBindings[1].pImmutableSamplers = nullptr;
-    layoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-    layoutBindings[2].binding = 2;
-    layoutBindings[2].descriptorCount = 1;
-    layoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    layoutBindings[2].pImmutableSamplers = nullptr;
-    layoutBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    LOG("Bindings 1 and 2 are the particle buffers, 3 to 7 hold the uniform grid, 8 and 9 the Barnes-Hut quadtree,");
+    LOG("10 to 15 the radix sort, 16 and 17 the statistics partials and result");
+    for (uint32_t binding = 1; binding < COMPUTE_BINDING_COUNT; binding++) {
+      layoutBindings[binding].binding = binding;
+      layoutBindings[binding].descriptorCount = 1;
+      layoutBindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      layoutBindings[binding].pImmutableSamplers = nullptr;
+      layoutBindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 3;
+    layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
     layoutInfo.pBindings = layoutBindings.data();
 
     if (LOGCALL(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &computeDescriptorSetLayout)) != VK_SUCCESS) {
@@ -621,11 +1468,37 @@ class App {
     }
   }
 
+  void createRenderDescriptorSetLayout() {
+    LOGFN;
+
+    LOG("Binding 0 is the uniform buffer, 1 the particles to draw, 2 and 3 the culling pre-pass output");
+    std::array<VkDescriptorSetLayoutBinding, 4> layoutBindings{};
+    for (uint32_t binding = 0; binding < layoutBindings.size(); binding++) {
+      layoutBindings[binding].binding = binding;
+      layoutBindings[binding].descriptorCount = 1;
+      layoutBindings[binding].descriptorType =
+          binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      layoutBindings[binding].pImmutableSamplers = nullptr;
+      layoutBindings[binding].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+    layoutInfo.pBindings = layoutBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &renderDescriptorSetLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create render descriptor set layout!");
+    }
+  }
+
   void createGraphicsPipeline() {
     LOGFN;
 
-    auto vertShaderCode = readFile("./bin/shaders/compute.vert.spv");
-    auto fragShaderCode = readFile("./bin/shaders/compute.frag.spv");
+    bool quads = options.renderMode == RenderMode::Quads;
+    LOG("Render mode:", quads ? "instanced quads" : "points");
+    auto vertShaderCode = readFile(quads ? particleShaderPath("particle_quad.vert") : "./bin/shaders/compute.vert.spv");
+    auto fragShaderCode = readFile(quads ? "./bin/shaders/particle_quad.frag.spv" : "./bin/shaders/compute.frag.spv");
 
     VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
     VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -647,17 +1520,24 @@ class App {
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-    auto bindingDescription = Particle::getBindingDescription();
-    auto attributeDescriptions = Particle::getAttributeDescriptions();
-
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    LOG("Points read the state as vertex attributes, the half precision state as 16-bit float formats");
+    auto bindingDescription =
+        options.halfPrecision ? HalfParticle::getBindingDescription() : Particle::getBindingDescription();
+    auto attributeDescriptions =
+        options.halfPrecision ? HalfParticle::getAttributeDescriptions() : Particle::getAttributeDescriptions();
+
+    if (!quads) {
+      vertexInputInfo.vertexBindingDescriptionCount = 1;
+      vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+      vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+      vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    } else {
+      LOG("Quads fetch their particle from the storage buffer by instance index, there is no vertex input");
+    }
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    inputAssembly.topology = quads ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
 
     VkPipelineViewportStateCreateInfo viewportState{};
@@ -671,7 +1551,8 @@ class App {
     rasterizer.rasterizerDiscardEnable = VK_FALSE;
     rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
     rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    LOG("Quads always face the viewer, the strip's winding alternates so it is not culled");
+    rasterizer.cullMode = quads ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
     rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
     rasterizer.depthBiasEnable = VK_FALSE;
 
@@ -690,6 +1571,12 @@ class App {
     colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
     colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
     colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    if (options.blendMode == BlendMode::Additive) {
+      LOG("Additive blending commutes, so the particles need no sorting and the culled draw order does not matter");
+      colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+      colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+      colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    }
 
     VkPipelineColorBlendStateCreateInfo colorBlending{};
     colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -710,8 +1597,8 @@ class App {
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pSetLayouts = nullptr;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &renderDescriptorSetLayout;
 
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
       throw std::runtime_error("failed to create pipeline layout!");
@@ -741,10 +1628,134 @@ class App {
     vkDestroyShaderModule(device, vertShaderModule, nullptr);
   }
 
-  void createComputePipeline() {
+  void createComputePipelines() {
+    LOGFN;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &computeDescriptorSetLayout;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create compute pipeline layout!");
+    }
+
+    LOG("All compute pipelines share the same layout, so the descriptor set stays bound across dispatches");
+    computePipeline = createComputePipeline(particleShaderPath("compute.comp"));
+
+    gridCountPipeline = createComputePipeline("./bin/shaders/grid_count.comp.spv");
+    LOG("The three grid scan phases are specializations of the same shader");
+    for (uint32_t phase = 0; phase < gridScanPipelines.size(); phase++) {
+      VkSpecializationMapEntry mapEntry{0, 0, sizeof(uint32_t)};
+      VkSpecializationInfo specializationInfo{1, &mapEntry, sizeof(uint32_t), &phase};
+      gridScanPipelines[phase] = createComputePipeline("./bin/shaders/grid_scan.comp.spv", &specializationInfo);
+    }
+    gridScatterPipeline = createComputePipeline("./bin/shaders/grid_scatter.comp.spv");
+    gridInteractPipeline = createComputePipeline("./bin/shaders/grid_interact.comp.spv");
+
+    if (!isTileSizeSupported(options.tileSize)) {
+      throw std::runtime_error("n-body tile size not supported by the device!");
+    }
+    nbodyGroupSize = options.tileSize;
+    nbodyPipeline = createNBodyPipeline(nbodyGroupSize);
+    nbodyNaivePipeline = createComputePipeline("./bin/shaders/nbody_naive.comp.spv");
+
+    barnesHutPipeline = createComputePipeline("./bin/shaders/barnes_hut.comp.spv");
+
+    LOG("The initialization kernel gets the seed as specialization constant 0");
+    VkSpecializationMapEntry seedEntry{0, 0, sizeof(uint32_t)};
+    VkSpecializationInfo seedInfo{1, &seedEntry, sizeof(uint32_t), &options.seed};
+    particleInitPipeline = createComputePipeline("./bin/shaders/particle_init.comp.spv", &seedInfo);
+
+    if (options.renderMode == RenderMode::Quads) {
+      LOG("The culling pre-pass shares the render descriptor set with the quad pipeline");
+      particleCullPipeline = createComputePipeline(particleShaderPath("particle_cull.comp"), nullptr, pipelineLayout);
+    }
+
+    subgroupSortSupported = hasSubgroupOperations(
+        VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT,
+        RADIX_BLOCK_SIZE);
+    if (subgroupSortSupported) {
+      sortKeysPipeline = createComputePipeline("./bin/shaders/sort_keys.comp.spv");
+      radixCountPipeline = createComputePipeline("./bin/shaders/radix_count.comp.spv");
+      for (uint32_t phase = 0; phase < radixScanPipelines.size(); phase++) {
+        VkSpecializationMapEntry mapEntry{0, 0, sizeof(uint32_t)};
+        VkSpecializationInfo specializationInfo{1, &mapEntry, sizeof(uint32_t), &phase};
+        radixScanPipelines[phase] = createComputePipeline("./bin/shaders/radix_scan.comp.spv", &specializationInfo);
+      }
+      radixScatterPipeline = createComputePipeline("./bin/shaders/radix_scatter.comp.spv");
+      sortPermutePipeline = createComputePipeline("./bin/shaders/sort_permute.comp.spv");
+    } else if (options.sortInterval > 0 || options.sortBenchmark) {
+      throw std::runtime_error("the radix sort needs subgroup ballot and arithmetic support in compute shaders!");
+    }
+
+    LOG("The statistics reduction has a shared memory fallback for devices without subgroup arithmetic");
+    for (uint32_t phase = 0; phase < statsPipelines.size(); phase++) {
+      VkSpecializationMapEntry mapEntry{0, 0, sizeof(uint32_t)};
+      VkSpecializationInfo specializationInfo{1, &mapEntry, sizeof(uint32_t), &phase};
+      sharedStatsPipelines[phase] =
+          createComputePipeline("./bin/shaders/particle_stats_shared.comp.spv", &specializationInfo);
+    }
+    bool subgroupStatsSupported = hasSubgroupOperations(
+        VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT,
+        STATS_GROUP_SIZE);
+    if (subgroupStatsSupported) {
+      for (uint32_t phase = 0; phase < statsPipelines.size(); phase++) {
+        VkSpecializationMapEntry mapEntry{0, 0, sizeof(uint32_t)};
+        VkSpecializationInfo specializationInfo{1, &mapEntry, sizeof(uint32_t), &phase};
+        subgroupStatsPipelines[phase] =
+            createComputePipeline("./bin/shaders/particle_stats_subgroup.comp.spv", &specializationInfo);
+      }
+    }
+    statsPipelines = subgroupStatsSupported ? subgroupStatsPipelines : sharedStatsPipelines;
+  }
+
+  // Whether compute shaders support the `required` subgroup operations with full subgroups in a workgroup of
+  // `workgroupSize` invocations
+  bool hasSubgroupOperations(VkSubgroupFeatureFlags required, uint32_t workgroupSize) {
+    return (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+           (subgroupProperties.supportedOperations & required) == required &&
+           subgroupProperties.subgroupSize <= workgroupSize;
+  }
+
+  bool isTileSizeSupported(uint32_t tileSize) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    return tileSize > 0 && tileSize <= properties.limits.maxComputeWorkGroupSize[0] &&
+           tileSize <= properties.limits.maxComputeWorkGroupInvocations &&
+           tileSize * sizeof(glm::vec2) <= properties.limits.maxComputeSharedMemorySize;
+  }
+
+  VkPipeline createNBodyPipeline(uint32_t tileSize) {
+    LOGFN;
+
+    LOG("Workgroup size and shared memory tile size come from specialization constant 0");
+    VkSpecializationMapEntry mapEntry{0, 0, sizeof(uint32_t)};
+    VkSpecializationInfo specializationInfo{1, &mapEntry, sizeof(uint32_t), &tileSize};
+    return createComputePipeline("./bin/shaders/nbody.comp.spv", &specializationInfo);
+  }
+
+  // Shaders that read or write the state are compiled once per storage format, see StoredParticle in particle.glsl
+  std::string particleShaderPath(const std::string& name) {
+    if (!options.halfPrecision) {
+      return "./bin/shaders/" + name + ".spv";
+    }
+    size_t extension = name.find('.');
+    return "./bin/shaders/" + name.substr(0, extension) + (storage16Supported ? "_half16" : "_half") +
+           name.substr(extension) + ".spv";
+  }
+
+  // Bytes per particle in the storage and render buffers
+  VkDeviceSize particleStride() const { return options.halfPrecision ? sizeof(HalfParticle) : sizeof(Particle); }
+
+  // Uses the simulation's pipeline layout unless `layout` is given
+  VkPipeline createComputePipeline(const std::string& filename,
+                                   const VkSpecializationInfo* specializationInfo = nullptr,
+                                   VkPipelineLayout layout = VK_NULL_HANDLE) {
     LOGFN;
 
-    auto computeShaderCode = readFile("./bin/shaders/compute.comp.spv");
+    auto computeShaderCode = readFile(filename);
 
     VkShaderModule computeShaderModule = createShaderModule(computeShaderCode);
 
@@ -754,26 +1765,21 @@ class App {
     LOGCALL(computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT);
     computeShaderStageInfo.module = computeShaderModule;
     computeShaderStageInfo.pName = "main";
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &computeDescriptorSetLayout;
-
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create compute pipeline layout!");
-    }
+    computeShaderStageInfo.pSpecializationInfo = specializationInfo;
 
     VkComputePipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    pipelineInfo.layout = computePipelineLayout;
+    pipelineInfo.layout = layout != VK_NULL_HANDLE ? layout : computePipelineLayout;
     pipelineInfo.stage = computeShaderStageInfo;
 
-    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
       throw std::runtime_error("failed to create compute pipeline!");
     }
 
     vkDestroyShaderModule(device, computeShaderModule, nullptr);
+
+    return pipeline;
   }
 
   void createFramebuffers() {
@@ -812,118 +1818,527 @@ class App {
     if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
       throw std::runtime_error("failed to create graphics command pool!");
     }
+
+    LOG("Compute and one-time transfer commands are recorded for the compute queue family");
+    poolInfo.queueFamilyIndex = computeQueueFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create compute command pool!");
+    }
   }
 
   void createShaderStorageBuffers() {
     LOGFN;
 
-    // Initialize particles
-    std::default_random_engine rndEngine((unsigned)time(nullptr));
-    std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
-
-    LOG("Initializing particles positions on a circle.");
-    std::vector<Particle> particles(PARTICLE_COUNT);
-    for (auto& particle : particles) {
-      float r = 0.25f * sqrt(rndDist(rndEngine));
-      float theta = rndDist(rndEngine) * 2.0f * 3.14159265358979323846f;
-      float x = r * cos(theta) * HEIGHT / WIDTH;
-      float y = r * sin(theta);
-      particle.position = glm::vec2(x, y);
-      particle.velocity = glm::normalize(glm::vec2(x, y)) * 0.00025f;
-      particle.color = glm::vec4(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine), 1.0f);
+    std::ifstream snapshot;
+    if (restorePending) {
+      LOG("Restore the particles from a snapshot instead of the random initialization");
+      restorePending = false;
+      snapshot = openSnapshot(options.restoreFile);
     }
 
-    LOGCALL(VkDeviceSize bufferSize = sizeof(Particle) * PARTICLE_COUNT);
+    LOGCALL(VkDeviceSize bufferSize = particleStride() * particleCount);
 
-    LOG("Create a staging buffer used to upload data to the gpu");
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory);
+    shaderStorageBuffers.resize(options.stateBuffers);
+    shaderStorageBuffersMemory.resize(options.stateBuffers);
+    for (size_t i = 0; i < options.stateBuffers; i++) {
+      createBuffer(bufferSize,
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shaderStorageBuffers[i], shaderStorageBuffersMemory[i]);
+    }
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, particles.data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    if (snapshot.is_open()) {
+      restoreSnapshot(snapshot);
+    } else if (options.gpuInit) {
+      LOG("particle_init.comp fills the storage buffers once the descriptor sets exist, no staging upload");
+      gpuInitPending = true;
+    } else {
+      LOG("Create a staging buffer used to upload data to the gpu");
+      VkBuffer stagingBuffer;
+      VkDeviceMemory stagingBufferMemory;
+      createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
+                   stagingBufferMemory);
+
+      LOG("Initializing particles positions on a circle, in parallel straight into the staging buffer. Seed:",
+          options.seed);
+      void* data;
+      vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+      if (options.halfPrecision) {
+        LOG("The half precision state is generated in fp32 and rounded once");
+        HalfParticle* particles = static_cast<HalfParticle*>(data);
+        parallelFor(particleCount, [&](size_t i) {
+          particles[i] = HalfParticle::pack(initialParticle(static_cast<uint32_t>(i), options.seed));
+        });
+      } else {
+        Particle* particles = static_cast<Particle*>(data);
+        parallelFor(particleCount, [&](size_t i) {
+          particles[i] = initialParticle(static_cast<uint32_t>(i), options.seed);
+        });
+      }
+      vkUnmapMemory(device, stagingBufferMemory);
 
-    shaderStorageBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    shaderStorageBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+      LOG("Copy initial particle data to all storage buffers");
+      for (size_t i = 0; i < options.stateBuffers; i++) {
+        copyBuffer(stagingBuffer, shaderStorageBuffers[i], bufferSize);
+      }
 
-    LOG("Copy initial particle data to all storage buffers");
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-      createBuffer(
-          bufferSize,
-          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shaderStorageBuffers[i], shaderStorageBuffersMemory[i]);
-      copyBuffer(stagingBuffer, shaderStorageBuffers[i], bufferSize);
+      vkDestroyBuffer(device, stagingBuffer, nullptr);
+      vkFreeMemory(device, stagingBufferMemory, nullptr);
     }
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    if (asyncCompute) {
+      LOG("The storage buffers never leave the compute family, the graphics queue draws from copies");
+      renderBuffers.resize(options.framesInFlight);
+      renderBuffersMemory.resize(options.framesInFlight);
+      renderBufferReleased.assign(options.framesInFlight, false);
+      for (size_t i = 0; i < options.framesInFlight; i++) {
+        createBuffer(bufferSize,
+                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderBuffers[i], renderBuffersMemory[i]);
+      }
+    }
   }
 
-  void createUniformBuffers() {
+  // Generates the initial state in storage buffer 0 with particle_init.comp and copies it to the other buffers
+  void initializeParticlesOnGpu() {
     LOGFN;
 
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    LOG("The kernel only reads the particle count from the uniform buffer");
+    writeUniformBuffer(0, 0.0f);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-      createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i],
-                   uniformBuffersMemory[i]);
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1,
+                            &computeDescriptorSets[0], 0, nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleInitPipeline);
+    vkCmdDispatch(commandBuffer, (particleCount + 255) / 256, 1, 1);
 
-      vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    VkBufferCopy copyRegion{};
+    copyRegion.size = sizeof(Particle) * particleCount;
+    for (size_t i = 1; i < options.stateBuffers; i++) {
+      vkCmdCopyBuffer(commandBuffer, shaderStorageBuffers[0], shaderStorageBuffers[i], 1, &copyRegion);
     }
+    endSingleTimeCommands(commandBuffer);
+
+    gpuInitPending = false;
   }
 
-  void createDescriptorPool() {
+  // Reads and checks a snapshot's header, sets the particle count and leaves the stream at the particle data
+  std::ifstream openSnapshot(const std::string& filename) {
     LOGFN;
 
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to open snapshot " + filename + "!");
+    }
 
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
+    SnapshotHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.particleSize != sizeof(Particle) || header.particleCount == 0 ||
+        header.particleCount > std::numeric_limits<uint32_t>::max()) {
+      throw std::runtime_error("not a compatible particle snapshot: " + filename);
+    }
 
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 2;
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    LOG("The particle data has to start after the header and end within the file");
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    uint64_t dataSize = header.particleCount * sizeof(Particle);
+    if (!file || header.dataOffset < sizeof(header) || header.dataOffset > fileSize ||
+        fileSize - header.dataOffset < dataSize) {
+      throw std::runtime_error("particle snapshot is truncated or corrupt: " + filename);
+    }
+
+    particleCount = static_cast<uint32_t>(header.particleCount);
+    file.seekg(static_cast<std::streamoff>(header.dataOffset));
+    std::cout << "Restoring " << particleCount << " particles from frame " << header.frame << " of " << filename
+              << std::endl;
+    return file;
+  }
+
+  // Streams the particle data of `snapshot` into all storage buffers through one chunk sized staging buffer
+  void restoreSnapshot(std::ifstream& snapshot) {
+    LOGFN;
+
+    VkDeviceSize stateSize = sizeof(Particle) * particleCount;
+    VkDeviceSize stagingSize = std::min(SNAPSHOT_CHUNK_SIZE, stateSize);
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
+                 stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, stagingSize, 0, &data);
+    for (VkDeviceSize offset = 0; offset < stateSize; offset += stagingSize) {
+      VkDeviceSize size = std::min(stagingSize, stateSize - offset);
+      snapshot.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+      if (!snapshot) {
+        throw std::runtime_error("particle snapshot is truncated!");
+      }
+
+      VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+      VkBufferCopy copyRegion{0, offset, size};
+      for (auto buffer : shaderStorageBuffers) {
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+      }
+      endSingleTimeCommands(commandBuffer);
+    }
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+  }
+
+  void createGridBuffers() {
+    LOGFN;
+
+    gridDim = gridDimForParticleCount(particleCount);
+    LOG("Grid resolution: ", gridDim, "x", gridDim);
+
+    VkDeviceSize cellCount = static_cast<VkDeviceSize>(gridDim) * gridDim;
+    VkDeviceSize blockCount = (cellCount + GRID_SCAN_BLOCK_SIZE - 1) / GRID_SCAN_BLOCK_SIZE;
+
+    LOG("Cell counts are cleared with vkCmdFillBuffer every step");
+    createBuffer(cellCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cellCountBuffer, cellCountBufferMemory);
+    createBuffer(cellCount * 2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cellRangeBuffer, cellRangeBufferMemory);
+    createBuffer(static_cast<VkDeviceSize>(particleCount) * 2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particleCellBuffer, particleCellBufferMemory);
+    createBuffer(static_cast<VkDeviceSize>(particleCount) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortedIndexBuffer, sortedIndexBufferMemory);
+    createBuffer(blockCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 blockSumBuffer, blockSumBufferMemory);
+  }
+
+  void createSortBuffers() {
+    LOGFN;
+
+    VkDeviceSize blockCount = (particleCount + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+    VkDeviceSize histogramSize = blockCount * RADIX_DIGITS;
+    VkDeviceSize scanBlockCount = (histogramSize + RADIX_SCAN_BLOCK_SIZE - 1) / RADIX_SCAN_BLOCK_SIZE;
+
+    LOG("Keys and values have two halves that every sort pass ping-pongs between");
+    createBuffer(static_cast<VkDeviceSize>(particleCount) * 2 * sizeof(uint32_t),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortKeysBuffer, sortKeysBufferMemory);
+    createBuffer(static_cast<VkDeviceSize>(particleCount) * 2 * sizeof(uint32_t),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortValuesBuffer, sortValuesBufferMemory);
+    createBuffer(histogramSize * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortHistogramBuffer, sortHistogramBufferMemory);
+    createBuffer(scanBlockCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortBlockSumBuffer, sortBlockSumBufferMemory);
+    LOG("The pass state is written with vkCmdUpdateBuffer between the passes");
+    createBuffer(2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortStateBuffer, sortStateBufferMemory);
+    createBuffer(sizeof(Particle) * particleCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortedParticlesBuffer, sortedParticlesBufferMemory);
+  }
+
+  void createCullBuffers() {
+    LOGFN;
+
+    LOG("The culling pre-pass writes the visible particle indices and the indirect draw, one pair per frame");
+    visibleIndexBuffers.resize(options.framesInFlight);
+    visibleIndexBuffersMemory.resize(options.framesInFlight);
+    drawIndirectBuffers.resize(options.framesInFlight);
+    drawIndirectBuffersMemory.resize(options.framesInFlight);
+    for (size_t i = 0; i < options.framesInFlight; i++) {
+      createBuffer(static_cast<VkDeviceSize>(particleCount) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibleIndexBuffers[i], visibleIndexBuffersMemory[i]);
+      createBuffer(sizeof(VkDrawIndirectCommand),
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawIndirectBuffers[i], drawIndirectBuffersMemory[i]);
+    }
+  }
+
+  void createSnapshotBuffers() {
+    LOGFN;
+
+    if (options.snapshotInterval == 0) {
+      return;
+    }
+
+    VkDeviceSize stateSize = sizeof(Particle) * particleCount;
+    VkDeviceSize chunkSize = std::min(SNAPSHOT_CHUNK_SIZE, stateSize);
+
+    LOG("Snapshots first copy the whole state on the GPU, so the simulation can go on while it is read back");
+    createBuffer(stateSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, snapshotBuffer, snapshotBufferMemory);
+
+    LOG("The read back goes through a ring of", SNAPSHOT_RING_SIZE, "chunks of", chunkSize, "bytes");
+    snapshotRingBuffers.resize(SNAPSHOT_RING_SIZE);
+    snapshotRingBuffersMemory.resize(SNAPSHOT_RING_SIZE);
+    snapshotRingBuffersMapped.resize(SNAPSHOT_RING_SIZE);
+    snapshotRingValues.assign(SNAPSHOT_RING_SIZE, 0);
+    for (size_t i = 0; i < SNAPSHOT_RING_SIZE; i++) {
+      createBuffer(chunkSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, snapshotRingBuffers[i],
+                   snapshotRingBuffersMemory[i]);
+      vkMapMemory(device, snapshotRingBuffersMemory[i], 0, chunkSize, 0, &snapshotRingBuffersMapped[i]);
+    }
+  }
+
+  void createStatsBuffers() {
+    LOGFN;
+
+    LOG("Phase 0 of the statistics reduction writes one partial per workgroup, phase 1 reduces them without atomics");
+    createBuffer(sizeof(ParticleStats) * STATS_MAX_GROUPS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, statsPartialsBuffer, statsPartialsBufferMemory);
+
+    LOG("The result goes straight into a tiny mapped buffer per frame, read once the frame's slot comes around again");
+    statsBuffers.resize(options.framesInFlight);
+    statsBuffersMemory.resize(options.framesInFlight);
+    statsBuffersMapped.resize(options.framesInFlight);
+    for (size_t i = 0; i < options.framesInFlight; i++) {
+      createBuffer(sizeof(ParticleStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, statsBuffers[i],
+                   statsBuffersMemory[i]);
+      vkMapMemory(device, statsBuffersMemory[i], 0, sizeof(ParticleStats), 0, &statsBuffersMapped[i]);
+    }
+  }
+
+  void createQuadtreeBuffers() {
+    LOGFN;
+
+    LOG("The quadtree is rebuilt on the host every step, so each frame in flight gets its own mapped copy");
+    quadtreeNodeCapacity.assign(options.framesInFlight, 0);
+    quadtreeNodeBuffers.resize(options.framesInFlight);
+    quadtreeNodeBuffersMemory.resize(options.framesInFlight);
+    quadtreeNodeBuffersMapped.resize(options.framesInFlight);
+    quadtreeBodyBuffers.resize(options.framesInFlight);
+    quadtreeBodyBuffersMemory.resize(options.framesInFlight);
+    quadtreeBodyBuffersMapped.resize(options.framesInFlight);
+
+    VkDeviceSize bodyBufferSize = sizeof(glm::vec2) * particleCount;
+    for (size_t i = 0; i < options.framesInFlight; i++) {
+      createQuadtreeNodeBuffer(i, std::max<uint32_t>(1, particleCount / QUADTREE_LEAF_CAPACITY * 2));
+
+      createBuffer(bodyBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, quadtreeBodyBuffers[i],
+                   quadtreeBodyBuffersMemory[i]);
+      vkMapMemory(device, quadtreeBodyBuffersMemory[i], 0, bodyBufferSize, 0, &quadtreeBodyBuffersMapped[i]);
+    }
+  }
+
+  void createQuadtreeNodeBuffer(size_t frame, uint32_t nodeCapacity) {
+    LOGFN;
+
+    VkDeviceSize bufferSize = sizeof(QuadNode) * nodeCapacity;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 quadtreeNodeBuffers[frame], quadtreeNodeBuffersMemory[frame]);
+    vkMapMemory(device, quadtreeNodeBuffersMemory[frame], 0, bufferSize, 0, &quadtreeNodeBuffersMapped[frame]);
+    quadtreeNodeCapacity[frame] = nodeCapacity;
+  }
+
+  void destroyQuadtreeNodeBuffer(size_t frame) {
+    vkUnmapMemory(device, quadtreeNodeBuffersMemory[frame]);
+    vkDestroyBuffer(device, quadtreeNodeBuffers[frame], nullptr);
+    vkFreeMemory(device, quadtreeNodeBuffersMemory[frame], nullptr);
+  }
+
+  // Copies `quadtree` into the buffers of `frame`, whose previous step must have finished
+  void uploadQuadtree(uint32_t frame) {
+    LOGFN_ONCE;
+
+    uint32_t nodeCount = static_cast<uint32_t>(quadtree.nodes.size());
+    if (nodeCount > quadtreeNodeCapacity[frame]) {
+      LOG_ONCE("Grow the node buffer and point the frame's descriptor sets at the new one");
+      destroyQuadtreeNodeBuffer(frame);
+      createQuadtreeNodeBuffer(frame, nodeCount * 2);
+
+      VkDescriptorBufferInfo bufferInfo{quadtreeNodeBuffers[frame], 0, VK_WHOLE_SIZE};
+      for (uint32_t state = 0; state < options.stateBuffers; state++) {
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = computeDescriptorSet(frame, state);
+        write.dstBinding = 8;
+        write.dstArrayElement = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+      }
+    }
+
+    memcpy(quadtreeNodeBuffersMapped[frame], quadtree.nodes.data(), sizeof(QuadNode) * nodeCount);
+    memcpy(quadtreeBodyBuffersMapped[frame], quadtree.bodies.data(), sizeof(glm::vec2) * quadtree.bodies.size());
+  }
+
+  void destroyParticleBuffers() {
+    LOGFN;
+
+    for (size_t i = 0; i < shaderStorageBuffers.size(); i++) {
+      vkDestroyBuffer(device, shaderStorageBuffers[i], nullptr);
+      vkFreeMemory(device, shaderStorageBuffersMemory[i], nullptr);
+    }
+    shaderStorageBuffers.clear();
+    shaderStorageBuffersMemory.clear();
+
+    for (size_t i = 0; i < renderBuffers.size(); i++) {
+      vkDestroyBuffer(device, renderBuffers[i], nullptr);
+      vkFreeMemory(device, renderBuffersMemory[i], nullptr);
+    }
+    renderBuffers.clear();
+    renderBuffersMemory.clear();
+
+    for (size_t i = 0; i < visibleIndexBuffers.size(); i++) {
+      vkDestroyBuffer(device, visibleIndexBuffers[i], nullptr);
+      vkFreeMemory(device, visibleIndexBuffersMemory[i], nullptr);
+      vkDestroyBuffer(device, drawIndirectBuffers[i], nullptr);
+      vkFreeMemory(device, drawIndirectBuffersMemory[i], nullptr);
+    }
+    visibleIndexBuffers.clear();
+    drawIndirectBuffers.clear();
+
+    vkDestroyBuffer(device, cellCountBuffer, nullptr);
+    vkFreeMemory(device, cellCountBufferMemory, nullptr);
+    vkDestroyBuffer(device, cellRangeBuffer, nullptr);
+    vkFreeMemory(device, cellRangeBufferMemory, nullptr);
+    vkDestroyBuffer(device, particleCellBuffer, nullptr);
+    vkFreeMemory(device, particleCellBufferMemory, nullptr);
+    vkDestroyBuffer(device, sortedIndexBuffer, nullptr);
+    vkFreeMemory(device, sortedIndexBufferMemory, nullptr);
+    vkDestroyBuffer(device, blockSumBuffer, nullptr);
+    vkFreeMemory(device, blockSumBufferMemory, nullptr);
+
+    std::array<std::pair<VkBuffer, VkDeviceMemory>, 6> sortBuffers = {
+        std::make_pair(sortKeysBuffer, sortKeysBufferMemory),
+        std::make_pair(sortValuesBuffer, sortValuesBufferMemory),
+        std::make_pair(sortHistogramBuffer, sortHistogramBufferMemory),
+        std::make_pair(sortBlockSumBuffer, sortBlockSumBufferMemory),
+        std::make_pair(sortStateBuffer, sortStateBufferMemory),
+        std::make_pair(sortedParticlesBuffer, sortedParticlesBufferMemory)};
+    for (auto& [buffer, memory] : sortBuffers) {
+      vkDestroyBuffer(device, buffer, nullptr);
+      vkFreeMemory(device, memory, nullptr);
+    }
+
+    for (size_t i = 0; i < quadtreeNodeBuffers.size(); i++) {
+      destroyQuadtreeNodeBuffer(i);
+      vkUnmapMemory(device, quadtreeBodyBuffersMemory[i]);
+      vkDestroyBuffer(device, quadtreeBodyBuffers[i], nullptr);
+      vkFreeMemory(device, quadtreeBodyBuffersMemory[i], nullptr);
+    }
+    quadtreeNodeBuffers.clear();
+    quadtreeBodyBuffers.clear();
+  }
+
+  // Recreates everything that depends on the particle count, used by the benchmark
+  void resizeParticleSystem(uint32_t count) {
+    LOGFN;
+
+    vkDeviceWaitIdle(device);
+
+    destroyParticleBuffers();
+    vkResetDescriptorPool(device, descriptorPool, 0);
+
+    particleCount = count;
+    createShaderStorageBuffers();
+    createGridBuffers();
+    createQuadtreeBuffers();
+    createSortBuffers();
+    createCullBuffers();
+    createComputeDescriptorSets();
+    createRenderDescriptorSets();
+    if (gpuInitPending) {
+      initializeParticlesOnGpu();
+    }
+  }
+
+  void createUniformBuffers() {
+    LOGFN;
+
+    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+
+    uniformBuffers.resize(options.framesInFlight);
+    uniformBuffersMemory.resize(options.framesInFlight);
+    uniformBuffersMapped.resize(options.framesInFlight);
+
+    for (size_t i = 0; i < options.framesInFlight; i++) {
+      createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i],
+                   uniformBuffersMemory[i]);
+
+      vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+    }
+  }
+
+  void createDescriptorPool() {
+    LOGFN;
+
+    LOG("Every frame has a compute and a render descriptor set per state buffer, each with one uniform buffer");
+    uint32_t setsPerKind = options.framesInFlight * options.stateBuffers;
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = setsPerKind * 2;
+
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = setsPerKind * (COMPUTE_BINDING_COUNT - 1 + 3);
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = setsPerKind * 2;
 
     if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
       throw std::runtime_error("failed to create descriptor pool!");
     }
   }
 
+  // Set of frame slot `frame` for simulation step `step`: it reads state buffer (step - 1) % stateBuffers, writes
+  // step % stateBuffers and uses the frame's uniform, quadtree and statistics buffers
+  VkDescriptorSet computeDescriptorSet(uint32_t frame, uint64_t step) const {
+    return computeDescriptorSets[frame * options.stateBuffers + step % options.stateBuffers];
+  }
+
+  // State buffer the newest recorded step wrote, before the first step all of them hold the initial state
+  uint32_t latestStateBuffer() const {
+    return static_cast<uint32_t>((simulationStep + options.stateBuffers - 1) % options.stateBuffers);
+  }
+
+  // Render set of the current frame, drawing the newest state
+  const VkDescriptorSet& renderDescriptorSet() const {
+    return renderDescriptorSets[currentFrame * options.stateBuffers + latestStateBuffer()];
+  }
+
   void createComputeDescriptorSets() {
     LOGFN;
 
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, computeDescriptorSetLayout);
+    LOG("One set per frame in flight and state buffer, see computeDescriptorSet()");
+    uint32_t setCount = options.framesInFlight * options.stateBuffers;
+    std::vector<VkDescriptorSetLayout> layouts(setCount, computeDescriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.descriptorSetCount = setCount;
     allocInfo.pSetLayouts = layouts.data();
 
-    computeDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    computeDescriptorSets.resize(setCount);
     if (vkAllocateDescriptorSets(device, &allocInfo, computeDescriptorSets.data()) != VK_SUCCESS) {
       throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < setCount; i++) {
+      size_t frame = i / options.stateBuffers;
+      size_t state = i % options.stateBuffers;
+
       VkDescriptorBufferInfo uniformBufferInfo{};
-      uniformBufferInfo.buffer = uniformBuffers[i];
+      uniformBufferInfo.buffer = uniformBuffers[frame];
       uniformBufferInfo.offset = 0;
       uniformBufferInfo.range = sizeof(UniformBufferObject);
 
-      std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+      std::array<VkWriteDescriptorSet, COMPUTE_BINDING_COUNT> descriptorWrites{};
       descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
       descriptorWrites[0].dstSet = computeDescriptorSets[i];
       descriptorWrites[0].dstBinding = 0;
@@ -934,9 +2349,10 @@ class App {
 
       LOG("Storage buffer info last frame...");
       VkDescriptorBufferInfo storageBufferInfoLastFrame{};
-      LOGCALL(storageBufferInfoLastFrame.buffer = shaderStorageBuffers[(i - 1) % MAX_FRAMES_IN_FLIGHT]);
+      LOGCALL(storageBufferInfoLastFrame.buffer =
+                  shaderStorageBuffers[(state + options.stateBuffers - 1) % options.stateBuffers]);
       storageBufferInfoLastFrame.offset = 0;
-      storageBufferInfoLastFrame.range = sizeof(Particle) * PARTICLE_COUNT;
+      storageBufferInfoLastFrame.range = particleStride() * particleCount;
 
       descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
       descriptorWrites[1].dstSet = computeDescriptorSets[i];
@@ -948,9 +2364,9 @@ class App {
 
       LOG("Storage buffer for current frame...");
       VkDescriptorBufferInfo storageBufferInfoCurrentFrame{};
-      LOGCALL(storageBufferInfoCurrentFrame.buffer = shaderStorageBuffers[i]);
+      LOGCALL(storageBufferInfoCurrentFrame.buffer = shaderStorageBuffers[state]);
       storageBufferInfoCurrentFrame.offset = 0;
-      storageBufferInfoCurrentFrame.range = sizeof(Particle) * PARTICLE_COUNT;
+      storageBufferInfoCurrentFrame.range = particleStride() * particleCount;
 
       descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
       descriptorWrites[2].dstSet = computeDescriptorSets[i];
@@ -960,7 +2376,119 @@ class App {
       descriptorWrites[2].descriptorCount = 1;
       descriptorWrites[2].pBufferInfo = &storageBufferInfoCurrentFrame;
 
-      vkUpdateDescriptorSets(device, 3, descriptorWrites.data(), 0, nullptr);
+      LOG("Grid buffers are shared by all frames, steps are serialized on the compute queue");
+      std::array<VkBuffer, 5> gridBuffers = {cellCountBuffer, cellRangeBuffer, particleCellBuffer, sortedIndexBuffer,
+                                             blockSumBuffer};
+      std::array<VkDescriptorBufferInfo, 5> gridBufferInfos{};
+      for (size_t j = 0; j < gridBuffers.size(); j++) {
+        gridBufferInfos[j].buffer = gridBuffers[j];
+        gridBufferInfos[j].offset = 0;
+        gridBufferInfos[j].range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet& write = descriptorWrites[3 + j];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = computeDescriptorSets[i];
+        write.dstBinding = static_cast<uint32_t>(3 + j);
+        write.dstArrayElement = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &gridBufferInfos[j];
+      }
+
+      LOG("Quadtree buffers are written by the host, one pair per frame");
+      std::array<VkDescriptorBufferInfo, 2> quadtreeBufferInfos{};
+      quadtreeBufferInfos[0] = {quadtreeNodeBuffers[frame], 0, VK_WHOLE_SIZE};
+      quadtreeBufferInfos[1] = {quadtreeBodyBuffers[frame], 0, VK_WHOLE_SIZE};
+      for (size_t j = 0; j < quadtreeBufferInfos.size(); j++) {
+        VkWriteDescriptorSet& write = descriptorWrites[8 + j];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = computeDescriptorSets[i];
+        write.dstBinding = static_cast<uint32_t>(8 + j);
+        write.dstArrayElement = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &quadtreeBufferInfos[j];
+      }
+
+      LOG("Radix sort buffers are shared by all frames as well");
+      std::array<VkBuffer, 6> sortBuffers = {sortKeysBuffer,      sortValuesBuffer, sortHistogramBuffer,
+                                             sortBlockSumBuffer,  sortStateBuffer,  sortedParticlesBuffer};
+      std::array<VkDescriptorBufferInfo, 6> sortBufferInfos{};
+      for (size_t j = 0; j < sortBuffers.size(); j++) {
+        sortBufferInfos[j] = {sortBuffers[j], 0, VK_WHOLE_SIZE};
+
+        VkWriteDescriptorSet& write = descriptorWrites[10 + j];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = computeDescriptorSets[i];
+        write.dstBinding = static_cast<uint32_t>(10 + j);
+        write.dstArrayElement = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &sortBufferInfos[j];
+      }
+
+      LOG("The statistics partials are shared, the result buffer belongs to the frame");
+      std::array<VkDescriptorBufferInfo, 2> statsBufferInfos{};
+      statsBufferInfos[0] = {statsPartialsBuffer, 0, VK_WHOLE_SIZE};
+      statsBufferInfos[1] = {statsBuffers[frame], 0, VK_WHOLE_SIZE};
+      for (size_t j = 0; j < statsBufferInfos.size(); j++) {
+        VkWriteDescriptorSet& write = descriptorWrites[16 + j];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = computeDescriptorSets[i];
+        write.dstBinding = static_cast<uint32_t>(16 + j);
+        write.dstArrayElement = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &statsBufferInfos[j];
+      }
+
+      vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+                             nullptr);
+    }
+  }
+
+  void createRenderDescriptorSets() {
+    LOGFN;
+
+    LOG("Like the compute sets, one set per frame in flight and state buffer, see renderDescriptorSet()");
+    uint32_t setCount = options.framesInFlight * options.stateBuffers;
+    std::vector<VkDescriptorSetLayout> layouts(setCount, renderDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = setCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    renderDescriptorSets.resize(setCount);
+    if (vkAllocateDescriptorSets(device, &allocInfo, renderDescriptorSets.data()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate render descriptor sets!");
+    }
+
+    for (size_t i = 0; i < setCount; i++) {
+      size_t frame = i / options.stateBuffers;
+      size_t state = i % options.stateBuffers;
+
+      LOG("A frame draws the state buffer its last compute step wrote, or its copy of it with async compute");
+      std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+      bufferInfos[0] = {uniformBuffers[frame], 0, sizeof(UniformBufferObject)};
+      bufferInfos[1] = {asyncCompute ? renderBuffers[frame] : shaderStorageBuffers[state], 0, VK_WHOLE_SIZE};
+      bufferInfos[2] = {visibleIndexBuffers[frame], 0, VK_WHOLE_SIZE};
+      bufferInfos[3] = {drawIndirectBuffers[frame], 0, VK_WHOLE_SIZE};
+
+      std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+      for (size_t j = 0; j < descriptorWrites.size(); j++) {
+        descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[j].dstSet = renderDescriptorSets[i];
+        descriptorWrites[j].dstBinding = static_cast<uint32_t>(j);
+        descriptorWrites[j].dstArrayElement = 0;
+        descriptorWrites[j].descriptorType =
+            j == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[j].descriptorCount = 1;
+        descriptorWrites[j].pBufferInfo = &bufferInfos[j];
+      }
+
+      vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+                             nullptr);
     }
   }
 
@@ -986,234 +2514,1314 @@ class App {
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate buffer memory!");
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate buffer memory!");
+    }
+
+    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+  }
+
+  VkCommandBuffer beginSingleTimeCommands() {
+    LOGFN;
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = computeCommandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    return commandBuffer;
+  }
+
+  void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+    LOGFN;
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    LOG("One-time commands only touch the storage buffers, which are owned by the compute family");
+    vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(computeQueue);
+
+    vkFreeCommandBuffers(device, computeCommandPool, 1, &commandBuffer);
+  }
+
+  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    LOGFN;
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+    endSingleTimeCommands(commandBuffer);
+  }
+
+  // Copies a particle buffer back to the host, only used outside of the frame loop
+  std::vector<Particle> readParticles(VkBuffer buffer) {
+    if (!options.halfPrecision) {
+      return readBuffer<Particle>(buffer, particleCount);
+    }
+    std::vector<HalfParticle> halfParticles = readBuffer<HalfParticle>(buffer, particleCount);
+    std::vector<Particle> particles(halfParticles.size());
+    std::transform(halfParticles.begin(), halfParticles.end(), particles.begin(),
+                   [](const HalfParticle& particle) { return particle.unpack(); });
+    return particles;
+  }
+
+  // Copies the first `count` elements of a buffer back to the host through a staging buffer
+  template <typename T>
+  std::vector<T> readBuffer(VkBuffer buffer, size_t count) {
+    LOGFN;
+
+    VkDeviceSize bufferSize = sizeof(T) * count;
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
+                 stagingBufferMemory);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.size = bufferSize;
+    vkCmdCopyBuffer(commandBuffer, buffer, stagingBuffer, 1, &copyRegion);
+
+    LOG("Make the transfer visible to the host before mapping");
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+    endSingleTimeCommands(commandBuffer);
+
+    std::vector<T> elements(count);
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+    memcpy(elements.data(), data, (size_t)bufferSize);
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+
+    return elements;
+  }
+
+  void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask,
+                     VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = dstAccessMask;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  // Release (on the source family) or acquire (on the destination family) half of a queue family ownership transfer
+  void bufferOwnershipBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcQueueFamily,
+                              uint32_t dstQueueFamily, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask,
+                              VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = dstAccessMask;
+    barrier.srcQueueFamilyIndex = srcQueueFamily;
+    barrier.dstQueueFamilyIndex = dstQueueFamily;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+  }
+
+  void computeBarrier(VkCommandBuffer commandBuffer) {
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  }
+
+  uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+    LOGFN;
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+      if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+        return i;
+      }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+  }
+
+  void createCommandBuffers() {
+    LOGFN;
+
+    commandBuffers.resize(options.framesInFlight);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate command buffers!");
+    }
+  }
+
+  void createComputeCommandBuffers() {
+    LOGFN;
+
+    computeCommandBuffers.resize(options.framesInFlight);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = computeCommandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = (uint32_t)computeCommandBuffers.size();
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate compute command buffers!");
+    }
+  }
+
+  void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    LOGFN_ONCE;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    LOG_ONCE("Points read the particles as vertex attributes, quads and their culling pre-pass as a storage buffer");
+    VkPipelineStageFlags particleReadStages =
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkAccessFlags particleReadAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    VkBuffer vertexBuffer = shaderStorageBuffers[latestStateBuffer()];
+    if (asyncCompute) {
+      LOG_ONCE("Acquire the render buffer released by the compute queue");
+      vertexBuffer = renderBuffers[currentFrame];
+      bufferOwnershipBarrier(commandBuffer, vertexBuffer, computeQueueFamily, graphicsQueueFamily,
+                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, particleReadStages, particleReadAccess);
+    }
+
+    bool quads = options.renderMode == RenderMode::Quads;
+    if (quads) {
+      recordParticleCull(commandBuffer);
+    }
+
+    if (fragmentQueryPool != VK_NULL_HANDLE) {
+      vkCmdResetQueryPool(commandBuffer, fragmentQueryPool, currentFrame, 1);
+    }
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = swapChainExtent;
+
+    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearColor;
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)swapChainExtent.width;
+    viewport.height = (float)swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+                            &renderDescriptorSet(), 0, nullptr);
+
+    if (fragmentQueryPool != VK_NULL_HANDLE) {
+      vkCmdBeginQuery(commandBuffer, fragmentQueryPool, currentFrame, 0);
+    }
+    if (quads) {
+      LOG_ONCE("One 4 vertex strip per visible particle, the instance count comes from the culling pre-pass");
+      vkCmdDrawIndirect(commandBuffer, drawIndirectBuffers[currentFrame], 0, 1, sizeof(VkDrawIndirectCommand));
+    } else {
+      VkDeviceSize offsets[] = {0};
+      vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+
+      vkCmdDraw(commandBuffer, particleCount, 1, 0, 0);
+    }
+    if (fragmentQueryPool != VK_NULL_HANDLE) {
+      vkCmdEndQuery(commandBuffer, fragmentQueryPool, currentFrame);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    if (asyncCompute) {
+      LOG_ONCE("Release it back so the compute queue can overwrite it", options.framesInFlight, "frames later");
+      bufferOwnershipBarrier(commandBuffer, vertexBuffer, graphicsQueueFamily, computeQueueFamily, particleReadStages,
+                             0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record command buffer!");
+    }
+  }
+
+  // Culls this frame's particles into its visible index buffer and indirect draw, on the graphics queue
+  void recordParticleCull(VkCommandBuffer commandBuffer) {
+    LOGFN_ONCE;
+
+    LOG_ONCE("Reset the indirect draw to 4 vertices and no instances, the pre-pass counts the instances");
+    VkDrawIndirectCommand drawCommand{4, 0, 0, 0};
+    vkCmdUpdateBuffer(commandBuffer, drawIndirectBuffers[currentFrame], 0, sizeof(drawCommand), &drawCommand);
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+                            &renderDescriptorSet(), 0, nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleCullPipeline);
+    vkCmdDispatch(commandBuffer, (particleCount + 255) / 256, 1, 1);
+
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                  VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+  }
+
+  void recordComputeCommandBuffer(VkCommandBuffer commandBuffer) {
+    LOGFN_ONCE;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording compute command buffer!");
+    }
+
+    LOG_ONCE("Every step writes the next buffer of the state ring and reads the one before, whatever the frame slot,");
+    LOG_ONCE("so the newest state is wherever the frame's last step landed and rendering draws it from there");
+    for (uint32_t step = 0; step < options.stepsPerFrame; step++) {
+      recordSimulationStep(commandBuffer, computeDescriptorSet(currentFrame, simulationStep++));
+    }
+    VkDescriptorSet latestDescriptorSet = computeDescriptorSet(currentFrame, simulationStep - 1);
+
+    if (options.sortInterval > 0 && computeTimelineValue % options.sortInterval == 0) {
+      recordParticleSort(commandBuffer, latestDescriptorSet, shaderStorageBuffers[latestStateBuffer()]);
+    }
+
+    if (options.stats) {
+      recordParticleStats(commandBuffer, latestDescriptorSet, statsPipelines);
+    }
+
+    if (options.snapshotInterval > 0) {
+      recordSnapshotCopies(commandBuffer);
+    }
+
+    if (asyncCompute) {
+      recordRenderBufferHandover(commandBuffer);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record compute command buffer!");
+    }
+  }
+
+  // Copies the new state into this frame's render buffer and releases that to the graphics queue family
+  void recordRenderBufferHandover(VkCommandBuffer commandBuffer) {
+    LOGFN_ONCE;
+
+    VkBuffer renderBuffer = renderBuffers[currentFrame];
+    if (renderBufferReleased[currentFrame]) {
+      LOG_ONCE("Acquire the render buffer back from the graphics family, the submit waits for its release");
+      bufferOwnershipBarrier(commandBuffer, renderBuffer, graphicsQueueFamily, computeQueueFamily,
+                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_ACCESS_TRANSFER_WRITE_BIT);
+    }
+
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_ACCESS_TRANSFER_READ_BIT);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.size = particleStride() * particleCount;
+    vkCmdCopyBuffer(commandBuffer, shaderStorageBuffers[latestStateBuffer()], renderBuffer, 1, &copyRegion);
+
+    bufferOwnershipBarrier(commandBuffer, renderBuffer, computeQueueFamily, graphicsQueueFamily,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+  }
+
+  void recordSimulationStep(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet) {
+    LOGFN_ONCE;
+
+    uint32_t particleGroups = (particleCount + 255) / 256;
+
+    LOG_ONCE("Earlier steps on this queue may still be using the same buffers, and without async compute so may");
+    LOG_ONCE("earlier draws when a frame runs more than one step");
+    memoryBarrier(commandBuffer,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT |
+                      (asyncCompute ? 0 : VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT),
+                  VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    LOGCALL_ONCE(vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1,
+                                         &descriptorSet, 0, nullptr));
+
+    switch (options.mode) {
+      case SimulationMode::Integrate:
+        LOGCALL_ONCE(vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline));
+
+        LOG_ONCE("Dispatching compute shader!!!");
+        LOGCALL_ONCE(vkCmdDispatch(commandBuffer, particleGroups, 1, 1));
+        break;
+
+      case SimulationMode::Grid:
+        recordGridStep(commandBuffer, particleGroups);
+        break;
+
+      case SimulationMode::NBody:
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, nbodyPipeline);
+        vkCmdDispatch(commandBuffer, (particleCount + nbodyGroupSize - 1) / nbodyGroupSize, 1, 1);
+        break;
+
+      case SimulationMode::BarnesHut:
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, barnesHutPipeline);
+        vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+        break;
+    }
+  }
+
+  // Starts a snapshot of this frame's state every snapshotInterval frames and copies the chunks of the snapshot in
+  // progress into the free ring slots
+  void recordSnapshotCopies(VkCommandBuffer commandBuffer) {
+    LOGFN_ONCE;
+
+    if (!snapshotActive && (computeTimelineValue + 1) % options.snapshotInterval == 0) {
+      LOG_ONCE("Copy the state aside, the snapshot is the state this submission ends with");
+      beginSnapshotFile(computeTimelineValue + 1);
+      memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT);
+      VkBufferCopy copyRegion{};
+      copyRegion.size = sizeof(Particle) * particleCount;
+      vkCmdCopyBuffer(commandBuffer, shaderStorageBuffers[latestStateBuffer()], snapshotBuffer, 1, &copyRegion);
+    }
+
+    if (snapshotActive) {
+      recordSnapshotChunkCopies(commandBuffer, computeTimelineValue + 1);
+    }
+  }
+
+  // Copies the next chunks into the free ring slots, their data is ready once the compute timeline reaches
+  // `readyValue`
+  void recordSnapshotChunkCopies(VkCommandBuffer commandBuffer, uint64_t readyValue) {
+    VkDeviceSize stateSize = sizeof(Particle) * particleCount;
+    if (snapshotChunksCopied == snapshotChunkCount ||
+        snapshotChunksCopied == snapshotChunksWritten + SNAPSHOT_RING_SIZE) {
+      return;
+    }
+
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    for (; snapshotChunksCopied < snapshotChunkCount &&
+           snapshotChunksCopied < snapshotChunksWritten + SNAPSHOT_RING_SIZE;
+         snapshotChunksCopied++) {
+      uint32_t slot = snapshotChunksCopied % SNAPSHOT_RING_SIZE;
+      VkDeviceSize offset = snapshotChunksCopied * SNAPSHOT_CHUNK_SIZE;
+      VkBufferCopy copyRegion{offset, 0, std::min(SNAPSHOT_CHUNK_SIZE, stateSize - offset)};
+      vkCmdCopyBuffer(commandBuffer, snapshotBuffer, snapshotRingBuffers[slot], 1, &copyRegion);
+      snapshotRingValues[slot] = readyValue;
+    }
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  }
+
+  // Reduces `descriptorSet`'s output buffer into its statistics result buffer with the two phases of `pipelines`
+  void recordParticleStats(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet,
+                           const std::array<VkPipeline, 2>& pipelines) {
+    LOGFN_ONCE;
+
+    uint32_t statsGroups = std::min((particleCount + STATS_GROUP_SIZE - 1) / STATS_GROUP_SIZE, STATS_MAX_GROUPS);
+
+    LOG_ONCE("The state may have just been written by a step, a copy or the sort, the partials by the last reduction");
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1,
+                            &descriptorSet, 0, nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0]);
+    vkCmdDispatch(commandBuffer, statsGroups, 1, 1);
+    computeBarrier(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[1]);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+    LOG_ONCE("Make the result visible to the host once the submission's timeline value is reached");
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  }
+
+  // Sorts the particles of `descriptorSet`'s output buffer by Morton code and copies them back in sorted order, so
+  // neighbours in space end up as neighbours in memory
+  void recordParticleSort(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, VkBuffer particleBuffer) {
+    LOGFN_ONCE;
+
+    uint32_t particleGroups = (particleCount + 255) / 256;
+
+    LOG_ONCE("The simulation step or the previous sort may still be using the sort and particle buffers");
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &descriptorSet,
+                            0, nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortKeysPipeline);
+    vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+
+    recordRadixSort(commandBuffer);
+
+    LOG_ONCE("Gather the particles in sorted order and copy them back over the state");
+    computeBarrier(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortPermutePipeline);
+    vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+    VkBufferCopy copyRegion{};
+    copyRegion.size = sizeof(Particle) * particleCount;
+    vkCmdCopyBuffer(commandBuffer, sortedParticlesBuffer, particleBuffer, 1, &copyRegion);
+  }
+
+  // LSD radix sort of the (key, value) pairs in the lower half of the sort buffers, with the descriptor set bound.
+  // RADIX_PASSES is even, so the sorted pairs end up in the lower half again.
+  void recordRadixSort(VkCommandBuffer commandBuffer) {
+    LOGFN_ONCE;
+
+    uint32_t blockCount = (particleCount + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+    uint32_t scanBlocks = (blockCount * RADIX_DIGITS + RADIX_SCAN_BLOCK_SIZE - 1) / RADIX_SCAN_BLOCK_SIZE;
+
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+      LOG_ONCE("Every pass sorts by the next", RADIX_BITS, "bits: count, scan the counts, scatter");
+      std::array<uint32_t, 2> sortState = {pass * RADIX_BITS, pass % 2};
+      memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT);
+      vkCmdUpdateBuffer(commandBuffer, sortStateBuffer, 0, sizeof(sortState), sortState.data());
+      memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, radixCountPipeline);
+      vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+      computeBarrier(commandBuffer);
+
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, radixScanPipelines[0]);
+      vkCmdDispatch(commandBuffer, scanBlocks, 1, 1);
+      computeBarrier(commandBuffer);
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, radixScanPipelines[1]);
+      vkCmdDispatch(commandBuffer, 1, 1, 1);
+      computeBarrier(commandBuffer);
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, radixScanPipelines[2]);
+      vkCmdDispatch(commandBuffer, scanBlocks, 1, 1);
+      computeBarrier(commandBuffer);
+
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, radixScatterPipeline);
+      vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+      computeBarrier(commandBuffer);
+    }
+  }
+
+  void recordGridStep(VkCommandBuffer commandBuffer, uint32_t particleGroups) {
+    LOGFN_ONCE;
+
+    uint32_t scanBlocks = (gridDim * gridDim + GRID_SCAN_BLOCK_SIZE - 1) / GRID_SCAN_BLOCK_SIZE;
+
+    LOG_ONCE("Counting sort of the particles into the uniform grid");
+    LOGCALL_ONCE(vkCmdFillBuffer(commandBuffer, cellCountBuffer, 0, VK_WHOLE_SIZE, 0));
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gridCountPipeline);
+    vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+    computeBarrier(commandBuffer);
+
+    LOG_ONCE("Prefix sum of the cell counts gives the start/end table");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gridScanPipelines[0]);
+    vkCmdDispatch(commandBuffer, scanBlocks, 1, 1);
+    computeBarrier(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gridScanPipelines[1]);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    computeBarrier(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gridScanPipelines[2]);
+    vkCmdDispatch(commandBuffer, scanBlocks, 1, 1);
+    computeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gridScatterPipeline);
+    vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+    computeBarrier(commandBuffer);
+
+    LOG_ONCE("Neighbour queries only visit the 3x3 surrounding cells");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gridInteractPipeline);
+    vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+  }
+
+  void createSyncObjects() {
+    LOGFN;
+
+    imageAvailableSemaphores.resize(options.framesInFlight);
+    renderFinishedSemaphores.resize(options.framesInFlight);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    LOG("Presentation needs binary semaphores, one pair per frame in flight");
+    for (size_t i = 0; i < options.framesInFlight; i++) {
+      if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+          vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics synchronization objects for a frame!");
+      }
+    }
+
+    LOG("Everything else is ordered by one timeline semaphore per queue, whatever the number of frames in flight");
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+    semaphoreInfo.pNext = &timelineInfo;
+
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &computeTimeline) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &graphicsTimeline) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create timeline semaphores!");
+    }
+  }
+
+  void createTimestampQueryPool() {
+    LOGFN;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    LOG("Timestamps tick every", properties.limits.timestampPeriod, "ns");
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+
+    if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create timestamp query pool!");
+    }
+  }
+
+  void createFragmentQueryPool() {
+    LOGFN;
+
+    fragmentQueryWritten.assign(options.framesInFlight, false);
+    if (!pipelineStatisticsSupported) {
+      LOG("No pipeline statistics queries, fragment invocations are not counted");
+      return;
+    }
+
+    LOG("One fragment shader invocation query per frame in flight, read when the frame's slot comes around again");
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    queryPoolInfo.queryCount = options.framesInFlight;
+    queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+    if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &fragmentQueryPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create pipeline statistics query pool!");
+    }
+  }
+
+  // Records `steps` simulation steps into one command buffer and returns the GPU time per step in milliseconds
+  double measureSimulationSteps(uint32_t steps) {
+    LOGFN;
+
+    return measureCommands(steps, [&](VkCommandBuffer commandBuffer, uint32_t i) {
+      recordSimulationStep(commandBuffer, computeDescriptorSet(0, i));
+    });
+  }
+
+  // Records `repeats` calls of `record` into one command buffer and returns the GPU time per call in milliseconds
+  double measureCommands(uint32_t repeats, const std::function<void(VkCommandBuffer, uint32_t)>& record) {
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 0, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, 0);
+    for (uint32_t i = 0; i < repeats; i++) {
+      record(commandBuffer, i);
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, 1);
+
+    endSingleTimeCommands(commandBuffer);
+
+    uint64_t timestamps[2];
+    vkGetQueryPoolResults(device, timestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+    return (timestamps[1] - timestamps[0]) * timestampPeriod / 1.0e6 / repeats;
+  }
+
+  // Integrates the half precision state next to the fp32 CPU reference and prints how far it drifts
+  void runDriftReport() {
+    LOGFN;
+
+    for (uint32_t i = 0; i < options.framesInFlight; i++) {
+      writeUniformBuffer(i, BENCHMARK_DELTA_TIME);
+    }
+
+    LOG("The reference starts from the fp32 initial state, so the first row is the rounding of the upload alone");
+    std::vector<Particle> reference(particleCount);
+    parallelFor(particleCount,
+                [&](size_t i) { reference[i] = initialParticle(static_cast<uint32_t>(i), options.seed); });
+    std::vector<Particle> referenceNext;
+
+    std::cout << "Half precision drift against fp32, " << particleCount << " particles, " << options.driftSteps
+              << " integrate steps of " << BENCHMARK_DELTA_TIME << " ms, " << sizeof(HalfParticle) << " instead of "
+              << sizeof(Particle) << " bytes per particle" << std::endl;
+    std::cout << std::setw(10) << "step" << std::setw(14) << "max position" << std::setw(14) << "rms position"
+              << std::setw(14) << "max velocity" << std::setw(12) << "diverged" << std::endl;
+
+    uint32_t step = 0;
+    for (uint32_t row = 0; row <= DRIFT_REPORT_ROWS; row++) {
+      uint32_t target = static_cast<uint32_t>(static_cast<uint64_t>(options.driftSteps) * row / DRIFT_REPORT_ROWS);
+      if (row > 0 && target == step) {
+        continue;
+      }
+
+      LOG("Step s writes state buffer s % stateBuffers and reads the buffer the step before wrote");
+      VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+      for (uint32_t s = step; s < target; s++) {
+        recordSimulationStep(commandBuffer, computeDescriptorSet(0, s));
+      }
+      endSingleTimeCommands(commandBuffer);
+      for (; step < target; step++) {
+        simulateIntegrateStepReference(reference, referenceNext, BENCHMARK_DELTA_TIME);
+        std::swap(reference, referenceNext);
+      }
+
+      std::vector<Particle> state =
+          readParticles(shaderStorageBuffers[(step + options.stateBuffers - 1) % options.stateBuffers]);
+      float maxPositionError = 0.0f;
+      float maxVelocityError = 0.0f;
+      double squaredPositionError = 0.0;
+      LOG("A particle that bounced off a border at another step than the reference moves the other way for good");
+      uint32_t diverged = 0;
+      for (uint32_t i = 0; i < particleCount; i++) {
+        float positionError = glm::distance(state[i].position, reference[i].position);
+        maxPositionError = std::max(maxPositionError, positionError);
+        squaredPositionError += static_cast<double>(positionError) * positionError;
+        maxVelocityError = std::max(maxVelocityError, glm::distance(state[i].velocity, reference[i].velocity));
+        if (glm::any(glm::lessThan(state[i].velocity * reference[i].velocity, glm::vec2(0.0f)))) {
+          diverged++;
+        }
+      }
+
+      std::cout << std::setw(10) << step << std::scientific << std::setprecision(2) << std::setw(14)
+                << maxPositionError << std::setw(14) << std::sqrt(squaredPositionError / particleCount)
+                << std::setw(14) << maxVelocityError << std::setw(12) << diverged << std::defaultfloat << std::endl;
+    }
+  }
+
+  void runSortBenchmark() {
+    LOGFN;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (!properties.limits.timestampComputeAndGraphics) {
+      throw std::runtime_error("benchmark needs timestamp queries on the compute queue!");
+    }
+
+    std::cout << "Radix sort benchmark, 32-bit Morton keys with 32-bit values, " << RADIX_PASSES << " passes of "
+              << RADIX_BITS << " bits, " << BENCHMARK_STEPS << " sorts per particle count" << std::endl;
+    std::cout << std::setw(10) << "particles" << std::setw(12) << "gpu ms" << std::setw(14) << "gpu Mkeys/s"
+              << std::setw(12) << "cpu ms" << std::setw(14) << "cpu Mkeys/s" << std::setw(10) << "valid" << std::endl;
+
+    for (uint32_t count : BENCHMARK_PARTICLE_COUNTS) {
+      resizeParticleSystem(count);
+      for (uint32_t i = 0; i < options.framesInFlight; i++) {
+        writeUniformBuffer(i, BENCHMARK_DELTA_TIME);
+      }
+
+      auto recordKeys = [&](VkCommandBuffer commandBuffer) {
+        computeBarrier(commandBuffer);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1,
+                                &computeDescriptorSets[0], 0, nullptr);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortKeysPipeline);
+        vkCmdDispatch(commandBuffer, (particleCount + 255) / 256, 1, 1);
+        computeBarrier(commandBuffer);
+      };
+
+      LOG("The CPU reference is a stable sort of the keys the GPU generated");
+      VkCommandBuffer keysCommandBuffer = beginSingleTimeCommands();
+      recordKeys(keysCommandBuffer);
+      endSingleTimeCommands(keysCommandBuffer);
+      std::vector<uint32_t> keys = readBuffer<uint32_t>(sortKeysBuffer, count);
+
+      std::vector<std::pair<uint32_t, uint32_t>> reference(count);
+      auto start = std::chrono::high_resolution_clock::now();
+      for (uint32_t i = 0; i < count; i++) {
+        reference[i] = {keys[i], i};
+      }
+      std::stable_sort(reference.begin(), reference.end(),
+                       [](const auto& a, const auto& b) { return a.first < b.first; });
+      auto end = std::chrono::high_resolution_clock::now();
+      double cpuMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+      VkCommandBuffer sortCommandBuffer = beginSingleTimeCommands();
+      recordKeys(sortCommandBuffer);
+      recordRadixSort(sortCommandBuffer);
+      endSingleTimeCommands(sortCommandBuffer);
+      std::vector<uint32_t> sortedKeys = readBuffer<uint32_t>(sortKeysBuffer, count);
+      std::vector<uint32_t> sortedValues = readBuffer<uint32_t>(sortValuesBuffer, count);
+      bool valid = true;
+      for (uint32_t i = 0; i < count && valid; i++) {
+        valid = sortedKeys[i] == reference[i].first && sortedValues[i] == reference[i].second;
+      }
+
+      LOG("Every timed sort starts from freshly generated, unsorted keys");
+      double keysMs = measureCommands(BENCHMARK_STEPS, [&](VkCommandBuffer commandBuffer, uint32_t) {
+        recordKeys(commandBuffer);
+      });
+      double gpuMs = measureCommands(BENCHMARK_STEPS, [&](VkCommandBuffer commandBuffer, uint32_t) {
+        recordKeys(commandBuffer);
+        recordRadixSort(commandBuffer);
+      }) - keysMs;
+
+      std::cout << std::setw(10) << count << std::setw(12) << std::fixed << std::setprecision(3) << gpuMs
+                << std::setw(14) << std::setprecision(1) << count / (gpuMs * 1.0e3) << std::setw(12)
+                << std::setprecision(3) << cpuMs << std::setw(14) << std::setprecision(1) << count / (cpuMs * 1.0e3)
+                << std::setw(10) << (valid ? "yes" : "NO") << std::endl;
+    }
+  }
+
+  void runReduceBenchmark() {
+    LOGFN;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (!properties.limits.timestampComputeAndGraphics) {
+      throw std::runtime_error("benchmark needs timestamp queries on the compute queue!");
+    }
+
+    std::vector<std::pair<std::string, std::array<VkPipeline, 2>>> variants = {{"shared", sharedStatsPipelines}};
+    if (subgroupStatsPipelines[0] != VK_NULL_HANDLE) {
+      variants.push_back({"subgroup", subgroupStatsPipelines});
+    } else {
+      std::cout << "Subgroup arithmetic and ballot not supported, only the shared memory variant runs" << std::endl;
+    }
+
+    std::cout << "Statistics reduction benchmark (kinetic energy, bounds, live count), " << BENCHMARK_STEPS
+              << " reductions per particle count" << std::endl;
+    std::cout << std::setw(10) << "particles" << std::setw(10) << "variant" << std::setw(12) << "gpu ms"
+              << std::setw(16) << "gpu Mparticle/s" << std::setw(10) << "GB/s" << std::setw(10) << "valid"
+              << std::endl;
+
+    for (uint32_t count : BENCHMARK_PARTICLE_COUNTS) {
+      resizeParticleSystem(count);
+      for (uint32_t i = 0; i < options.framesInFlight; i++) {
+        writeUniformBuffer(i, BENCHMARK_DELTA_TIME);
+      }
+
+      LOG("Descriptor set 0 reduces buffer 0 into result buffer 0");
+      ParticleStats reference = computeParticleStatsReference(readParticles(shaderStorageBuffers[0]));
+
+      for (const auto& variant : variants) {
+        auto recordStats = [&](VkCommandBuffer commandBuffer, uint32_t) {
+          recordParticleStats(commandBuffer, computeDescriptorSets[0], variant.second);
+        };
+
+        memset(statsBuffersMapped[0], 0, sizeof(ParticleStats));
+        VkCommandBuffer statsCommandBuffer = beginSingleTimeCommands();
+        recordStats(statsCommandBuffer, 0);
+        endSingleTimeCommands(statsCommandBuffer);
+        ParticleStats stats = *static_cast<const ParticleStats*>(statsBuffersMapped[0]);
+
+        LOG("Bounds and counts are exact, the energy only differs by the summation order");
+        bool valid = stats.boundsMin == reference.boundsMin && stats.boundsMax == reference.boundsMax &&
+                     stats.liveCount == reference.liveCount &&
+                     std::abs(stats.kineticEnergy - reference.kineticEnergy) <= 1.0e-4f * reference.kineticEnergy;
+
+        double gpuMs = measureCommands(BENCHMARK_STEPS, recordStats);
+        std::cout << std::setw(10) << count << std::setw(10) << variant.first << std::setw(12) << std::fixed
+                  << std::setprecision(3) << gpuMs << std::setw(16) << std::setprecision(1)
+                  << count / (gpuMs * 1.0e3) << std::setw(10) << std::setprecision(1)
+                  << sizeof(Particle) * count / (gpuMs * 1.0e6) << std::setw(10) << (valid ? "yes" : "NO")
+                  << std::endl;
+      }
     }
-
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
   }
 
-  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+  void runBenchmark() {
     LOGFN;
 
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (!properties.limits.timestampComputeAndGraphics) {
+      throw std::runtime_error("benchmark needs timestamp queries on the compute queue!");
+    }
 
-    VkBufferCopy copyRegion{};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    if (options.mode == SimulationMode::NBody) {
+      runNBodyBenchmark();
+      return;
+    }
+    if (options.mode == SimulationMode::BarnesHut) {
+      runBarnesHutBenchmark();
+      return;
+    }
 
-    vkEndCommandBuffer(commandBuffer);
+    std::cout << "Simulation step benchmark (" << simulationModeName(options.mode) << "), " << BENCHMARK_STEPS
+              << " steps per particle count" << std::endl;
+    std::cout << std::setw(10) << "particles" << std::setw(8) << "grid" << std::setw(12) << "gpu ms"
+              << std::setw(14) << "gpu ns/part" << std::setw(12) << "cpu ms" << std::setw(14) << "max error"
+              << std::endl;
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    for (uint32_t count : BENCHMARK_PARTICLE_COUNTS) {
+      resizeParticleSystem(count);
+      for (uint32_t i = 0; i < options.framesInFlight; i++) {
+        writeUniformBuffer(i, BENCHMARK_DELTA_TIME);
+      }
 
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
+      LOG("Validate one GPU step against the CPU reference, the first step writes buffer 0 and reads the last one");
+      std::vector<Particle> initial = readParticles(shaderStorageBuffers[options.stateBuffers - 1]);
+      measureSimulationSteps(1);
+      std::vector<Particle> gpuResult = readParticles(shaderStorageBuffers[0]);
+
+      std::ostringstream cpuColumns;
+      if (options.mode == SimulationMode::Grid) {
+        std::vector<Particle> cpuResult;
+        auto start = std::chrono::high_resolution_clock::now();
+        simulateGridStepReference(initial, cpuResult, gridDim, BENCHMARK_DELTA_TIME);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        float maxError = 0.0f;
+        for (uint32_t i = 0; i < particleCount; i++) {
+          maxError = std::max(maxError, glm::distance(gpuResult[i].position, cpuResult[i].position));
+        }
+        cpuColumns << std::setw(12) << std::fixed << std::setprecision(2)
+                   << std::chrono::duration<double, std::milli>(end - start).count() << std::setw(14)
+                   << std::scientific << std::setprecision(2) << maxError;
+      } else {
+        cpuColumns << std::setw(12) << "-" << std::setw(14) << "-";
+      }
 
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+      double gpuMs = measureSimulationSteps(BENCHMARK_STEPS);
+      std::cout << std::setw(10) << count << std::setw(8) << gridDim << std::setw(12) << std::fixed
+                << std::setprecision(3) << gpuMs << std::setw(14) << std::setprecision(3)
+                << gpuMs * 1.0e6 / count << cpuColumns.str() << std::endl;
+    }
   }
 
-  uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+  void runNBodyBenchmark() {
     LOGFN;
 
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    struct KernelConfig {
+      std::string name;
+      VkPipeline pipeline;
+      uint32_t groupSize;
+    };
 
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-      if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-        return i;
+    LOG("The naive kernel is the baseline, every tiled variant gets its own specialized pipeline");
+    std::vector<KernelConfig> configs = {{"naive", nbodyNaivePipeline, 256}};
+    for (uint32_t tileSize : NBODY_BENCHMARK_TILE_SIZES) {
+      if (isTileSizeSupported(tileSize)) {
+        configs.push_back({"tiled " + std::to_string(tileSize), createNBodyPipeline(tileSize), tileSize});
       }
     }
 
-    throw std::runtime_error("failed to find suitable memory type!");
-  }
+    VkPipeline selectedPipeline = nbodyPipeline;
+    uint32_t selectedGroupSize = nbodyGroupSize;
 
-  void createCommandBuffers() {
-    LOGFN;
+    std::cout << "N-body benchmark, " << BENCHMARK_STEPS << " steps per configuration, "
+              << NBODY_FLOPS_PER_INTERACTION << " flops per interaction" << std::endl;
+    std::cout << std::setw(10) << "particles" << std::setw(12) << "kernel" << std::setw(12) << "gpu ms"
+              << std::setw(12) << "GFLOP/s" << std::setw(10) << "speedup" << std::setw(14) << "max error"
+              << std::endl;
 
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    for (uint32_t count : NBODY_BENCHMARK_PARTICLE_COUNTS) {
+      resizeParticleSystem(count);
+      for (uint32_t i = 0; i < options.framesInFlight; i++) {
+        writeUniformBuffer(i, BENCHMARK_DELTA_TIME);
+      }
 
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+      std::vector<Particle> initial = readParticles(shaderStorageBuffers[1]);
+      std::vector<Particle> reference;
+      if (count <= NBODY_REFERENCE_LIMIT) {
+        simulateNBodyStepReference(initial, reference, BENCHMARK_DELTA_TIME);
+      }
 
-    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate command buffers!");
-    }
-  }
+      LOG("Validate every kernel first, a single step only writes buffer 0 so buffer 1 keeps the initial state");
+      std::vector<std::string> maxErrors(configs.size(), "-");
+      for (size_t c = 0; c < configs.size() && !reference.empty(); c++) {
+        nbodyPipeline = configs[c].pipeline;
+        nbodyGroupSize = configs[c].groupSize;
+
+        measureSimulationSteps(1);
+        std::vector<Particle> gpuResult = readParticles(shaderStorageBuffers[0]);
+        float maxError = 0.0f;
+        for (uint32_t i = 0; i < count; i++) {
+          maxError = std::max(maxError, glm::distance(gpuResult[i].position, reference[i].position));
+        }
+        std::ostringstream errorText;
+        errorText << std::scientific << std::setprecision(2) << maxError;
+        maxErrors[c] = errorText.str();
+      }
 
-  void createComputeCommandBuffers() {
-    LOGFN;
+      double naiveMs = 0.0;
+      for (size_t c = 0; c < configs.size(); c++) {
+        const KernelConfig& config = configs[c];
+        nbodyPipeline = config.pipeline;
+        nbodyGroupSize = config.groupSize;
 
-    computeCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        double gpuMs = measureSimulationSteps(BENCHMARK_STEPS);
+        if (config.pipeline == nbodyNaivePipeline) {
+          naiveMs = gpuMs;
+        }
+        double gflops = static_cast<double>(count) * count * NBODY_FLOPS_PER_INTERACTION / (gpuMs * 1.0e6);
 
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)computeCommandBuffers.size();
+        std::cout << std::setw(10) << count << std::setw(12) << config.name << std::setw(12) << std::fixed
+                  << std::setprecision(3) << gpuMs << std::setw(12) << std::setprecision(1) << gflops
+                  << std::setw(9) << std::setprecision(2) << naiveMs / gpuMs << "x" << std::setw(14) << maxErrors[c]
+                  << std::endl;
+      }
+    }
 
-    if (vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate compute command buffers!");
+    nbodyPipeline = selectedPipeline;
+    nbodyGroupSize = selectedGroupSize;
+    for (const auto& config : configs) {
+      if (config.pipeline != nbodyNaivePipeline) {
+        vkDestroyPipeline(device, config.pipeline, nullptr);
+      }
     }
   }
 
-  void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-    LOGFN_ONCE;
+  void runBarnesHutBenchmark() {
+    LOGFN;
 
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    SimulationMode selectedMode = options.mode;
+    float selectedTheta = options.theta;
 
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-      throw std::runtime_error("failed to begin recording command buffer!");
-    }
+    std::cout << "Barnes-Hut benchmark, " << BENCHMARK_STEPS << " steps per theta, exact kernel with tile size "
+              << nbodyGroupSize << " and " << BARNES_HUT_EXACT_STEPS << " steps" << std::endl;
+    std::cout << "Error is the rms of the velocity change difference relative to the exact kernel" << std::endl;
+    std::cout << std::setw(10) << "particles" << std::setw(8) << "theta" << std::setw(10) << "nodes" << std::setw(12)
+              << "build ms" << std::setw(12) << "gpu ms" << std::setw(12) << "total ms" << std::setw(12) << "exact ms"
+              << std::setw(10) << "speedup" << std::setw(14) << "rms error" << std::endl;
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
+    for (uint32_t count : BARNES_HUT_BENCHMARK_PARTICLE_COUNTS) {
+      resizeParticleSystem(count);
+      bool runExact = count <= BARNES_HUT_EXACT_LIMIT;
 
-    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+      std::vector<Particle> initial = readParticles(shaderStorageBuffers[1]);
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+      LOG("Build time is averaged over a few builds of the initial state, both frames get the same tree");
+      auto start = std::chrono::high_resolution_clock::now();
+      for (uint32_t i = 0; i < BARNES_HUT_BUILD_REPEATS; i++) {
+        buildQuadtree(initial, quadtree);
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      double buildMs = std::chrono::duration<double, std::milli>(end - start).count() / BARNES_HUT_BUILD_REPEATS;
+      for (uint32_t i = 0; i < options.framesInFlight; i++) {
+        uploadQuadtree(i);
+      }
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+      LOG("Single steps first, they only write buffer 0 so buffer 1 keeps the initial state");
+      std::vector<Particle> exact;
+      if (runExact) {
+        options.mode = SimulationMode::NBody;
+        for (uint32_t i = 0; i < options.framesInFlight; i++) {
+          writeUniformBuffer(i, BENCHMARK_DELTA_TIME);
+        }
+        measureSimulationSteps(1);
+        exact = readParticles(shaderStorageBuffers[0]);
+      }
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swapChainExtent.width;
-    viewport.height = (float)swapChainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+      options.mode = SimulationMode::BarnesHut;
+      std::vector<std::string> rmsErrors(BARNES_HUT_BENCHMARK_THETAS.size(), "-");
+      for (size_t t = 0; t < BARNES_HUT_BENCHMARK_THETAS.size() && runExact; t++) {
+        options.theta = BARNES_HUT_BENCHMARK_THETAS[t];
+        for (uint32_t i = 0; i < options.framesInFlight; i++) {
+          writeUniformBuffer(i, BENCHMARK_DELTA_TIME);
+        }
+        measureSimulationSteps(1);
+        std::vector<Particle> approximate = readParticles(shaderStorageBuffers[0]);
+
+        double errorSum = 0.0;
+        double exactSum = 0.0;
+        for (uint32_t i = 0; i < count; i++) {
+          glm::vec2 exactChange = exact[i].velocity - initial[i].velocity;
+          glm::vec2 difference = approximate[i].velocity - exact[i].velocity;
+          errorSum += glm::dot(difference, difference);
+          exactSum += glm::dot(exactChange, exactChange);
+        }
+        std::ostringstream errorText;
+        errorText << std::scientific << std::setprecision(2) << std::sqrt(errorSum / exactSum);
+        rmsErrors[t] = errorText.str();
+      }
 
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapChainExtent;
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+      double exactMs = 0.0;
+      if (runExact) {
+        options.mode = SimulationMode::NBody;
+        exactMs = measureSimulationSteps(BARNES_HUT_EXACT_STEPS);
+      }
 
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &shaderStorageBuffers[currentFrame], offsets);
+      options.mode = SimulationMode::BarnesHut;
+      for (size_t t = 0; t < BARNES_HUT_BENCHMARK_THETAS.size(); t++) {
+        options.theta = BARNES_HUT_BENCHMARK_THETAS[t];
+        for (uint32_t i = 0; i < options.framesInFlight; i++) {
+          writeUniformBuffer(i, BENCHMARK_DELTA_TIME);
+        }
+        double gpuMs = measureSimulationSteps(BENCHMARK_STEPS);
+
+        std::ostringstream exactColumns;
+        if (runExact) {
+          exactColumns << std::setw(12) << std::fixed << std::setprecision(3) << exactMs << std::setw(9)
+                       << std::setprecision(2) << exactMs / (buildMs + gpuMs) << "x";
+        } else {
+          exactColumns << std::setw(12) << "-" << std::setw(10) << "-";
+        }
 
-    vkCmdDraw(commandBuffer, PARTICLE_COUNT, 1, 0, 0);
+        std::cout << std::setw(10) << count << std::setw(8) << std::fixed << std::setprecision(2) << options.theta
+                  << std::setw(10) << quadtree.nodes.size() << std::setw(12) << std::setprecision(3) << buildMs
+                  << std::setw(12) << gpuMs << std::setw(12) << buildMs + gpuMs << exactColumns.str() << std::setw(14)
+                  << rmsErrors[t] << std::endl;
+      }
+    }
 
-    vkCmdEndRenderPass(commandBuffer);
+    options.mode = selectedMode;
+    options.theta = selectedTheta;
+  }
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-      throw std::runtime_error("failed to record command buffer!");
+  void beginSnapshotFile(uint64_t frame) {
+    LOGFN;
+
+    LOG("Write to a temporary file first, so an interrupted snapshot never replaces the previous one");
+    snapshotFile.open(options.snapshotFile + ".tmp", std::ios::binary | std::ios::trunc);
+    if (!snapshotFile.is_open()) {
+      throw std::runtime_error("failed to open " + options.snapshotFile + ".tmp for writing!");
     }
+
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.particleSize = sizeof(Particle);
+    header.particleCount = particleCount;
+    header.frame = frame;
+    header.dataOffset = SNAPSHOT_DATA_OFFSET;
+    std::vector<char> headerBlock(SNAPSHOT_DATA_OFFSET, 0);
+    memcpy(headerBlock.data(), &header, sizeof(header));
+    snapshotFile.write(headerBlock.data(), headerBlock.size());
+
+    VkDeviceSize stateSize = sizeof(Particle) * particleCount;
+    snapshotChunkCount = (stateSize + SNAPSHOT_CHUNK_SIZE - 1) / SNAPSHOT_CHUNK_SIZE;
+    snapshotChunksCopied = 0;
+    snapshotChunksWritten = 0;
+    snapshotActive = true;
   }
 
-  void recordComputeCommandBuffer(VkCommandBuffer commandBuffer) {
+  // Collects the finished chunk write and starts writing the next chunk once its copy has completed, never blocks
+  void pollSnapshotWrites() {
     LOGFN_ONCE;
 
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-      throw std::runtime_error("failed to begin recording compute command buffer!");
+    if (!snapshotActive) {
+      return;
     }
 
-    LOGCALL_ONCE(vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline));
-
-    LOGCALL_ONCE(vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1,
-                                         &computeDescriptorSets[currentFrame], 0, nullptr));
+    if (snapshotWrite.valid()) {
+      if (snapshotWrite.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+      }
+      snapshotWrite.get();
+      snapshotChunksWritten++;
+    }
 
-    LOG_ONCE("Dispatching compute shader!!!");
-    LOGCALL_ONCE(vkCmdDispatch(commandBuffer, PARTICLE_COUNT / 256, 1, 1));
+    if (snapshotChunksWritten == snapshotChunkCount) {
+      finishSnapshotFile();
+      return;
+    }
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-      throw std::runtime_error("failed to record compute command buffer!");
+    uint64_t completedValue = 0;
+    vkGetSemaphoreCounterValue(device, computeTimeline, &completedValue);
+    uint32_t slot = snapshotChunksWritten % SNAPSHOT_RING_SIZE;
+    if (snapshotChunksWritten < snapshotChunksCopied && snapshotRingValues[slot] <= completedValue) {
+      LOG_ONCE("Write the chunk on another thread, the ring slot stays busy until the write is done");
+      VkDeviceSize stateSize = sizeof(Particle) * particleCount;
+      VkDeviceSize offset = snapshotChunksWritten * SNAPSHOT_CHUNK_SIZE;
+      const char* data = static_cast<const char*>(snapshotRingBuffersMapped[slot]);
+      std::streamsize size = static_cast<std::streamsize>(std::min(SNAPSHOT_CHUNK_SIZE, stateSize - offset));
+      snapshotWrite = std::async(std::launch::async, [this, data, size] { snapshotFile.write(data, size); });
     }
   }
 
-  void createSyncObjects() {
+  void finishSnapshotFile() {
     LOGFN;
 
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    computeFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    computeInFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-
-    VkSemaphoreCreateInfo semaphoreInfo{};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    snapshotFile.close();
+    if (snapshotFile.fail()) {
+      throw std::runtime_error("failed to write " + options.snapshotFile + ".tmp!");
+    }
+    if (!replaceFile(options.snapshotFile + ".tmp", options.snapshotFile)) {
+      throw std::runtime_error("failed to replace " + options.snapshotFile + "!");
+    }
+    std::cout << "Snapshot of " << particleCount << " particles written to " << options.snapshotFile << std::endl;
+    snapshotActive = false;
+  }
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  // Finishes the snapshot in progress when the frame loop ends, with the device already idle
+  void completeSnapshot() {
+    LOGFN;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-      if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-          vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-          vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create graphics synchronization objects for a frame!");
+    while (snapshotActive) {
+      if (snapshotWrite.valid()) {
+        snapshotWrite.wait();
       }
-      if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &computeFinishedSemaphores[i]) != VK_SUCCESS ||
-          vkCreateFence(device, &fenceInfo, nullptr, &computeInFlightFences[i]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create compute synchronization objects for a frame!");
+      if (snapshotChunksCopied < snapshotChunkCount) {
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        recordSnapshotChunkCopies(commandBuffer, 0);
+        endSingleTimeCommands(commandBuffer);
       }
+      pollSnapshotWrites();
     }
   }
 
+  void printParticleStats(const ParticleStats& stats) {
+    std::cout << "kinetic energy " << std::scientific << std::setprecision(4) << stats.kineticEnergy << std::fixed
+              << ", bounds (" << stats.boundsMin.x << ", " << stats.boundsMin.y << ") - ("
+              << stats.boundsMax.x << ", " << stats.boundsMax.y << "), live " << stats.liveCount << "/"
+              << particleCount << std::endl;
+  }
+
   void updateUniformBuffer(uint32_t currentImage) {
     LOGFN_ONCE;
 
+    writeUniformBuffer(currentImage, lastFrameTime * 2.0f / options.stepsPerFrame);
+  }
+
+  void writeUniformBuffer(uint32_t currentImage, float deltaTime) {
     UniformBufferObject ubo{};
-    ubo.deltaTime = lastFrameTime * 2.0f;
+    ubo.deltaTime = deltaTime;
+    ubo.particleCount = particleCount;
+    ubo.gridDim = gridDim;
+    ubo.cellSize = 2.0f / gridDim;
+    ubo.theta = options.theta;
+    ubo.particleSize = options.particleSize;
+    ubo.viewportSize = glm::vec2(swapChainExtent.width, swapChainExtent.height);
 
     memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
   }
 
-  void drawFrame() {
-    LOGFN_ONCE;
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  // Blocks until both queues have reached (at least) the given timeline values
+  void waitForTimelines(uint64_t computeValue, uint64_t graphicsValue) {
+    std::array<VkSemaphore, 2> semaphores = {computeTimeline, graphicsTimeline};
+    std::array<uint64_t, 2> values = {computeValue, graphicsValue};
 
-    // Compute submission
-    vkWaitForFences(device, 1, &computeInFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+    waitInfo.pSemaphores = semaphores.data();
+    waitInfo.pValues = values.data();
 
-    updateUniformBuffer(currentFrame);
+    vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+  }
 
-    vkResetFences(device, 1, &computeInFlightFences[currentFrame]);
+  // Timeline value signaled by the submission framesInFlight submissions before the next one, 0 if none
+  uint64_t frameSlotValue(uint64_t lastValue) const {
+    return lastValue + 1 > options.framesInFlight ? lastValue + 1 - options.framesInFlight : 0;
+  }
 
-    vkResetCommandBuffer(computeCommandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
-    recordComputeCommandBuffer(computeCommandBuffers[currentFrame]);
+  // Lets latencyThread finish the frames already submitted and joins it
+  void stopLatencyThread() {
+    vkDeviceWaitIdle(device);
+    {
+      std::lock_guard<std::mutex> lock(latencyMutex);
+      latencyThreadDone = true;
+    }
+    latencyCondition.notify_one();
+    latencyThread.join();
+  }
 
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &computeCommandBuffers[currentFrame];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &computeFinishedSemaphores[currentFrame];
+  // Body of latencyThread: blocks on the graphics timeline until each pending frame's submission finishes and adds
+  // the time from the start of its drawFrame() to then. Returns once mainLoop() is done and nothing is pending.
+  void measureFrameLatencies() {
+    std::unique_lock<std::mutex> lock(latencyMutex);
+    while (true) {
+      latencyCondition.wait(lock, [this] { return !pendingFrameStarts.empty() || latencyThreadDone; });
+      if (pendingFrameStarts.empty()) {
+        return;
+      }
+      auto [value, frameStartTime] = pendingFrameStarts.front();
+      pendingFrameStarts.pop_front();
+      lock.unlock();
+
+      VkSemaphoreWaitInfo waitInfo{};
+      waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+      waitInfo.semaphoreCount = 1;
+      waitInfo.pSemaphores = &graphicsTimeline;
+      waitInfo.pValues = &value;
+      vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+      double finishTime = glfwGetTime();
+
+      lock.lock();
+      frameLatencySum += finishTime - frameStartTime;
+      frameLatencyCount++;
+    }
+  }
 
-    LOG_ONCE("Submitting compute command buffer...");
-    if (LOGCALL_ONCE(vkQueueSubmit(computeQueue, 1, &submitInfo, computeInFlightFences[currentFrame])) != VK_SUCCESS) {
-      throw std::runtime_error("failed to submit compute command buffer!");
-    };
+  void drawFrame() {
+    LOGFN_ONCE;
 
-    // Graphics submission
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    double frameStartTime = glfwGetTime();
+
+    LOG_ONCE("Wait for the work that last used this frame's command buffers, framesInFlight submissions back");
+    LOG_ONCE("on each queue. The image is acquired before anything is submitted, so an out of date swap chain leaves");
+    LOG_ONCE("no compute submission without its graphics counterpart.");
+    waitForTimelines(frameSlotValue(computeTimelineValue), frameSlotValue(graphicsTimelineValue));
+
+    if (options.stats && computeTimelineValue >= options.framesInFlight &&
+        glfwGetTime() - lastStatsTime >= STATS_PRINT_INTERVAL) {
+      LOG_ONCE("The compute submission that last used this frame has finished, its statistics are ready to read");
+      printParticleStats(*static_cast<const ParticleStats*>(statsBuffersMapped[currentFrame]));
+      lastStatsTime = glfwGetTime();
+    }
+
+    pollSnapshotWrites();
+
+    if (fragmentQueryPool != VK_NULL_HANDLE && fragmentQueryWritten[currentFrame]) {
+      LOG_ONCE("Likewise the fragment invocation count of the draw that last used this frame");
+      uint64_t invocations = 0;
+      if (vkGetQueryPoolResults(device, fragmentQueryPool, currentFrame, 1, sizeof(invocations), &invocations,
+                                sizeof(invocations), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        fragmentInvocations += invocations;
+        fragmentQueryFrames++;
+      }
+      fragmentQueryWritten[currentFrame] = false;
+    }
 
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
@@ -1226,29 +3834,94 @@ class App {
       throw std::runtime_error("failed to acquire swap chain image!");
     }
 
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    // Compute submission
+    updateUniformBuffer(currentFrame);
+
+    if (options.mode == SimulationMode::BarnesHut) {
+      LOG_ONCE("The quadtree is built on the host from the state the previous frame's compute step produced");
+      waitForTimelines(computeTimelineValue, 0);
+      buildQuadtree(readParticles(shaderStorageBuffers[latestStateBuffer()]), quadtree);
+      uploadQuadtree(currentFrame);
+    }
+
+    vkResetCommandBuffer(computeCommandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
+    recordComputeCommandBuffer(computeCommandBuffers[currentFrame]);
+
+    uint64_t computeWaitValue = frameSlotValue(graphicsTimelineValue);
+    uint64_t computeSignalValue = ++computeTimelineValue;
+    VkTimelineSemaphoreSubmitInfo computeTimelineInfo{};
+    computeTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    computeTimelineInfo.pWaitSemaphoreValues = &computeWaitValue;
+    computeTimelineInfo.signalSemaphoreValueCount = 1;
+    computeTimelineInfo.pSignalSemaphoreValues = &computeSignalValue;
+
+    VkPipelineStageFlags computeWaitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &computeTimelineInfo;
+    if (asyncCompute && renderBufferReleased[currentFrame]) {
+      LOG_ONCE("Async compute waits for the graphics submission that released the render buffer");
+      submitInfo.waitSemaphoreCount = 1;
+      submitInfo.pWaitSemaphores = &graphicsTimeline;
+      submitInfo.pWaitDstStageMask = &computeWaitStage;
+      computeTimelineInfo.waitSemaphoreValueCount = 1;
+    }
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &computeCommandBuffers[currentFrame];
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &computeTimeline;
+
+    LOG_ONCE("Submitting compute command buffer...");
+    if (LOGCALL_ONCE(vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit compute command buffer!");
+    };
 
+    // Graphics submission
     vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
     recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
 
-    VkSemaphore waitSemaphores[] = {computeFinishedSemaphores[currentFrame], imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+    LOG_ONCE("The swap chain semaphores stay binary, their values are ignored");
+    VkSemaphore waitSemaphores[] = {computeTimeline, imageAvailableSemaphores[currentFrame]};
+    uint64_t waitValues[] = {computeSignalValue, 0};
+    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                                          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame], graphicsTimeline};
+    uint64_t signalValues[] = {0, ++graphicsTimelineValue};
+
+    VkTimelineSemaphoreSubmitInfo graphicsTimelineInfo{};
+    graphicsTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    graphicsTimelineInfo.waitSemaphoreValueCount = 2;
+    graphicsTimelineInfo.pWaitSemaphoreValues = waitValues;
+    graphicsTimelineInfo.signalSemaphoreValueCount = 2;
+    graphicsTimelineInfo.pSignalSemaphoreValues = signalValues;
+
     submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &graphicsTimelineInfo;
 
     submitInfo.waitSemaphoreCount = 2;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &renderFinishedSemaphores[currentFrame];
+    submitInfo.signalSemaphoreCount = 2;
+    submitInfo.pSignalSemaphores = signalSemaphores;
 
     LOG_ONCE("Submitting graphics command buffer...");
-    if (LOGCALL_ONCE(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame])) != VK_SUCCESS) {
+    if (LOGCALL_ONCE(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE)) != VK_SUCCESS) {
       throw std::runtime_error("failed to submit draw command buffer!");
     }
+    if (asyncCompute) {
+      renderBufferReleased[currentFrame] = true;
+    }
+    {
+      std::lock_guard<std::mutex> lock(latencyMutex);
+      pendingFrameStarts.push_back({graphicsTimelineValue, frameStartTime});
+    }
+    latencyCondition.notify_one();
+    if (fragmentQueryPool != VK_NULL_HANDLE) {
+      fragmentQueryWritten[currentFrame] = true;
+    }
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1271,16 +3944,20 @@ class App {
       throw std::runtime_error("failed to present swap chain image!");
     }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % options.framesInFlight;
   }
 
-  VkShaderModule createShaderModule(const std::vector<char>& code) {
+  VkShaderModule createShaderModule(const MappedFile& code) {
     LOGFN;
 
+    if (code.size() % sizeof(uint32_t) != 0) {
+      throw std::runtime_error("shader code is not a whole number of SPIR-V words!");
+    }
+
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    createInfo.pCode = code.data<uint32_t>();
 
     VkShaderModule shaderModule;
     if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -1374,7 +4051,20 @@ class App {
       swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    bool timelineSemaphoreSupported = false;
+    if (properties.apiVersion >= VK_API_VERSION_1_2) {
+      VkPhysicalDeviceVulkan12Features vulkan12Features{};
+      vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+      VkPhysicalDeviceFeatures2 features{};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &vulkan12Features;
+      vkGetPhysicalDeviceFeatures2(device, &features);
+      timelineSemaphoreSupported = vulkan12Features.timelineSemaphore;
+    }
+
+    return indices.isComplete() && extensionsSupported && swapChainAdequate && timelineSemaphoreSupported;
   }
 
   bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -1411,18 +4101,26 @@ class App {
 
     int i = 0;
     for (const auto& queueFamily : queueFamilies) {
-      if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
-        indices.graphicsAndComputeFamily = i;
-      }
+      if (!indices.isComplete()) {
+        if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+          indices.graphicsAndComputeFamily = i;
+        }
+
+        VkBool32 presentSupport = false;
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
-      VkBool32 presentSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        if (presentSupport) {
+          indices.presentFamily = i;
+        }
+      }
 
-      if (presentSupport) {
-        indices.presentFamily = i;
+      if ((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+          !indices.asyncComputeFamily.has_value()) {
+        LOG("Compute-only family", i, "can run the simulation next to rendering");
+        indices.asyncComputeFamily = i;
       }
 
-      if (indices.isComplete()) {
+      if (indices.isComplete() && indices.asyncComputeFamily.has_value()) {
         break;
       }
 
@@ -1475,25 +4173,12 @@ class App {
     return true;
   }
 
-  static std::vector<char> readFile(const std::string& filename) {
+  // Maps the file instead of reading it, the bytes stay valid as long as the returned MappedFile lives
+  static MappedFile readFile(const std::string& filename) {
     LOGFN;
 
-    LOG("Reading file: ", filename);
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-      throw std::runtime_error("failed to open file!");
-    }
-
-    size_t fileSize = (size_t)file.tellg();
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-
-    return buffer;
+    LOG("Mapping file: ", filename);
+    return MappedFile(filename);
   }
 
   static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -1510,11 +4195,162 @@ class App {
   }
 };
 
-int main() {
+Options parseOptions(int argc, char** argv) {
+  Options options;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--mode" && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "integrate") {
+        options.mode = SimulationMode::Integrate;
+      } else if (mode == "grid") {
+        options.mode = SimulationMode::Grid;
+      } else if (mode == "nbody") {
+        options.mode = SimulationMode::NBody;
+      } else if (mode == "barnes-hut") {
+        options.mode = SimulationMode::BarnesHut;
+      } else {
+        throw std::runtime_error("unknown simulation mode: " + mode);
+      }
+    } else if (arg == "--render" && i + 1 < argc) {
+      std::string render = argv[++i];
+      if (render == "points") {
+        options.renderMode = RenderMode::Points;
+      } else if (render == "quads") {
+        options.renderMode = RenderMode::Quads;
+      } else {
+        throw std::runtime_error("unknown render mode: " + render);
+      }
+    } else if (arg == "--blend" && i + 1 < argc) {
+      std::string blend = argv[++i];
+      if (blend == "alpha") {
+        options.blendMode = BlendMode::Alpha;
+      } else if (blend == "additive") {
+        options.blendMode = BlendMode::Additive;
+      } else {
+        throw std::runtime_error("unknown blend mode: " + blend);
+      }
+    } else if (arg == "--particle-size" && i + 1 < argc) {
+      options.particleSize = std::stof(argv[++i]);
+    } else if (arg == "--particles" && i + 1 < argc) {
+      options.particleCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--tile-size" && i + 1 < argc) {
+      options.tileSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--theta" && i + 1 < argc) {
+      options.theta = std::stof(argv[++i]);
+    } else if (arg == "--steps-per-frame" && i + 1 < argc) {
+      options.stepsPerFrame = static_cast<uint32_t>(std::stoul(argv[++i]));
+      if (options.stepsPerFrame == 0) {
+        throw std::runtime_error("--steps-per-frame must be at least 1");
+      }
+    } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+      options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+      if (options.framesInFlight == 0) {
+        throw std::runtime_error("--frames-in-flight must be at least 1");
+      }
+    } else if (arg == "--state-buffers" && i + 1 < argc) {
+      options.stateBuffers = static_cast<uint32_t>(std::stoul(argv[++i]));
+      if (options.stateBuffers < 2) {
+        throw std::runtime_error("--state-buffers must be at least 2");
+      }
+    } else if (arg == "--frames" && i + 1 < argc) {
+      options.frameLimit = std::stoull(argv[++i]);
+    } else if (arg == "--no-async-compute") {
+      options.asyncCompute = false;
+    } else if (arg == "--sort-interval" && i + 1 < argc) {
+      options.sortInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--stats") {
+      options.stats = true;
+    } else if (arg == "--snapshot-interval" && i + 1 < argc) {
+      options.snapshotInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--snapshot-file" && i + 1 < argc) {
+      options.snapshotFile = argv[++i];
+    } else if (arg == "--restore" && i + 1 < argc) {
+      options.restoreFile = argv[++i];
+    } else if (arg == "--seed" && i + 1 < argc) {
+      options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--gpu-init") {
+      options.gpuInit = true;
+    } else if (arg == "--half") {
+      options.halfPrecision = true;
+    } else if (arg == "--half-drift" && i + 1 < argc) {
+      options.halfPrecision = true;
+      options.driftSteps = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--sort-benchmark") {
+      options.sortBenchmark = true;
+    } else if (arg == "--reduce-benchmark") {
+      options.reduceBenchmark = true;
+    } else if (arg == "--benchmark") {
+      options.benchmark = true;
+    } else if (arg == "--latency-sweep") {
+      options.latencySweep = true;
+    } else {
+      throw std::runtime_error("unknown argument: " + arg);
+    }
+  }
+
+  if (options.mode == SimulationMode::BarnesHut && options.stepsPerFrame != 1) {
+    throw std::runtime_error("barnes-hut mode builds one quadtree per frame and needs --steps-per-frame 1");
+  }
+
+  if (options.latencySweep &&
+      (options.benchmark || options.sortBenchmark || options.reduceBenchmark || options.driftSteps > 0)) {
+    throw std::runtime_error("--latency-sweep runs the frame loop and cannot be combined with the benchmarks");
+  }
+
+  if (options.halfPrecision &&
+      (options.mode != SimulationMode::Integrate || options.sortInterval > 0 || options.stats ||
+       options.snapshotInterval > 0 || !options.restoreFile.empty() || options.gpuInit || options.benchmark ||
+       options.sortBenchmark || options.reduceBenchmark)) {
+    throw std::runtime_error(
+        "--half only supports the integrate mode, without sorting, statistics, snapshots, --gpu-init or benchmarks");
+  }
+
+  return options;
+}
+
+// Runs the frame loop once per frames in flight and state buffer pair and prints throughput and latency side by side.
+// Every run gets its own App, the buffer rings are sized at startup.
+void runLatencySweep(Options options) {
+  LOGFN;
+
+  if (options.frameLimit == 0) {
+    options.frameLimit = LATENCY_SWEEP_FRAMES;
+  }
+
+  std::vector<std::pair<Options, FrameLoopResult>> results;
+  for (uint32_t framesInFlight : LATENCY_SWEEP_FRAMES_IN_FLIGHT) {
+    for (uint32_t stateBuffers : LATENCY_SWEEP_STATE_BUFFERS) {
+      options.framesInFlight = framesInFlight;
+      options.stateBuffers = stateBuffers;
+      App app(options);
+      app.run();
+      results.push_back({options, app.frameLoopResult()});
+    }
+  }
+
+  std::cout << "Latency sweep, " << options.frameLimit << " frames per configuration" << std::endl;
+  std::cout << std::setw(18) << "frames in flight" << std::setw(15) << "state buffers" << std::setw(14)
+            << "ms per frame" << std::setw(12) << "frames/s" << std::setw(14) << "latency ms" << std::endl;
+  for (const auto& [runOptions, result] : results) {
+    std::cout << std::setw(18) << runOptions.framesInFlight << std::setw(15) << runOptions.stateBuffers << std::fixed
+              << std::setprecision(3) << std::setw(14) << result.msPerFrame << std::setw(12) << std::setprecision(1)
+              << (result.msPerFrame > 0.0 ? 1000.0 / result.msPerFrame : 0.0) << std::setw(14)
+              << std::setprecision(3) << result.latencyMs << std::endl;
+  }
+}
+
+int main(int argc, char** argv) {
   LOG("Vulkan Compute!!");
-  App app;
 
   try {
+    Options options = parseOptions(argc, argv);
+    if (options.latencySweep) {
+      runLatencySweep(options);
+      return EXIT_SUCCESS;
+    }
+    App app(options);
     app.run();
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
@@ -3,19 +3,41 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+// The CPU mip generator uses SSE where the compiler targets it
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MIPMAP_SSE
+#include <xmmintrin.h>
+#endif
+
 constexpr bool LOG_TO_README = true;
 const char* logFileName = LOG_TO_README ? "README.md" : "log.hpp";
 #include "logger.h"
+#include "mapped_file.h"
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
@@ -34,30 +56,127 @@ const uint32_t HEIGHT = 600;
 const int MAX_FRAMES_IN_FLIGHT = 2;
 const std::string FRAGMENT_SHADER_PATH = "./bin/shaders/frag.spv";
 const std::string VERTEX_SHADER_PATH = "./bin/shaders/vert.spv";
+const std::string BINDLESS_FRAGMENT_SHADER_PATH = "./bin/shaders/frag_bindless.spv";
+const std::string BINDLESS_VERTEX_SHADER_PATH = "./bin/shaders/vert_bindless.spv";
+const std::string CULL_SHADER_PATH = "./bin/shaders/instance_cull.comp.spv";
+const std::string OCCLUSION_CULL_SHADER_PATH = "./bin/shaders/instance_cull_occlusion.comp.spv";
+const std::string DEPTH_PYRAMID_SHADER_PATH = "./bin/shaders/hiz_build.comp.spv";
+const std::string DEPTH_PYRAMID_MS_SHADER_PATH = "./bin/shaders/hiz_build_ms.comp.spv";
+const std::string MESHLET_CULL_SHADER_PATH = "./bin/shaders/meshlet_cull.comp.spv";
+const std::string MESHLET_CULL_MESH_SHADER_PATH = "./bin/shaders/meshlet_cull_mesh.comp.spv";
+const std::string MESHLET_MESH_SHADER_PATH = "./bin/shaders/meshlet.mesh.spv";
+const std::string MESHLET_BINDLESS_MESH_SHADER_PATH = "./bin/shaders/meshlet_bindless.mesh.spv";
 // const std::string TEXTURE_PATH = "./res/texture.jpg";
 const std::string MODEL_PATH = "./res/viking_room.obj";
 const std::string TEXTURE_PATH = "./res/viking_room.png";
 
+// KTX2 container, see TEXTURE_CACHE
+const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+const uint32_t KTX2_MAX_LEVELS = 32;
+// Levels of a streamed texture no larger than this are uploaded before the first frame, see startTextureStreaming
+const uint32_t MIP_TAIL_SIZE = 64;
+
+// Instanced rendering, see updateInstanceBuffer. Instances sit on a square grid this far apart.
+const float INSTANCE_SPACING = 1.5f;
+const size_t INSTANCES_PER_THREAD = 4096;
+// Workgroup size of instance_cull.comp and meshlet_cull.comp
+const uint32_t CULL_GROUP_SIZE = 64;
+// Repetitions of the CPU culling reference the GPU pass is compared against
+const uint32_t CPU_CULL_REPEATS = 20;
+// Depth pyramid of occlusion culling, see recordDepthPyramid. A workgroup of hiz_build.comp reduces a tile of this
+// many level 0 texels, keep both in sync with the shader.
+const uint32_t HIZ_MAX_LEVELS = 16;
+const uint32_t HIZ_TILE_SIZE = 32;
+
+// Mesh cache, see MESH_CACHE. The meshlet limits are the usual mesh shader sizes, keep them in sync with meshlet.mesh.
+const uint8_t MESH_CACHE_IDENTIFIER[8] = {'I', 'V', 'M', 'E', 'S', 'H', '\r', '\n'};
+const uint32_t MESH_CACHE_VERSION = 2;
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+// A meshlet whose triangle normals spread this far from their average gets no normal cone, it would never be culled
+const float MESHLET_MIN_CONE_DOT = 0.1f;
+// Levels of detail including the full mesh, keep in sync with instance_cull.comp and meshlet_cull.comp. A level
+// keeping more than MESH_LOD_MAX_RATIO of the triangles of the one before ends the chain, the simplifier is stuck.
+const uint32_t MESH_MAX_LODS = 5;
+// Width of the mesh task launch rows, keep in sync with meshlet_cull.comp and meshlet.mesh
+const uint32_t MESH_TASKS_PER_ROW = 65535;
+const float MESH_LOD_MAX_RATIO = 0.8f;
+// Weight of the planes that hold open borders in place, relative to the triangle planes
+const float MESH_SIMPLIFY_BORDER_WEIGHT = 10.0f;
+
+// Vertical field of view of the camera in degrees, LOD selection projects errors with it
+const float CAMERA_FOV = 45.0f;
+
+// Slots of the bindless texture array, fewer where the device's update after bind limits are lower
+const uint32_t BINDLESS_MAX_TEXTURES = 1024;
+
+// CPU mip generation, see generateMipChain. Radii are in destination texels.
+const float MIP_KAISER_RADIUS = 3.0f;
+const float MIP_KAISER_ALPHA = 4.0f;
+const float MIP_LANCZOS_RADIUS = 3.0f;
+const uint32_t MIP_SRGB_TABLE_SIZE = 65536;
+const size_t MIP_ROWS_PER_THREAD = 16;
+
+enum class MipFilter { Box, Kaiser, Lanczos };
+
+struct Options {
+  // Encode this image into KTX2 texture caches next to it and exit instead of opening a window
+  std::string compressTexture;
+  // Load TEXTURE_PATH from a KTX2 cache the device can sample, otherwise decode it and build the mips at startup
+  bool textureCache = true;
+  // Build the mips of TEXTURE_PATH on the CPU instead of blitting them. Always done when the device cannot blit the
+  // texture format with linear filtering.
+  bool cpuMipmaps = false;
+  // Filter of the CPU mips and of the mips --compress-texture writes
+  MipFilter mipFilter = MipFilter::Kaiser;
+  // Start rendering with the mip tail of the texture cache and stream the larger levels in the background
+  bool textureStreaming = true;
+  // Copies of the model drawn by the single instanced draw
+  uint32_t instances = 1;
+  // Close the window after this many frames, 0 runs until it is closed
+  uint64_t frameLimit = 0;
+  // Moves the camera closer to the instance grid, above 1 part of the grid leaves the view
+  float zoom = 1.0f;
+  // Cull the instances against the view frustum in a compute pass and draw the survivors indirectly
+  bool gpuCulling = false;
+  // Also cull the instances hidden behind others against a depth pyramid, implies gpuCulling
+  bool occlusionCulling = false;
+  // Put the camera at the edge of the instance grid at the height of the models, so the front rows hide the rest
+  bool occlusionScene = false;
+  // Split this OBJ into meshlets, write its mesh cache next to it and exit instead of opening a window
+  std::string buildMeshCache;
+  // Load MODEL_PATH from its mesh cache when there is one, otherwise parse the OBJ at startup
+  bool meshCache = true;
+  // Cull every meshlet of every instance against the view frustum and its normal cone instead of whole instances,
+  // implies gpuCulling
+  bool meshletCulling = false;
+  // Draw the meshlets with VK_EXT_mesh_shader where the device has it, otherwise with indexed indirect draws
+  bool meshShaders = true;
+  // Draw every instance at the coarsest level of detail whose error stays under lodThreshold pixels on screen,
+  // implies gpuCulling
+  bool lod = false;
+  float lodThreshold = 1.0f;
+  // Bind one set per frame holding an array of every texture and the per-object data, which the shaders index by
+  // instance through descriptor indexing. Falls back to the fixed set where the device lacks it.
+  bool bindless = false;
+  // Record the render passes with VK_KHR_dynamic_rendering instead of render pass and framebuffer objects, where the
+  // device has it
+  bool dynamicRendering = false;
+  // Recreate the swap chain this many times after the frame loop and report what it cost, to compare the rendering
+  // paths without resizing the window by hand
+  uint32_t recreateBenchmark = 0;
+};
+
 std::unordered_set<std::string> OneTimeLogger::loggedFunctions;
 
-static std::vector<char> readFile(const std::string& filename) {
+// Maps the file instead of reading it into a buffer, the bytes stay valid as long as the returned MappedFile lives
+static MappedFile readFile(const std::string& filename) {
   LOGFN;
-  std::ifstream file{filename, std::ios::ate | std::ios::binary};
-
-  if (!file.is_open()) {
-    throw std::runtime_error("failed to open file!");
-  }
-
-  size_t fileSize = (size_t)file.tellg();
-  std::vector<char> buffer(fileSize);
+  MappedFile file(filename);
 
-  LOG("Loading filename:", filename, "fileSize:", fileSize, "bytes");
+  LOG("Mapping filename:", filename, "fileSize:", file.size(), "bytes");
 
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
-
-  file.close();
-  return buffer;
+  return file;
 }
 #pragma region VERTEX_DESC
 
@@ -200,220 +319,1997 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
 }
 #pragma endregion VALIDATION_CALLBACK
 
-class App {
- public:
-#pragma region APP
-  void run() {
-    initWindow();
-    initVulkan();
-    mainLoop();
-    cleanup();
-  }
+#pragma region TEXTURE_CACHE
 
- private:
-  void initWindow() {
-    LOGFN;
-    LOGCALL(glfwInit());
+// One level of an RGBA8 mip chain on the CPU, rows are tightly packed
+struct TextureLevel {
+  uint32_t width;
+  uint32_t height;
+  std::vector<uint8_t> pixels;
+};
 
-    LOGCALL(glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API));
-    // LOGCALL(glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE));
+// Encodes a 4x4 block of RGBA8 texels, row-major, into blockBytes bytes
+using BlockEncoder = void (*)(const uint8_t* texels, uint8_t* block);
 
-    LOGCALL(window = glfwCreateWindow(WIDTH, HEIGHT, "Illiterate Vulkan", nullptr, nullptr));
-    glfwSetWindowUserPointer(window, this);
-    glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
-  }
+void encodeBC1Block(const uint8_t* texels, uint8_t* block);
+void encodeETC2Block(const uint8_t* texels, uint8_t* block);
 
-  static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
-    auto app = reinterpret_cast<App*>(glfwGetWindowUserPointer(window));
-    app->framebbufferResized = true;
-  }
+struct TextureCacheFormat {
+  const char* name;  // the cache of image.png is image.<name>.ktx2
+  VkFormat format;
+  uint32_t blockBytes;  // per 4x4 block, or per texel for uncompressed formats
+  bool blockCompressed;
+  // nullptr for formats --compress-texture does not write, those are still loaded when an external encoder made them
+  BlockEncoder encodeBlock;
+};
 
-  void initVulkan() {
-    LOGFN;
-    createInstance();
-    setupDebugMessenger();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createGraphicsPipeline();
-    createCommandPool();
-    createColorResources();
-    createDepthResources();
-    createFrameBuffers();
-    createTextureImage();
-    createTextureImageView();
-    createTextureSampler();
-    loadModel();
-    createVertexBuffer();
-    createIndexBuffer();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();
-    createCommandBuffers();
-    createSyncObjects();
-  }
+// In the order the loader prefers them, the first one the device can sample wins. All of them store sRGB color like
+// the VK_FORMAT_R8G8B8A8_SRGB image createTextureImage builds, BC1 and ETC2 drop the alpha channel.
+const std::array<TextureCacheFormat, 4> TEXTURE_CACHE_FORMATS = {{
+    {"bc7", VK_FORMAT_BC7_SRGB_BLOCK, 16, true, nullptr},
+    {"bc1", VK_FORMAT_BC1_RGB_SRGB_BLOCK, 8, true, encodeBC1Block},
+    {"etc2", VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, 8, true, encodeETC2Block},
+    {"rgba8", VK_FORMAT_R8G8B8A8_SRGB, 4, false, nullptr},
+}};
+
+struct Ktx2Header {
+  uint8_t identifier[12];
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t supercompressionScheme;
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header layout changed");
 
-  void mainLoop() {
-    LOGFN;
+struct Ktx2LevelIndex {
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+static_assert(sizeof(Ktx2LevelIndex) == 24, "KTX2 level index layout changed");
 
-    LOGCALL(while (!glfwWindowShouldClose(window))) {
-      glfwPollEvents();
-      drawFrame();
+// A KTX2 file checked by parseKtx2, levels[0] is the full resolution level
+struct Ktx2Texture {
+  Ktx2Header header;
+  std::vector<Ktx2LevelIndex> levels;
+};
+
+// `path` without its extension, the caches of a file sit next to it
+std::string pathStem(const std::string& path) {
+  size_t slash = path.find_last_of("/\\");
+  size_t dot = path.find_last_of('.');
+  return (dot != std::string::npos && (slash == std::string::npos || dot > slash)) ? path.substr(0, dot) : path;
+}
+
+std::string textureCachePath(const std::string& imagePath, const TextureCacheFormat& format) {
+  return pathStem(imagePath) + "." + format.name + ".ktx2";
+}
+
+uint64_t textureLevelSize(const TextureCacheFormat& format, uint32_t width, uint32_t height) {
+  if (!format.blockCompressed) {
+    return uint64_t(width) * height * format.blockBytes;
+  }
+  return uint64_t((width + 3) / 4) * ((height + 3) / 4) * format.blockBytes;
+}
+
+// Threads that stay alive between parallelFor calls, so a call every frame does not pay for starting them
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t workerCount) {
+    for (size_t i = 0; i < workerCount; i++) {
+      workers.emplace_back([this]() { work(); });
     }
+  }
 
-    LOGCALL(vkDeviceWaitIdle(device));
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+      worker.join();
+    }
   }
 
-  void cleanup() {
-    LOGFN;
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
 
-    cleanupSwapChain();
+  // The workers plus the calling thread, which runs tasks too
+  size_t threadCount() const { return workers.size() + 1; }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-      LOGCALL(vkDestroyBuffer(device, uniformBuffers[i], nullptr));
-      LOGCALL(vkFreeMemory(device, uniformBuffersMemory[i], nullptr));
-    }
+  // Calls task(t) for every t in [0, count) and returns once all of them have finished
+  void run(size_t count, const std::function<void(size_t)>& task) {
+    std::lock_guard<std::mutex> runLock(runMutex);
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return activeWorkers == 0; });
+    currentTask = &task;
+    taskCount = count;
+    nextTask = 0;
+    generation++;
+    lock.unlock();
+    wake.notify_all();
 
-    LOGCALL(vkDestroySampler(device, textureSampler, nullptr));
-    LOGCALL(vkDestroyImageView(device, textureImageView, nullptr));
-    LOGCALL(vkDestroyImage(device, textureImage, nullptr));
-    LOGCALL(vkFreeMemory(device, textureImageMemory, nullptr));
+    runTasks(task, count);
 
-    LOGCALL(vkDestroyDescriptorPool(device, descriptorPool, nullptr));
-    LOGCALL(vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr));
+    lock.lock();
+    idle.wait(lock, [this]() { return activeWorkers == 0; });
+  }
 
-    LOGCALL(vkDestroyBuffer(device, vertexBuffer, nullptr));
-    LOGCALL(vkFreeMemory(device, vertexBufferMemory, nullptr));
+ private:
+  std::vector<std::thread> workers;
+  std::mutex runMutex;  // one run at a time
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  const std::function<void(size_t)>* currentTask = nullptr;
+  size_t taskCount = 0;
+  std::atomic<size_t> nextTask{0};
+  uint64_t generation = 0;
+  size_t activeWorkers = 0;
+  bool stopping = false;
+
+  void work() {
+    uint64_t seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+      if (stopping) {
+        return;
+      }
+      seenGeneration = generation;
+      const std::function<void(size_t)>* task = currentTask;
+      size_t count = taskCount;
+      activeWorkers++;
+      lock.unlock();
 
-    LOGCALL(vkDestroyBuffer(device, indexBuffer, nullptr));
-    LOGCALL(vkFreeMemory(device, indexBufferMemory, nullptr));
+      runTasks(*task, count);
 
-    LOGCALL(vkDestroyPipeline(device, graphicsPipeline, nullptr));
-    LOGCALL(vkDestroyPipelineLayout(device, pipelineLayout, nullptr));
+      lock.lock();
+      activeWorkers--;
+      idle.notify_all();
+    }
+  }
 
-    LOGCALL(vkDestroyRenderPass(device, renderPass, nullptr));
+  // Claims tasks of the current run until every one has been claimed
+  void runTasks(const std::function<void(size_t)>& task, size_t count) {
+    for (size_t t = nextTask++; t < count; t = nextTask++) {
+      task(t);
+    }
+  }
+};
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-      LOGCALL(vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr));
-      LOGCALL(vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr));
-      LOGCALL(vkDestroyFence(device, inFlightFences[i], nullptr));
+// Started on first use and shared by every parallelFor
+WorkerPool& workerPool() {
+  static WorkerPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+  return pool;
+}
+
+// Splits [0, count) into one contiguous chunk per pool thread, at least `grain` items per chunk. Fewer than `grain`
+// items run serially on the calling thread.
+template <typename Function>
+void parallelFor(size_t count, size_t grain, Function function) {
+  WorkerPool& pool = workerPool();
+  size_t chunkCount = std::max<size_t>(1, std::min<size_t>(pool.threadCount(), count / grain + 1));
+  if (chunkCount == 1) {
+    for (size_t i = 0; i < count; i++) {
+      function(i);
     }
+    return;
+  }
+  size_t chunkSize = (count + chunkCount - 1) / chunkCount;
 
-    LOGCALL(vkDestroyCommandPool(device, commandPool, nullptr));
+  pool.run(chunkCount, [&](size_t chunk) {
+    size_t begin = chunk * chunkSize;
+    size_t end = std::min(count, begin + chunkSize);
+    for (size_t i = begin; i < end; i++) {
+      function(i);
+    }
+  });
+}
 
-    LOGCALL(vkDestroyDevice(device, nullptr));
+// Support of the mip filters in destination texels
+float mipFilterRadius(MipFilter filter) {
+  switch (filter) {
+    case MipFilter::Box:
+      return 0.5f;
+    case MipFilter::Kaiser:
+      return MIP_KAISER_RADIUS;
+    case MipFilter::Lanczos:
+      return MIP_LANCZOS_RADIUS;
+  }
+  return 0.5f;
+}
 
-    if (enableValidationLayers) {
-      DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+float mipFilterWeight(MipFilter filter, float x) {
+  const float PI = 3.14159265358979f;
+  auto sinc = [PI](float x) { return std::abs(x) < 1e-6f ? 1.0f : std::sin(PI * x) / (PI * x); };
+  // Modified Bessel function of the first kind, order 0
+  auto besselI0 = [](float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 16; k++) {
+      term *= (x / (2.0f * k)) * (x / (2.0f * k));
+      sum += term;
     }
+    return sum;
+  };
 
-    LOGCALL(vkDestroySurfaceKHR(instance, surface, nullptr));
+  float radius = mipFilterRadius(filter);
+  if (std::abs(x) > radius) {
+    return 0.0f;
+  }
+  switch (filter) {
+    case MipFilter::Box:
+      return 1.0f;
+    case MipFilter::Kaiser: {
+      float t = x / radius;
+      return sinc(x) * besselI0(MIP_KAISER_ALPHA * std::sqrt(1.0f - t * t)) / besselI0(MIP_KAISER_ALPHA);
+    }
+    case MipFilter::Lanczos:
+      return sinc(x) * sinc(x / radius);
+  }
+  return 0.0f;
+}
 
-    LOGCALL(vkDestroyInstance(instance, nullptr));
+// Normalized weights of the source texels contributing to every destination texel along one axis, clamped to the edge.
+// Taps of destination texel i are [begin[i], begin[i + 1]).
+struct MipFilterTaps {
+  std::vector<uint32_t> begin;
+  std::vector<uint32_t> source;
+  std::vector<float> weight;
+};
 
-    LOGCALL(glfwDestroyWindow(window));
-    LOGCALL(glfwTerminate());
+MipFilterTaps buildMipFilterTaps(MipFilter filter, uint32_t srcSize, uint32_t dstSize) {
+  MipFilterTaps taps;
+  taps.begin.push_back(0);
+
+  // Axes that are already 1 texel wide are copied
+  float scale = float(srcSize) / float(dstSize);
+  float support = srcSize == dstSize ? 0.5f : mipFilterRadius(filter) * scale;
+
+  for (uint32_t i = 0; i < dstSize; i++) {
+    float center = (i + 0.5f) * scale;
+    int32_t first = static_cast<int32_t>(std::floor(center - support));
+    int32_t last = static_cast<int32_t>(std::ceil(center + support));
+
+    float total = 0.0f;
+    size_t tapsBegin = taps.weight.size();
+    for (int32_t s = first; s <= last; s++) {
+      float x = (s + 0.5f - center) / (srcSize == dstSize ? 1.0f : scale);
+      float w = srcSize == dstSize ? (s == static_cast<int32_t>(i) ? 1.0f : 0.0f) : mipFilterWeight(filter, x);
+      if (w == 0.0f) {
+        continue;
+      }
+      taps.source.push_back(static_cast<uint32_t>(std::clamp<int32_t>(s, 0, static_cast<int32_t>(srcSize) - 1)));
+      taps.weight.push_back(w);
+      total += w;
+    }
+    for (size_t t = tapsBegin; t < taps.weight.size(); t++) {
+      taps.weight[t] /= total;
+    }
+    taps.begin.push_back(static_cast<uint32_t>(taps.weight.size()));
   }
 
-#pragma endregion APP
+  return taps;
+}
 
-#pragma region VARIABLES
-  GLFWwindow* window = nullptr;
+// SIMD kernels, one linear RGBA texel per SSE register. The scalar versions do the same in the same order.
+// out = sum of the texels at source[t] * stride weighted by weight[t]
+inline void filterTexel(const float* texels, size_t stride, const uint32_t* source, const float* weight,
+                        uint32_t count, float* out) {
+#ifdef MIPMAP_SSE
+  __m128 sum = _mm_setzero_ps();
+  for (uint32_t t = 0; t < count; t++) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(texels + source[t] * stride), _mm_set1_ps(weight[t])));
+  }
+  _mm_storeu_ps(out, sum);
+#else
+  float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (uint32_t t = 0; t < count; t++) {
+    const float* texel = texels + source[t] * stride;
+    for (int c = 0; c < 4; c++) {
+      sum[c] += texel[c] * weight[t];
+    }
+  }
+  memcpy(out, sum, sizeof(sum));
+#endif
+}
 
-  VkInstance instance{};
-  VkDebugUtilsMessengerEXT debugMessenger;
+// row += src * weight over `texels` RGBA texels
+inline void accumulateRow(const float* src, float weight, float* row, size_t texels) {
+#ifdef MIPMAP_SSE
+  __m128 w = _mm_set1_ps(weight);
+  for (size_t x = 0; x < texels; x++) {
+    _mm_storeu_ps(row + x * 4, _mm_add_ps(_mm_loadu_ps(row + x * 4), _mm_mul_ps(_mm_loadu_ps(src + x * 4), w)));
+  }
+#else
+  for (size_t i = 0; i < texels * 4; i++) {
+    row[i] += src[i] * weight;
+  }
+#endif
+}
 
-  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+float srgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
 
-  VkDevice device;
-  VkQueue graphicsQueue;
+float linearToSrgb(float value) {
+  return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
 
-  VkSurfaceKHR surface;
-  VkQueue presentQueue;
+// Mip chain of an sRGB RGBA8 image down to 1x1, as many levels as createTextureImage allocates. Color is filtered
+// in linear space, alpha as is. Every level is filtered separably from the one above it, with the rows of each pass
+// spread over all cores. The final conversion back to sRGB runs over the rows of all levels at once.
+std::vector<TextureLevel> generateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter) {
+  LOGFN;
 
-  VkSwapchainKHR swapChain;
-  std::vector<VkImage> swapChainImages;
-  VkFormat swapChainImageFormat;
-  VkExtent2D swapChainExtent;
+  // Exact tables both ways, the linear one is indexed by 16-bit linear values
+  static const std::vector<float> toLinear = [] {
+    std::vector<float> table(256);
+    for (int i = 0; i < 256; i++) {
+      table[i] = srgbToLinear(i / 255.0f);
+    }
+    return table;
+  }();
+  static const std::vector<uint8_t> toSrgb = [] {
+    std::vector<uint8_t> table(MIP_SRGB_TABLE_SIZE);
+    for (uint32_t i = 0; i < MIP_SRGB_TABLE_SIZE; i++) {
+      table[i] = static_cast<uint8_t>(std::lround(linearToSrgb(i / float(MIP_SRGB_TABLE_SIZE - 1)) * 255.0f));
+    }
+    return table;
+  }();
 
-  std::vector<VkImageView> swapChainImageViews;
+  struct LinearLevel {
+    uint32_t width;
+    uint32_t height;
+    std::vector<float> texels;
+  };
+  std::vector<LinearLevel> linear;
+  linear.push_back({width, height, std::vector<float>(size_t(width) * height * 4)});
+  parallelFor(height, MIP_ROWS_PER_THREAD, [&](size_t y) {
+    for (size_t i = y * width * 4; i < (y + 1) * width * 4; i++) {
+      linear[0].texels[i] = (i % 4 == 3) ? pixels[i] / 255.0f : toLinear[pixels[i]];
+    }
+  });
+
+  while (linear.back().width > 1 || linear.back().height > 1) {
+    const LinearLevel& src = linear.back();
+    LinearLevel dst{std::max(src.width / 2, 1u), std::max(src.height / 2, 1u), {}};
+    dst.texels.resize(size_t(dst.width) * dst.height * 4);
+
+    MipFilterTaps horizontal = buildMipFilterTaps(filter, src.width, dst.width);
+    MipFilterTaps vertical = buildMipFilterTaps(filter, src.height, dst.height);
+
+    // Horizontal pass into a src.height x dst.width image, then the vertical pass accumulates whole rows of it
+    std::vector<float> columns(size_t(src.height) * dst.width * 4);
+    parallelFor(src.height, MIP_ROWS_PER_THREAD, [&](size_t y) {
+      const float* srcRow = &src.texels[y * src.width * 4];
+      for (uint32_t x = 0; x < dst.width; x++) {
+        uint32_t first = horizontal.begin[x];
+        filterTexel(srcRow, 4, &horizontal.source[first], &horizontal.weight[first], horizontal.begin[x + 1] - first,
+                    &columns[(y * dst.width + x) * 4]);
+      }
+    });
+    parallelFor(dst.height, MIP_ROWS_PER_THREAD, [&](size_t y) {
+      float* dstRow = &dst.texels[y * dst.width * 4];
+      for (uint32_t t = vertical.begin[y]; t < vertical.begin[y + 1]; t++) {
+        accumulateRow(&columns[size_t(vertical.source[t]) * dst.width * 4], vertical.weight[t], dstRow, dst.width);
+      }
+    });
 
-  VkRenderPass renderPass;
+    linear.push_back(std::move(dst));
+  }
 
-  VkDescriptorPool descriptorPool;
-  VkDescriptorSetLayout descriptorSetLayout;
-  std::vector<VkDescriptorSet> descriptorSets;
+  std::vector<TextureLevel> levels(linear.size());
+  std::vector<std::pair<uint32_t, uint32_t>> rows;  // level, row
+  for (uint32_t level = 0; level < linear.size(); level++) {
+    levels[level] = {linear[level].width, linear[level].height, {}};
+    levels[level].pixels.resize(linear[level].texels.size());
+    for (uint32_t y = 0; y < linear[level].height; y++) {
+      rows.emplace_back(level, y);
+    }
+  }
+  // The sharper filters ring, so clamp before converting
+  parallelFor(rows.size(), MIP_ROWS_PER_THREAD, [&](size_t r) {
+    auto [level, y] = rows[r];
+    size_t rowBegin = size_t(y) * linear[level].width * 4;
+    for (size_t i = rowBegin; i < rowBegin + linear[level].width * 4; i++) {
+      float value = std::clamp(linear[level].texels[i], 0.0f, 1.0f);
+      levels[level].pixels[i] = (i % 4 == 3) ? static_cast<uint8_t>(std::lround(value * 255.0f))
+                                             : toSrgb[std::lround(value * (MIP_SRGB_TABLE_SIZE - 1))];
+    }
+  });
 
-  VkPipelineLayout pipelineLayout;
+  return levels;
+}
 
-  VkPipeline graphicsPipeline;
+uint16_t packRGB565(const float color[3]) {
+  auto quantize = [](float value, float max) {
+    return static_cast<uint16_t>(std::clamp(std::lround(value / 255.0f * max), 0l, static_cast<long>(max)));
+  };
+  return static_cast<uint16_t>((quantize(color[0], 31.0f) << 11) | (quantize(color[1], 63.0f) << 5) |
+                               quantize(color[2], 31.0f));
+}
 
-  std::vector<VkFramebuffer> swapChainFrameBuffers;
+void unpackRGB565(uint16_t packed, float color[3]) {
+  color[0] = float((packed >> 11) & 31) * 255.0f / 31.0f;
+  color[1] = float((packed >> 5) & 63) * 255.0f / 63.0f;
+  color[2] = float(packed & 31) * 255.0f / 31.0f;
+}
 
-  VkCommandPool commandPool;
-  std::vector<VkCommandBuffer> commandBuffers;
+// Endpoints are the extremes of the block along its principal axis, every texel picks the closest of the four
+// palette colors. BC1 block layout: color0, color1 as little endian RGB565, then 2 index bits per texel.
+void encodeBC1Block(const uint8_t* texels, uint8_t* block) {
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 3; c++) {
+      mean[c] += texels[i * 4 + c] / 16.0f;
+    }
+  }
 
-  uint32_t mipLevels;
-  VkImage textureImage;
-  VkDeviceMemory textureImageMemory;
-  VkImageView textureImageView;
-  VkSampler textureSampler;
+  float covariance[3][3] = {};
+  for (int i = 0; i < 16; i++) {
+    float d[3] = {texels[i * 4] - mean[0], texels[i * 4 + 1] - mean[1], texels[i * 4 + 2] - mean[2]};
+    for (int a = 0; a < 3; a++) {
+      for (int b = 0; b < 3; b++) {
+        covariance[a][b] += d[a] * d[b];
+      }
+    }
+  }
 
-  std::vector<VkSemaphore> imageAvailableSemaphores;
-  std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
+  // A few power iterations are plenty to find the dominant axis of 16 points
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[3];
+    for (int a = 0; a < 3; a++) {
+      next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+    }
+    float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    if (length < 1e-6f) {
+      break;
+    }
+    for (int a = 0; a < 3; a++) {
+      axis[a] = next[a] / length;
+    }
+  }
 
-  std::vector<Vertex> vertices;
-  std::vector<uint32_t> indices;
-  VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  VkBuffer indexBuffer;
-  VkDeviceMemory indexBufferMemory;
+  float minProjection = 0.0f, maxProjection = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    float projection = (texels[i * 4] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] +
+                       (texels[i * 4 + 2] - mean[2]) * axis[2];
+    minProjection = std::min(minProjection, projection);
+    maxProjection = std::max(maxProjection, projection);
+  }
 
-  std::vector<VkBuffer> uniformBuffers;
-  std::vector<VkDeviceMemory> uniformBuffersMemory;
-  std::vector<void*> uniformBuffersMapped;
+  float maxColor[3], minColor[3];
+  for (int c = 0; c < 3; c++) {
+    maxColor[c] = mean[c] + axis[c] * maxProjection;
+    minColor[c] = mean[c] + axis[c] * minProjection;
+  }
+  uint16_t color0 = packRGB565(maxColor);
+  uint16_t color1 = packRGB565(minColor);
+  // color0 > color1 selects the opaque four color mode
+  if (color0 < color1) {
+    std::swap(color0, color1);
+  }
 
-  VkImage depthImage;
-  VkDeviceMemory depthImageMemory;
-  VkImageView depthImageView;
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    float palette[4][3];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+      palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
 
-  VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    for (int i = 0; i < 16; i++) {
+      uint32_t best = 0;
+      float bestError = std::numeric_limits<float>::max();
+      for (uint32_t p = 0; p < 4; p++) {
+        float error = 0.0f;
+        for (int c = 0; c < 3; c++) {
+          float d = texels[i * 4 + c] - palette[p][c];
+          error += d * d;
+        }
+        if (error < bestError) {
+          bestError = error;
+          best = p;
+        }
+      }
+      indices |= best << (2 * i);
+    }
+  }
 
-  VkImage colorImage;
-  VkDeviceMemory colorImageMemory;
-  VkImageView colorImageView;
+  block[0] = static_cast<uint8_t>(color0 & 0xFF);
+  block[1] = static_cast<uint8_t>(color0 >> 8);
+  block[2] = static_cast<uint8_t>(color1 & 0xFF);
+  block[3] = static_cast<uint8_t>(color1 >> 8);
+  for (int i = 0; i < 4; i++) {
+    block[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+  }
+}
 
-  bool framebbufferResized = false;
+// Intensity modifiers of the ETC1 tables, pixel index 0..3 selects +small, +large, -small, -large
+const int ETC_MODIFIERS[8][2] = {{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+// ETC1 individual mode, which every ETC2 decoder reads unchanged: the block is split into two 2x4 or 4x2 halves, each
+// with its own RGB444 base color and modifier table. Both splits and all tables are tried, the lowest error wins.
+void encodeETC2Block(const uint8_t* texels, uint8_t* block) {
+  uint64_t bestBits = 0;
+  uint64_t bestError = std::numeric_limits<uint64_t>::max();
+
+  for (uint32_t flip = 0; flip < 2; flip++) {
+    uint64_t bits = uint64_t(flip) << 32;  // diff bit 33 stays 0 for individual mode
+    uint64_t blockError = 0;
+
+    for (uint32_t half = 0; half < 2; half++) {
+      // Pixels are numbered column-major in the index bits
+      uint32_t pixels[8];
+      uint32_t count = 0;
+      for (uint32_t x = 0; x < 4; x++) {
+        for (uint32_t y = 0; y < 4; y++) {
+          if ((flip ? y / 2 : x / 2) == half) {
+            pixels[count++] = x * 4 + y;
+          }
+        }
+      }
 
-  uint32_t currentFrame = 0;
+      int base[3];
+      uint32_t base4[3];
+      for (int c = 0; c < 3; c++) {
+        uint32_t sum = 0;
+        for (uint32_t pixel : pixels) {
+          sum += texels[((pixel % 4) * 4 + pixel / 4) * 4 + c];
+        }
+        base4[c] = static_cast<uint32_t>(std::lround(sum / 8.0 * 15.0 / 255.0));
+        base[c] = static_cast<int>(base4[c] * 17);
+      }
 
-#pragma endregion VARIABLES
+      uint64_t halfError = std::numeric_limits<uint64_t>::max();
+      uint32_t halfTable = 0;
+      uint32_t halfSelectors[8] = {};
+      for (uint32_t table = 0; table < 8; table++) {
+        const int modifiers[4] = {ETC_MODIFIERS[table][0], ETC_MODIFIERS[table][1], -ETC_MODIFIERS[table][0],
+                                  -ETC_MODIFIERS[table][1]};
+        uint64_t error = 0;
+        uint32_t selectors[8];
+        for (uint32_t p = 0; p < 8; p++) {
+          uint32_t pixel = pixels[p];
+          const uint8_t* texel = &texels[((pixel % 4) * 4 + pixel / 4) * 4];
+          uint64_t pixelError = std::numeric_limits<uint64_t>::max();
+          for (uint32_t s = 0; s < 4; s++) {
+            uint64_t e = 0;
+            for (int c = 0; c < 3; c++) {
+              int d = std::clamp(base[c] + modifiers[s], 0, 255) - texel[c];
+              e += uint64_t(d * d);
+            }
+            if (e < pixelError) {
+              pixelError = e;
+              selectors[p] = s;
+            }
+          }
+          error += pixelError;
+        }
+        if (error < halfError) {
+          halfError = error;
+          halfTable = table;
+          std::copy(selectors, selectors + 8, halfSelectors);
+        }
+      }
 
-#pragma region INSTANCE
-  void createInstance() {
-    LOGFN;
-    if (enableValidationLayers && !checkValidationLayerSupport()) {
-      throw std::runtime_error("validation layers requested, but not available!");
+      bits |= uint64_t(base4[0]) << (60 - 4 * half);
+      bits |= uint64_t(base4[1]) << (52 - 4 * half);
+      bits |= uint64_t(base4[2]) << (44 - 4 * half);
+      bits |= uint64_t(halfTable) << (37 - 3 * half);
+      for (uint32_t p = 0; p < 8; p++) {
+        bits |= uint64_t(halfSelectors[p] >> 1) << (16 + pixels[p]);
+        bits |= uint64_t(halfSelectors[p] & 1) << pixels[p];
+      }
+      blockError += halfError;
     }
 
-    // Optional
-    VkApplicationInfo appInfo{};
-    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    appInfo.pApplicationName = "Hello Triangle";
-    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.pEngineName = "No Engine";
-    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    if (blockError < bestError) {
+      bestError = blockError;
+      bestBits = bits;
+    }
+  }
 
-    //
-    LOGCALL(VkInstanceCreateInfo createInfo{});
-    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    createInfo.pApplicationInfo = &appInfo;
+  // ETC blocks are stored big endian
+  for (int i = 0; i < 8; i++) {
+    block[i] = static_cast<uint8_t>(bestBits >> (56 - 8 * i));
+  }
+}
+
+std::vector<uint8_t> encodeTextureLevel(const TextureCacheFormat& format, const TextureLevel& level) {
+  if (!format.blockCompressed) {
+    return level.pixels;
+  }
+
+  std::vector<uint8_t> encoded(textureLevelSize(format, level.width, level.height));
+  uint32_t blocksX = (level.width + 3) / 4;
+  uint32_t blocksY = (level.height + 3) / 4;
+  parallelFor(blocksY, 1, [&](size_t blockRow) {
+    uint32_t by = static_cast<uint32_t>(blockRow);
+    for (uint32_t bx = 0; bx < blocksX; bx++) {
+      // Blocks hanging over the edge of small levels repeat the last row and column
+      uint8_t texels[16 * 4];
+      for (uint32_t y = 0; y < 4; y++) {
+        for (uint32_t x = 0; x < 4; x++) {
+          uint32_t sx = std::min(bx * 4 + x, level.width - 1);
+          uint32_t sy = std::min(by * 4 + y, level.height - 1);
+          memcpy(&texels[(y * 4 + x) * 4], &level.pixels[(size_t(sy) * level.width + sx) * 4], 4);
+        }
+      }
+      format.encodeBlock(texels, &encoded[(size_t(by) * blocksX + bx) * format.blockBytes]);
+    }
+  });
+  return encoded;
+}
+
+// Basic data format descriptor block of the KTX2 file, which the loader ignores but other tools require
+std::vector<uint32_t> ktx2DataFormatDescriptor(const TextureCacheFormat& format) {
+  const uint32_t KHR_DF_MODEL_RGBSDA = 1, KHR_DF_MODEL_BC1A = 128, KHR_DF_MODEL_BC7 = 135, KHR_DF_MODEL_ETC2 = 161;
+  const uint32_t KHR_DF_PRIMARIES_BT709 = 1, KHR_DF_TRANSFER_SRGB = 2;
+  const uint32_t KHR_DF_SAMPLE_DATATYPE_LINEAR = 0x10;
+
+  uint32_t model = KHR_DF_MODEL_RGBSDA;
+  // bit offset, bit length, channel id (with qualifiers), upper value
+  std::vector<std::array<uint32_t, 4>> samples;
+  if (!format.blockCompressed) {
+    samples = {{0, 8, 0, 255}, {8, 8, 1, 255}, {16, 8, 2, 255}, {24, 8, 15 | KHR_DF_SAMPLE_DATATYPE_LINEAR, 255}};
+  } else {
+    uint32_t channel = 0;
+    if (format.format == VK_FORMAT_BC1_RGB_SRGB_BLOCK) {
+      model = KHR_DF_MODEL_BC1A;
+    } else if (format.format == VK_FORMAT_BC7_SRGB_BLOCK) {
+      model = KHR_DF_MODEL_BC7;
+    } else {
+      model = KHR_DF_MODEL_ETC2;
+      channel = 2;  // KHR_DF_CHANNEL_ETC2_COLOR
+    }
+    samples = {{0, format.blockBytes * 8, channel, 0xFFFFFFFF}};
+  }
+
+  uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+  uint32_t blockDimension = format.blockCompressed ? (3 | 3 << 8) : 0;
+  std::vector<uint32_t> dfd = {
+      4 + blockSize,                                                     // total size
+      0,                                                                 // vendor Khronos, basic descriptor type
+      2 | blockSize << 16,                                               // version 2
+      model | KHR_DF_PRIMARIES_BT709 << 8 | KHR_DF_TRANSFER_SRGB << 16,  // no flags, straight alpha
+      blockDimension,                                                    // texel block size minus one
+      format.blockBytes,                                                 // bytes in plane 0
+      0,
+  };
+  for (const auto& sample : samples) {
+    dfd.push_back(sample[0] | (sample[1] - 1) << 16 | sample[2] << 24);
+    dfd.push_back(0);  // sample position
+    dfd.push_back(0);  // lower
+    dfd.push_back(sample[3]);
+  }
+  return dfd;
+}
+
+// levels[0] is the full resolution level. The data is stored smallest level first, as KTX2 requires, so the mip tail
+// sits at the front of the file.
+void writeKtx2(const std::string& filename, const TextureCacheFormat& format, uint32_t width, uint32_t height,
+               const std::vector<std::vector<uint8_t>>& levels) {
+  std::vector<uint32_t> dfd = ktx2DataFormatDescriptor(format);
+
+  Ktx2Header header{};
+  memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+  header.vkFormat = format.format;
+  header.typeSize = 1;
+  header.pixelWidth = width;
+  header.pixelHeight = height;
+  header.faceCount = 1;
+  header.levelCount = static_cast<uint32_t>(levels.size());
+  header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * levels.size());
+  header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+  // Every level starts at a multiple of lcm(block size, 4)
+  uint64_t alignment = format.blockBytes % 4 == 0 ? format.blockBytes : 4 * format.blockBytes;
+  std::vector<Ktx2LevelIndex> index(levels.size());
+  uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+  for (size_t level = levels.size(); level-- > 0;) {
+    offset = (offset + alignment - 1) / alignment * alignment;
+    index[level] = {offset, levels[level].size(), levels[level].size()};
+    offset += levels[level].size();
+  }
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open texture cache for writing!");
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(index.data()), sizeof(Ktx2LevelIndex) * index.size());
+  file.write(reinterpret_cast<const char*>(dfd.data()), header.dfdByteLength);
+  const char padding[16] = {};
+  for (size_t level = levels.size(); level-- > 0;) {
+    file.write(padding, index[level].byteOffset - static_cast<uint64_t>(file.tellp()));
+    file.write(reinterpret_cast<const char*>(levels[level].data()), levels[level].size());
+  }
+  if (!file) {
+    throw std::runtime_error("failed to write texture cache!");
+  }
+}
+
+// Checks the parts of the container the loader relies on: a plain 2D texture in `format` without supercompression,
+// no more levels than a full mip chain, and levels that start on a block and hold a whole level inside the file.
+// `data` holds the first `size` bytes of the file, at least the header and the level index.
+Ktx2Texture parseKtx2(const TextureCacheFormat& format, const char* data, size_t size, uint64_t fileSize) {
+  Ktx2Texture texture{};
+  if (size < sizeof(Ktx2Header)) {
+    throw std::runtime_error("texture cache is truncated!");
+  }
+  memcpy(&texture.header, data, sizeof(Ktx2Header));
+  const Ktx2Header& header = texture.header;
+
+  if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+    throw std::runtime_error("texture cache is not a KTX2 file!");
+  }
+  if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 ||
+      header.faceCount != 1 || header.supercompressionScheme != 0) {
+    throw std::runtime_error("texture cache must be a 2D texture without supercompression!");
+  }
+  if (header.vkFormat != static_cast<uint32_t>(format.format)) {
+    throw std::runtime_error("texture cache format does not match its file name!");
+  }
+
+  uint32_t levelCount = std::max(header.levelCount, 1u);
+  uint32_t fullChainLevels =
+      static_cast<uint32_t>(std::floor(std::log2(std::max(header.pixelWidth, header.pixelHeight)))) + 1;
+  if (levelCount > KTX2_MAX_LEVELS || levelCount > fullChainLevels) {
+    throw std::runtime_error("texture cache has too many levels!");
+  }
+  if (size < sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * levelCount) {
+    throw std::runtime_error("texture cache is truncated!");
+  }
+  texture.levels.resize(levelCount);
+  memcpy(texture.levels.data(), data + sizeof(Ktx2Header), sizeof(Ktx2LevelIndex) * levelCount);
+
+  for (uint32_t i = 0; i < levelCount; i++) {
+    const Ktx2LevelIndex& level = texture.levels[i];
+    if (level.byteLength == 0 || level.byteOffset > fileSize || level.byteLength > fileSize - level.byteOffset) {
+      throw std::runtime_error("texture cache level lies outside the file!");
+    }
+    if (level.byteOffset % format.blockBytes != 0) {
+      throw std::runtime_error("texture cache level does not start on a texel block!");
+    }
+    if (level.byteLength <
+        textureLevelSize(format, std::max(header.pixelWidth >> i, 1u), std::max(header.pixelHeight >> i, 1u))) {
+      throw std::runtime_error("texture cache level is smaller than its extent!");
+    }
+  }
+
+  return texture;
+}
+
+// [begin, end) of the level data in the file
+std::pair<uint64_t, uint64_t> ktx2DataRange(const Ktx2Texture& texture) {
+  uint64_t begin = UINT64_MAX, end = 0;
+  for (const auto& level : texture.levels) {
+    begin = std::min(begin, level.byteOffset);
+    end = std::max(end, level.byteOffset + level.byteLength);
+  }
+  return {begin, end};
+}
+
+// Offline half of the texture cache: decode the image once, build the mip chain and write one KTX2 file per format
+// with an encoder, the runtime then uploads the levels as they are
+void compressTexture(const std::string& imagePath, MipFilter filter) {
+  LOGFN;
+
+  MappedFile image(imagePath);
+  int texWidth, texHeight, texChannels;
+  stbi_uc* pixels = stbi_load_from_memory(image.data<stbi_uc>(), static_cast<int>(image.size()), &texWidth, &texHeight,
+                                          &texChannels, STBI_rgb_alpha);
+  if (!pixels) {
+    throw std::runtime_error("failed to load texture image!");
+  }
+  std::vector<TextureLevel> mipChain =
+      generateMipChain(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), filter);
+  stbi_image_free(pixels);
+
+  uint64_t rgbaBytes = 0;
+  for (const auto& level : mipChain) {
+    rgbaBytes += level.pixels.size();
+  }
+  LOG("Source:", imagePath, texWidth, "x", texHeight, "levels:", mipChain.size(), "RGBA8 bytes:", rgbaBytes);
+
+  for (const auto& format : TEXTURE_CACHE_FORMATS) {
+    if (format.blockCompressed && format.encodeBlock == nullptr) {
+      continue;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::vector<uint8_t>> levels;
+    uint64_t bytes = 0;
+    for (const auto& level : mipChain) {
+      levels.push_back(encodeTextureLevel(format, level));
+      bytes += levels.back().size();
+    }
+    std::string path = textureCachePath(imagePath, format);
+    writeKtx2(path, format, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), levels);
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    LOG("Wrote", path, "bytes:", bytes, "ratio:", double(rgbaBytes) / double(bytes), "seconds:", seconds);
+  }
+}
+
+#pragma endregion TEXTURE_CACHE
+
+#pragma region MESH_CACHE
+
+// One cluster of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles, as the mesh cache stores
+// it and the meshlet shaders read it. Keep in sync with Meshlet in meshlet_cull.comp and meshlet.mesh.
+struct Meshlet {
+  glm::vec4 boundingSphere;  // model space center and radius
+  glm::vec4 coneApex;        // xyz apex of the normal cone, w its cutoff: 1 when there is no cone
+  glm::vec4 coneAxis;        // xyz average normal of the triangles
+  uint32_t firstTriangle;    // into the meshlet triangles, and times 3 into the index buffer
+  uint32_t triangleCount;
+  uint32_t firstVertex;  // into the meshlet vertices
+  uint32_t vertexCount;
+};
+static_assert(sizeof(Meshlet) == 64, "Meshlet layout changed");
+
+// One level of detail: a range of the index buffer over the shared vertex buffer, and how far its surface strays from
+// the full mesh. Also the array the cull uniforms hand to the cull shaders, keep in sync with Lod in there.
+struct MeshLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;  // in model units, 0 for the full mesh
+  uint32_t reserved;
+};
+static_assert(sizeof(MeshLod) == 16, "MeshLod layout changed");
+
+// The model the way the renderer uploads it. The levels of detail follow each other in the index buffer, the full
+// mesh first. The meshlets cover that one in order, so the triangles of meshlet i are the indices
+// [3 * firstTriangle, 3 * (firstTriangle + triangleCount)).
+struct Mesh {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  glm::vec4 boundingSphere;  // model space center and radius
+  // lods[0] is the full mesh, the only one unless buildLods ran
+  std::vector<MeshLod> lods;
+  std::vector<Meshlet> meshlets;
+  // Vertex buffer index of every vertex of every meshlet
+  std::vector<uint32_t> meshletVertices;
+  // Three 8 bit indices into the meshlet's vertices per triangle
+  std::vector<uint32_t> meshletTriangles;
+};
+
+// Every section starts on a 16 byte boundary of the file, so a mapping of it can be read in place
+struct MeshCacheHeader {
+  uint8_t identifier[8];
+  uint32_t version;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t meshletCount;
+  uint32_t meshletVertexCount;
+  uint32_t meshletTriangleCount;
+  uint32_t lodCount;
+  uint32_t reserved;
+  float boundingSphere[4];
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  uint64_t meshletOffset;
+  uint64_t meshletVertexOffset;
+  uint64_t meshletTriangleOffset;
+  uint64_t lodOffset;
+};
+static_assert(sizeof(MeshCacheHeader) == 104, "mesh cache header layout changed");
+
+std::string meshCachePath(const std::string& modelPath) { return pathStem(modelPath) + ".mesh"; }
+
+// Sphere around the center of the bounding box of `count` points, `position(i)` returns the ith one
+template <typename Position>
+glm::vec4 boundingSphere(size_t count, Position position) {
+  glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+  for (size_t i = 0; i < count; i++) {
+    boundsMin = glm::min(boundsMin, position(i));
+    boundsMax = glm::max(boundsMax, position(i));
+  }
+  glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+  float radius = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    radius = std::max(radius, glm::length(position(i) - center));
+  }
+  return glm::vec4(center, radius);
+}
+
+Mesh loadObjMesh(const std::string& path) {
+  LOGFN;
+
+  LOG("Load Model");
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string warn, err;
+
+  LOG("Parse the OBJ in place from a mapping of the file");
+  MappedFile model = readFile(path);
+  MappedFileStreamBuf modelBuffer(model);
+  std::istream modelStream(&modelBuffer);
+  tinyobj::MaterialFileReader materialReader("");
+  if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &modelStream, &materialReader)) {
+    throw std::runtime_error(warn + err);
+  }
+
+  LOG("Vertex Count in model: ", attrib.vertices.size() / 3);
+  Mesh mesh;
+  std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+
+  for (const auto& shape : shapes) {
+    for (const auto& index : shape.mesh.indices) {
+      Vertex vertex{};
+      vertex.pos = {attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1],
+                    attrib.vertices[3 * index.vertex_index + 2]};
+
+      vertex.texCoord = {attrib.texcoords[2 * index.texcoord_index + 0],
+                         1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+
+      vertex.color = {1.0f, 1.0f, 1.0f};
+
+      if (uniqueVertices.count(vertex) == 0) {
+        uniqueVertices[vertex] = static_cast<uint32_t>(mesh.vertices.size());
+        mesh.vertices.push_back(vertex);
+      }
+
+      mesh.indices.push_back(uniqueVertices[vertex]);
+    }
+  }
+
+  LOG("Unique Vertex Count: ", mesh.vertices.size());
+  mesh.lods = {{0, static_cast<uint32_t>(mesh.indices.size()), 0.0f, 0}};
+
+  LOG("Bounding sphere around the center of the bounding box, for culling");
+  mesh.boundingSphere = boundingSphere(mesh.vertices.size(), [&](size_t i) { return mesh.vertices[i].pos; });
+  return mesh;
+}
+
+// Bounds of the meshlet whose triangles and vertices are already in `mesh`: a sphere for the frustum test and a cone
+// holding the normals of all its triangles for the backface test. The cone's apex is pulled back along the axis until
+// every triangle's plane passes in front of it, so a camera looking down the cone from past the cutoff angle sees the
+// back of every triangle.
+Meshlet meshletBounds(const Mesh& mesh, uint32_t firstTriangle, uint32_t triangleCount, uint32_t firstVertex,
+                      uint32_t vertexCount) {
+  Meshlet meshlet{};
+  meshlet.firstTriangle = firstTriangle;
+  meshlet.triangleCount = triangleCount;
+  meshlet.firstVertex = firstVertex;
+  meshlet.vertexCount = vertexCount;
+  meshlet.boundingSphere = boundingSphere(
+      vertexCount, [&](size_t i) { return mesh.vertices[mesh.meshletVertices[firstVertex + i]].pos; });
+  glm::vec3 center(meshlet.boundingSphere);
+  meshlet.coneApex = glm::vec4(center, 1.0f);
+
+  // Degenerate triangles have no normal and face nowhere, they are left out of the cone
+  std::vector<glm::vec3> normals, corners;
+  glm::vec3 normalSum(0.0f);
+  for (uint32_t i = firstTriangle; i < firstTriangle + triangleCount; i++) {
+    glm::vec3 p0 = mesh.vertices[mesh.indices[3 * i + 0]].pos;
+    glm::vec3 p1 = mesh.vertices[mesh.indices[3 * i + 1]].pos;
+    glm::vec3 p2 = mesh.vertices[mesh.indices[3 * i + 2]].pos;
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float area = glm::length(normal);
+    if (area > 0.0f) {
+      normals.push_back(normal / area);
+      corners.push_back(p0);
+      normalSum += normal / area;
+    }
+  }
+  if (normals.empty() || glm::length(normalSum) == 0.0f) {
+    return meshlet;
+  }
+
+  glm::vec3 axis = glm::normalize(normalSum);
+  float minDot = 1.0f;
+  for (const auto& normal : normals) {
+    minDot = std::min(minDot, glm::dot(axis, normal));
+  }
+  if (minDot <= MESHLET_MIN_CONE_DOT) {
+    return meshlet;
+  }
+
+  float apexDistance = 0.0f;
+  for (size_t i = 0; i < normals.size(); i++) {
+    apexDistance = std::max(apexDistance, glm::dot(center - corners[i], normals[i]) / glm::dot(axis, normals[i]));
+  }
+  meshlet.coneApex = glm::vec4(center - axis * apexDistance, std::sqrt(1.0f - minDot * minDot));
+  meshlet.coneAxis = glm::vec4(axis, 0.0f);
+  return meshlet;
+}
+
+// Greedy scan over the triangles of the full mesh in index buffer order: a triangle joins the current meshlet unless
+// it would take it past MESHLET_MAX_VERTICES or MESHLET_MAX_TRIANGLES, then it starts the next one. The index buffer
+// stays as it is, and the vertices were numbered in the order the triangles first use them, so neighbouring triangles
+// share meshlets.
+void buildMeshlets(Mesh& mesh) {
+  LOGFN;
+
+  mesh.meshlets.clear();
+  mesh.meshletVertices.clear();
+  mesh.meshletTriangles.clear();
+
+  LOG("Local index of every vertex in the meshlet being built, UINT32_MAX when it is not in there");
+  std::vector<uint32_t> localIndices(mesh.vertices.size(), UINT32_MAX);
+  uint32_t triangleCount = mesh.lods[0].indexCount / 3;
+  uint32_t firstTriangle = 0;
+  uint32_t firstVertex = 0;
+  auto finishMeshlet = [&](uint32_t endTriangle) {
+    uint32_t endVertex = static_cast<uint32_t>(mesh.meshletVertices.size());
+    mesh.meshlets.push_back(
+        meshletBounds(mesh, firstTriangle, endTriangle - firstTriangle, firstVertex, endVertex - firstVertex));
+    for (uint32_t i = firstVertex; i < endVertex; i++) {
+      localIndices[mesh.meshletVertices[i]] = UINT32_MAX;
+    }
+    firstTriangle = endTriangle;
+    firstVertex = endVertex;
+  };
+
+  for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+    const uint32_t* corners = &mesh.indices[3 * triangle];
+    uint32_t newVertices = 0;
+    for (uint32_t i = 0; i < 3; i++) {
+      newVertices += localIndices[corners[i]] == UINT32_MAX ? 1 : 0;
+    }
+    if (mesh.meshletVertices.size() - firstVertex + newVertices > MESHLET_MAX_VERTICES ||
+        triangle - firstTriangle == MESHLET_MAX_TRIANGLES) {
+      finishMeshlet(triangle);
+    }
+
+    uint32_t packed = 0;
+    for (uint32_t i = 0; i < 3; i++) {
+      if (localIndices[corners[i]] == UINT32_MAX) {
+        localIndices[corners[i]] = static_cast<uint32_t>(mesh.meshletVertices.size()) - firstVertex;
+        mesh.meshletVertices.push_back(corners[i]);
+      }
+      packed |= localIndices[corners[i]] << (8 * i);
+    }
+    mesh.meshletTriangles.push_back(packed);
+  }
+  if (firstTriangle < triangleCount) {
+    finishMeshlet(triangleCount);
+  }
+}
+
+// Quadric error metric of Garland and Heckbert: the squared distances of a point to a set of planes, summed up in a
+// symmetric 4x4 matrix. Every plane is weighted by the area it came from, so the error over the total weight is the
+// mean squared distance.
+struct Quadric {
+  std::array<double, 10> m{};  // upper triangle of the matrix, row by row
+  double weight = 0.0;
+
+  static Quadric plane(const glm::vec3& normal, const glm::vec3& point, double weight) {
+    double a = normal.x, b = normal.y, c = normal.z, d = -glm::dot(normal, point);
+    Quadric quadric;
+    quadric.m = {a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d};
+    for (auto& value : quadric.m) {
+      value *= weight;
+    }
+    quadric.weight = weight;
+    return quadric;
+  }
+
+  void add(const Quadric& other) {
+    for (size_t i = 0; i < m.size(); i++) {
+      m[i] += other.m[i];
+    }
+    weight += other.weight;
+  }
+
+  // Weighted sum of the squared distances of `p` to the planes
+  double error(const glm::vec3& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return m[0] * x * x + m[4] * y * y + m[7] * z * z + m[9] +
+           2.0 * (m[1] * x * y + m[2] * x * z + m[5] * y * z + m[3] * x + m[6] * y + m[8] * z);
+  }
+};
+
+// Edge collapse simplification with quadric error metrics over the mesh's own vertices, so every level of detail
+// indexes the same vertex buffer. Collapses move a position onto a neighbouring one instead of a new optimal point.
+// Vertices split by a texture seam share their position and collapse together: every copy moves onto the copy of the
+// target it shares a triangle with, and when one has none the collapse would tear the seam open and is skipped. Open
+// borders get planes standing on their edges, so they keep their outline. Every pass collapses the cheapest edges
+// whose neighbourhoods do not overlap, the quadrics carry over from one level of detail to the next.
+struct MeshSimplifier {
+  const std::vector<Vertex>& vertices;
+  std::vector<uint32_t> positionIds;  // per vertex
+  std::vector<glm::vec3> positions;
+  std::vector<Quadric> quadrics;  // per position
+  // The vertices at every position, and the triangles around every vertex in this pass
+  std::vector<uint32_t> positionVertexOffsets, positionVertices;
+  std::vector<uint32_t> triangleOffsets, vertexTriangles;
+  float maxError = 0.0f;
+
+  static uint64_t edgeKey(uint32_t a, uint32_t b) {
+    return (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+  }
+
+  // Groups the numbers below `count` by `key(i)`, which is below `keyCount`: the ones with key k end up in
+  // values[offsets[k]] to values[offsets[k + 1] - 1]
+  template <typename Key>
+  static void groupBy(size_t keyCount, size_t count, Key key, std::vector<uint32_t>& offsets,
+                      std::vector<uint32_t>& values) {
+    offsets.assign(keyCount + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+      offsets[key(i) + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+    values.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      values[cursors[key(i)]++] = static_cast<uint32_t>(i);
+    }
+  }
+
+  MeshSimplifier(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) : vertices(vertices) {
+    std::unordered_map<glm::vec3, uint32_t> ids;
+    positionIds.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+      auto inserted = ids.emplace(vertices[i].pos, static_cast<uint32_t>(positions.size()));
+      if (inserted.second) {
+        positions.push_back(vertices[i].pos);
+      }
+      positionIds[i] = inserted.first->second;
+    }
+    groupBy(
+        positions.size(), vertices.size(), [&](size_t i) { return positionIds[i]; }, positionVertexOffsets,
+        positionVertices);
+
+    // Triangle planes, and how many triangles use every edge to find the open borders
+    quadrics.resize(positions.size());
+    std::unordered_map<uint64_t, uint32_t> edgeUses;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      uint32_t ids[3] = {positionIds[indices[i]], positionIds[indices[i + 1]], positionIds[indices[i + 2]]};
+      glm::vec3 normal = glm::cross(positions[ids[1]] - positions[ids[0]], positions[ids[2]] - positions[ids[0]]);
+      float area = glm::length(normal);
+      if (area == 0.0f) {
+        continue;
+      }
+      Quadric quadric = Quadric::plane(normal / area, positions[ids[0]], 0.5 * area);
+      for (uint32_t corner = 0; corner < 3; corner++) {
+        quadrics[ids[corner]].add(quadric);
+        edgeUses[edgeKey(ids[corner], ids[(corner + 1) % 3])]++;
+      }
+    }
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      uint32_t ids[3] = {positionIds[indices[i]], positionIds[indices[i + 1]], positionIds[indices[i + 2]]};
+      glm::vec3 normal = glm::cross(positions[ids[1]] - positions[ids[0]], positions[ids[2]] - positions[ids[0]]);
+      if (glm::length(normal) == 0.0f) {
+        continue;
+      }
+      for (uint32_t corner = 0; corner < 3; corner++) {
+        uint32_t a = ids[corner], b = ids[(corner + 1) % 3];
+        if (edgeUses[edgeKey(a, b)] != 1) {
+          continue;
+        }
+        glm::vec3 edge = positions[b] - positions[a];
+        glm::vec3 borderNormal = glm::cross(edge, normal);
+        float length = glm::length(borderNormal);
+        if (length > 0.0f) {
+          double weight = glm::dot(edge, edge) * MESH_SIMPLIFY_BORDER_WEIGHT;
+          Quadric quadric = Quadric::plane(borderNormal / length, positions[a], weight);
+          quadrics[a].add(quadric);
+          quadrics[b].add(quadric);
+        }
+      }
+    }
+  }
+
+  // The copy of position `to` in a triangle around `vertex`, UINT32_MAX when there is none
+  uint32_t collapseTarget(const std::vector<uint32_t>& indices, uint32_t vertex, uint32_t to) const {
+    for (uint32_t i = triangleOffsets[vertex]; i < triangleOffsets[vertex + 1]; i++) {
+      for (uint32_t corner = 0; corner < 3; corner++) {
+        uint32_t index = indices[3 * vertexTriangles[i] + corner];
+        if (positionIds[index] == to) {
+          return index;
+        }
+      }
+    }
+    return UINT32_MAX;
+  }
+
+  // Mean squared distance the surface strays by when position `from` moves onto position `to`, negative when the
+  // collapse would tear a seam or fold a triangle over. `removed` counts the triangles it collapses.
+  double collapseCost(const std::vector<uint32_t>& indices, uint32_t from, uint32_t to, uint32_t& removed) const {
+    removed = 0;
+    glm::vec3 target = positions[to];
+    for (uint32_t i = positionVertexOffsets[from]; i < positionVertexOffsets[from + 1]; i++) {
+      uint32_t vertex = positionVertices[i];
+      if (triangleOffsets[vertex] == triangleOffsets[vertex + 1]) {
+        continue;
+      }
+      if (collapseTarget(indices, vertex, to) == UINT32_MAX) {
+        return -1.0;
+      }
+      for (uint32_t j = triangleOffsets[vertex]; j < triangleOffsets[vertex + 1]; j++) {
+        const uint32_t* corners = &indices[3 * vertexTriangles[j]];
+        glm::vec3 p[3];
+        bool collapses = false;
+        for (uint32_t corner = 0; corner < 3; corner++) {
+          p[corner] = positions[positionIds[corners[corner]]];
+          collapses = collapses || positionIds[corners[corner]] == to;
+        }
+        if (collapses) {
+          removed++;
+          continue;
+        }
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        for (uint32_t corner = 0; corner < 3; corner++) {
+          p[corner] = corners[corner] == vertex ? target : p[corner];
+        }
+        glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+        if (glm::dot(before, after) < 0.25f * glm::length(before) * glm::length(after)) {
+          return -1.0;
+        }
+      }
+    }
+    double weight = std::max(quadrics[from].weight + quadrics[to].weight, 1e-20);
+    return std::max((quadrics[from].error(target) + quadrics[to].error(target)) / weight, 0.0);
+  }
+
+  // Simplifies `indices` until at most `targetTriangles` are left or no collapse is allowed anymore. Returns the
+  // largest error of any collapse so far, as a distance in model units.
+  float simplify(std::vector<uint32_t>& indices, size_t targetTriangles) {
+    struct Collapse {
+      uint32_t from, to;
+      uint32_t removed;
+      double cost;
+    };
+    while (indices.size() / 3 > targetTriangles) {
+      groupBy(
+          vertices.size(), indices.size(), [&](size_t i) { return indices[i]; }, triangleOffsets, vertexTriangles);
+      for (auto& triangle : vertexTriangles) {
+        triangle /= 3;
+      }
+
+      std::vector<uint64_t> edges;
+      for (size_t i = 0; i < indices.size(); i += 3) {
+        for (uint32_t corner = 0; corner < 3; corner++) {
+          edges.push_back(edgeKey(positionIds[indices[i + corner]], positionIds[indices[i + (corner + 1) % 3]]));
+        }
+      }
+      std::sort(edges.begin(), edges.end());
+      edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+      std::vector<Collapse> collapses;
+      for (uint64_t edge : edges) {
+        uint32_t a = static_cast<uint32_t>(edge >> 32), b = static_cast<uint32_t>(edge);
+        Collapse ab{a, b, 0, 0.0};
+        ab.cost = collapseCost(indices, a, b, ab.removed);
+        Collapse ba{b, a, 0, 0.0};
+        ba.cost = collapseCost(indices, b, a, ba.removed);
+        if (ab.cost >= 0.0 && (ba.cost < 0.0 || ab.cost <= ba.cost)) {
+          collapses.push_back(ab);
+        } else if (ba.cost >= 0.0) {
+          collapses.push_back(ba);
+        }
+      }
+      std::sort(collapses.begin(), collapses.end(),
+                [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+      // Every collapse locks the positions around the one it moves, so the next ones see the triangles it was
+      // checked against
+      std::vector<uint32_t> remap(vertices.size());
+      std::iota(remap.begin(), remap.end(), 0);
+      std::vector<bool> locked(positions.size(), false);
+      size_t triangleCount = indices.size() / 3;
+      size_t collapsed = 0;
+      for (const auto& collapse : collapses) {
+        if (triangleCount <= targetTriangles) {
+          break;
+        }
+        if (locked[collapse.from] || locked[collapse.to]) {
+          continue;
+        }
+        for (uint32_t i = positionVertexOffsets[collapse.from]; i < positionVertexOffsets[collapse.from + 1]; i++) {
+          uint32_t vertex = positionVertices[i];
+          for (uint32_t j = triangleOffsets[vertex]; j < triangleOffsets[vertex + 1]; j++) {
+            for (uint32_t corner = 0; corner < 3; corner++) {
+              locked[positionIds[indices[3 * vertexTriangles[j] + corner]]] = true;
+            }
+          }
+          uint32_t target = collapseTarget(indices, vertex, collapse.to);
+          remap[vertex] = target == UINT32_MAX ? vertex : target;
+        }
+        quadrics[collapse.to].add(quadrics[collapse.from]);
+        maxError = std::max(maxError, static_cast<float>(std::sqrt(collapse.cost)));
+        triangleCount -= std::min<size_t>(collapse.removed, triangleCount);
+        collapsed++;
+      }
+      if (collapsed == 0) {
+        break;
+      }
+
+      LOG("Collapsed", collapsed, "edges, the triangles whose corners now share a position go");
+      size_t written = 0;
+      for (size_t i = 0; i < indices.size(); i += 3) {
+        uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+        if (positionIds[a] == positionIds[b] || positionIds[b] == positionIds[c] || positionIds[a] == positionIds[c]) {
+          continue;
+        }
+        indices[written++] = a;
+        indices[written++] = b;
+        indices[written++] = c;
+      }
+      indices.resize(written);
+    }
+    return maxError;
+  }
+};
+
+// Appends levels of detail after the full mesh in the index buffer, each aiming at half the triangles of the one
+// before, until there are MESH_MAX_LODS of them or the simplifier gets stuck. They all index the same vertices, so the
+// whole chain is one vertex and one index buffer. The full mesh keeps its place at the front, where the meshlets are.
+void buildLods(Mesh& mesh) {
+  LOGFN;
+
+  uint32_t fullIndexCount = mesh.lods[0].indexCount;
+  mesh.lods.resize(1);
+  mesh.indices.resize(fullIndexCount);
+  std::vector<uint32_t> indices(mesh.indices);
+  MeshSimplifier simplifier(mesh.vertices, indices);
+  while (mesh.lods.size() < MESH_MAX_LODS) {
+    size_t previousCount = indices.size();
+    float error = simplifier.simplify(indices, previousCount / 6);
+    if (indices.size() > previousCount * MESH_LOD_MAX_RATIO) {
+      LOG("Stop at", mesh.lods.size(), "levels, the simplifier got stuck at", indices.size() / 3, "triangles");
+      break;
+    }
+    mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(indices.size()), error, 0});
+    mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+  }
+}
+
+void writeMeshCache(const std::string& filename, const Mesh& mesh) {
+  MeshCacheHeader header{};
+  memcpy(header.identifier, MESH_CACHE_IDENTIFIER, sizeof(MESH_CACHE_IDENTIFIER));
+  header.version = MESH_CACHE_VERSION;
+  header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+  header.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+  header.meshletVertexCount = static_cast<uint32_t>(mesh.meshletVertices.size());
+  header.meshletTriangleCount = static_cast<uint32_t>(mesh.meshletTriangles.size());
+  header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+  memcpy(header.boundingSphere, &mesh.boundingSphere, sizeof(header.boundingSphere));
+
+  struct Section {
+    uint64_t* offset;
+    const void* data;
+    uint64_t size;
+  };
+  std::array<Section, 6> sections = {{
+      {&header.vertexOffset, mesh.vertices.data(), sizeof(Vertex) * mesh.vertices.size()},
+      {&header.indexOffset, mesh.indices.data(), sizeof(uint32_t) * mesh.indices.size()},
+      {&header.meshletOffset, mesh.meshlets.data(), sizeof(Meshlet) * mesh.meshlets.size()},
+      {&header.meshletVertexOffset, mesh.meshletVertices.data(), sizeof(uint32_t) * mesh.meshletVertices.size()},
+      {&header.meshletTriangleOffset, mesh.meshletTriangles.data(), sizeof(uint32_t) * mesh.meshletTriangles.size()},
+      {&header.lodOffset, mesh.lods.data(), sizeof(MeshLod) * mesh.lods.size()},
+  }};
+  uint64_t offset = sizeof(header);
+  for (auto& section : sections) {
+    offset = (offset + 15) / 16 * 16;
+    *section.offset = offset;
+    offset += section.size;
+  }
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open mesh cache for writing!");
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  const char padding[16] = {};
+  for (const auto& section : sections) {
+    file.write(padding, *section.offset - static_cast<uint64_t>(file.tellp()));
+    file.write(static_cast<const char*>(section.data), section.size);
+  }
+  if (!file) {
+    throw std::runtime_error("failed to write mesh cache!");
+  }
+}
+
+// Copies the sections out of the mapping and checks the header, that every section, level of detail and meshlet lies
+// inside the file, and that every index the GPU follows stays inside what it indexes
+Mesh parseMeshCache(const MappedFile& file) {
+  if (file.size() < sizeof(MeshCacheHeader)) {
+    throw std::runtime_error("mesh cache is truncated!");
+  }
+  const MeshCacheHeader& header = *file.data<MeshCacheHeader>();
+  if (memcmp(header.identifier, MESH_CACHE_IDENTIFIER, sizeof(MESH_CACHE_IDENTIFIER)) != 0) {
+    throw std::runtime_error("mesh cache is not a mesh cache file!");
+  }
+  if (header.version != MESH_CACHE_VERSION) {
+    throw std::runtime_error("mesh cache is outdated, rebuild it with --build-mesh-cache!");
+  }
+
+  auto section = [&file](uint64_t offset, uint64_t count, auto element) {
+    using T = decltype(element);
+    if (offset > file.size() || count > (file.size() - offset) / sizeof(T)) {
+      throw std::runtime_error("mesh cache section lies outside the file!");
+    }
+    const T* data = file.data<T>(static_cast<size_t>(offset));
+    return std::vector<T>(data, data + count);
+  };
+  Mesh mesh;
+  mesh.vertices = section(header.vertexOffset, header.vertexCount, Vertex{});
+  mesh.indices = section(header.indexOffset, header.indexCount, uint32_t{});
+  mesh.meshlets = section(header.meshletOffset, header.meshletCount, Meshlet{});
+  mesh.meshletVertices = section(header.meshletVertexOffset, header.meshletVertexCount, uint32_t{});
+  mesh.meshletTriangles = section(header.meshletTriangleOffset, header.meshletTriangleCount, uint32_t{});
+  mesh.lods = section(header.lodOffset, header.lodCount, MeshLod{});
+  memcpy(&mesh.boundingSphere, header.boundingSphere, sizeof(header.boundingSphere));
+
+  if (mesh.lods.empty() || mesh.lods.size() > MESH_MAX_LODS) {
+    throw std::runtime_error("mesh cache has no full mesh or too many levels of detail!");
+  }
+  for (const auto& lod : mesh.lods) {
+    if (lod.indexCount % 3 != 0 || uint64_t(lod.firstIndex) + lod.indexCount > header.indexCount) {
+      throw std::runtime_error("mesh cache level of detail lies outside the index buffer!");
+    }
+  }
+  for (const auto& meshlet : mesh.meshlets) {
+    if (meshlet.vertexCount > MESHLET_MAX_VERTICES || meshlet.triangleCount > MESHLET_MAX_TRIANGLES ||
+        uint64_t(meshlet.firstVertex) + meshlet.vertexCount > header.meshletVertexCount ||
+        uint64_t(meshlet.firstTriangle) + meshlet.triangleCount > header.meshletTriangleCount ||
+        3 * (uint64_t(meshlet.firstTriangle) + meshlet.triangleCount) > mesh.lods[0].indexCount) {
+      throw std::runtime_error("mesh cache meshlet lies outside its mesh!");
+    }
+    for (uint32_t i = 0; i < meshlet.triangleCount; i++) {
+      uint32_t triangle = mesh.meshletTriangles[meshlet.firstTriangle + i];
+      if ((triangle & 0xFF) >= meshlet.vertexCount || ((triangle >> 8) & 0xFF) >= meshlet.vertexCount ||
+          (triangle >> 16) >= meshlet.vertexCount) {
+        throw std::runtime_error("mesh cache meshlet triangle indexes past the meshlet's vertices!");
+      }
+    }
+  }
+  for (uint32_t index : mesh.indices) {
+    if (index >= header.vertexCount) {
+      throw std::runtime_error("mesh cache index lies outside the vertex buffer!");
+    }
+  }
+  for (uint32_t vertex : mesh.meshletVertices) {
+    if (vertex >= header.vertexCount) {
+      throw std::runtime_error("mesh cache meshlet vertex lies outside the vertex buffer!");
+    }
+  }
+
+  return mesh;
+}
+
+// Offline half of the mesh cache: parse the OBJ once, split it into meshlets, simplify it into levels of detail and
+// write everything the renderer uploads into one file it maps at startup
+void buildMeshCache(const std::string& modelPath) {
+  LOGFN;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  Mesh mesh = loadObjMesh(modelPath);
+  buildMeshlets(mesh);
+  buildLods(mesh);
+  std::string path = meshCachePath(modelPath);
+  writeMeshCache(path, mesh);
+  double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+  uint32_t conedMeshlets = 0;
+  for (const auto& meshlet : mesh.meshlets) {
+    conedMeshlets += meshlet.coneApex.w < 1.0f ? 1 : 0;
+  }
+  double meshletCount = std::max<double>(1.0, static_cast<double>(mesh.meshlets.size()));
+  LOG("Wrote", path, "vertices:", mesh.vertices.size(), "triangles:", mesh.lods[0].indexCount / 3,
+      "levels of detail:", mesh.lods.size(), "meshlets:", mesh.meshlets.size(), "with a normal cone:", conedMeshlets,
+      "vertices per meshlet:", mesh.meshletVertices.size() / meshletCount,
+      "triangles per meshlet:", mesh.meshletTriangles.size() / meshletCount, "seconds:", seconds);
+  for (size_t i = 0; i < mesh.lods.size(); i++) {
+    LOG("LOD", i, "triangles:", mesh.lods[i].indexCount / 3, "error:", mesh.lods[i].error);
+  }
+}
+
+#pragma endregion MESH_CACHE
+
+class App {
+ public:
+#pragma region APP
+  explicit App(const Options& options) : options(options) {}
+
+  void run() {
+    startTime = std::chrono::high_resolution_clock::now();
+    initWindow();
+    initVulkan();
+    mainLoop();
+    cleanup();
+  }
+
+ private:
+  void initWindow() {
+    LOGFN;
+    LOGCALL(glfwInit());
+
+    LOGCALL(glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API));
+    // LOGCALL(glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE));
+
+    LOGCALL(window = glfwCreateWindow(WIDTH, HEIGHT, "Illiterate Vulkan", nullptr, nullptr));
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+  }
+
+  static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+    auto app = reinterpret_cast<App*>(glfwGetWindowUserPointer(window));
+    app->framebbufferResized = true;
+  }
+
+  void initVulkan() {
+    LOGFN;
+    createInstance();
+    setupDebugMessenger();
+    createSurface();
+    pickPhysicalDevice();
+    createLogicalDevice();
+    createSwapChain();
+    createImageViews();
+    if (!dynamicRenderingPath) {
+      createRenderPass();
+    }
+    createDescriptorSetLayout();
+    createGraphicsPipeline();
+    createCommandPool();
+    createColorResources();
+    createDepthResources();
+    if (!dynamicRenderingPath) {
+      createFrameBuffers();
+    }
+    if (!options.textureCache || !loadTextureCache()) {
+      createTextureImage();
+    }
+    createTextureImageView();
+    createTextureSampler();
+    loadModel();
+    createVertexBuffer();
+    createIndexBuffer();
+    if (options.meshletCulling) {
+      createMeshletBuffers();
+    }
+    createUniformBuffers();
+    createInstanceBuffer();
+    if (bindlessPath) {
+      createObjectBuffer();
+    }
+    if (options.gpuCulling) {
+      createCullResources();
+    }
+    createDescriptorPool();
+    createDescriptorSets();
+    createCommandBuffers();
+    createSyncObjects();
+    createTimestampQueryPool();
+  }
+
+  void mainLoop() {
+    LOGFN;
+
+    auto loopStart = std::chrono::high_resolution_clock::now();
+    LOGCALL(while (!glfwWindowShouldClose(window) && (options.frameLimit == 0 || frameCount < options.frameLimit))) {
+      glfwPollEvents();
+      drawFrame();
+      frameCount++;
+    }
+
+    LOGCALL(vkDeviceWaitIdle(device));
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - loopStart).count();
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      readFrameTimestamps(i);
+      readDrawCount(i);
+    }
+
+    if (options.recreateBenchmark > 0) {
+      LOG("Recreate the swap chain", options.recreateBenchmark, "times, the cost a window resize pays");
+      for (uint32_t i = 0; i < options.recreateBenchmark; i++) {
+        recreateSwapChain();
+      }
+    }
+
+    if (frameCount > 0) {
+      std::cout << frameCount << " frames of " << options.instances << " instances, " << seconds * 1000.0 / frameCount
+                << " ms per frame, " << options.instances * frameCount / seconds << " instances/s, "
+                << (dynamicRenderingPath ? "dynamic rendering" : "render pass objects") << std::endl;
+    }
+    reportRenderingObjects();
+    if (swapChainRecreateCount > 0) {
+      std::cout << swapChainRecreateCount << " swap chain recreations, "
+                << swapChainRecreateTimeSum / swapChainRecreateCount << " ms each" << std::endl;
+    }
+    if (gpuFrameCount > 0) {
+      double gpuSeconds = gpuFrameTimeSum / 1.0e9;
+      std::cout << gpuFrameTimeSum / 1.0e6 / gpuFrameCount << " ms of GPU time per frame, "
+                << options.instances * gpuFrameCount / gpuSeconds << " instances/s on the GPU" << std::endl;
+    }
+    reportCulling();
+    reportAttachmentMemory();
+  }
+
+  void cleanup() {
+    LOGFN;
+
+    cleanupSwapChain();
+
+    LOGCALL(vkDestroyBuffer(device, uniformBuffer, nullptr));
+    LOGCALL(vkFreeMemory(device, uniformBufferMemory, nullptr));
+    LOGCALL(vkDestroyBuffer(device, instanceBuffer, nullptr));
+    LOGCALL(vkFreeMemory(device, instanceBufferMemory, nullptr));
+    if (bindlessPath) {
+      LOGCALL(vkDestroyBuffer(device, objectBuffer, nullptr));
+      LOGCALL(vkFreeMemory(device, objectBufferMemory, nullptr));
+    }
+    if (options.gpuCulling) {
+      for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        LOGCALL(vkDestroyBuffer(device, cullUniformBuffers[i], nullptr));
+        LOGCALL(vkFreeMemory(device, cullUniformBuffersMemory[i], nullptr));
+        LOGCALL(vkDestroyBuffer(device, indirectDrawBuffers[i], nullptr));
+        LOGCALL(vkFreeMemory(device, indirectDrawBuffersMemory[i], nullptr));
+        LOGCALL(vkDestroyBuffer(device, drawCountBuffers[i], nullptr));
+        LOGCALL(vkFreeMemory(device, drawCountBuffersMemory[i], nullptr));
+      }
+      for (auto pipeline : cullPipelines) {
+        if (pipeline != VK_NULL_HANDLE) {
+          LOGCALL(vkDestroyPipeline(device, pipeline, nullptr));
+        }
+      }
+      LOGCALL(vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr));
+      LOGCALL(vkDestroyDescriptorSetLayout(device, cullDescriptorSetLayout, nullptr));
+    }
+    if (options.occlusionCulling) {
+      for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        LOGCALL(vkDestroyBuffer(device, candidateBuffers[i], nullptr));
+        LOGCALL(vkFreeMemory(device, candidateBuffersMemory[i], nullptr));
+      }
+      LOGCALL(vkDestroyBuffer(device, depthPyramidCounterBuffer, nullptr));
+      LOGCALL(vkFreeMemory(device, depthPyramidCounterBufferMemory, nullptr));
+      LOGCALL(vkDestroySampler(device, depthPyramidSampler, nullptr));
+      LOGCALL(vkDestroyPipeline(device, depthPyramidPipeline, nullptr));
+      LOGCALL(vkDestroyPipelineLayout(device, depthPyramidPipelineLayout, nullptr));
+      LOGCALL(vkDestroyDescriptorSetLayout(device, depthPyramidDescriptorSetLayout, nullptr));
+      if (!dynamicRenderingPath) {
+        LOGCALL(vkDestroyRenderPass(device, occlusionRenderPass, nullptr));
+      }
+    }
+    if (timestampsSupported) {
+      LOGCALL(vkDestroyQueryPool(device, timestampQueryPool, nullptr));
+    }
+
+    if (textureStreaming) {
+      stopTextureStreaming();
+    }
+    LOGCALL(vkDestroySemaphore(device, uploadSemaphore, nullptr));
+    LOGCALL(vkDestroyFence(device, uploadFence, nullptr));
+
+    LOGCALL(vkDestroySampler(device, textureSampler, nullptr));
+    for (auto view : textureLevelViews) {
+      if (view != VK_NULL_HANDLE) {
+        LOGCALL(vkDestroyImageView(device, view, nullptr));
+      }
+    }
+    LOGCALL(vkDestroyImage(device, textureImage, nullptr));
+    LOGCALL(vkFreeMemory(device, textureImageMemory, nullptr));
+
+    LOGCALL(vkDestroyDescriptorPool(device, descriptorPool, nullptr));
+    LOGCALL(vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr));
+
+    LOGCALL(vkDestroyBuffer(device, vertexBuffer, nullptr));
+    LOGCALL(vkFreeMemory(device, vertexBufferMemory, nullptr));
+
+    LOGCALL(vkDestroyBuffer(device, indexBuffer, nullptr));
+    LOGCALL(vkFreeMemory(device, indexBufferMemory, nullptr));
+
+    if (options.meshletCulling) {
+      LOGCALL(vkDestroyBuffer(device, meshletBuffer, nullptr));
+      LOGCALL(vkFreeMemory(device, meshletBufferMemory, nullptr));
+    }
+    if (meshShaderPath) {
+      LOGCALL(vkDestroyBuffer(device, meshletVertexBuffer, nullptr));
+      LOGCALL(vkFreeMemory(device, meshletVertexBufferMemory, nullptr));
+      LOGCALL(vkDestroyBuffer(device, meshletTriangleBuffer, nullptr));
+      LOGCALL(vkFreeMemory(device, meshletTriangleBufferMemory, nullptr));
+      LOGCALL(vkDestroyPipeline(device, meshPipeline, nullptr));
+      LOGCALL(vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr));
+      LOGCALL(vkDestroyDescriptorSetLayout(device, meshletDescriptorSetLayout, nullptr));
+    }
+
+    LOGCALL(vkDestroyPipeline(device, graphicsPipeline, nullptr));
+    LOGCALL(vkDestroyPipelineLayout(device, pipelineLayout, nullptr));
+
+    if (!dynamicRenderingPath) {
+      LOGCALL(vkDestroyRenderPass(device, renderPass, nullptr));
+    }
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      LOGCALL(vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr));
+      LOGCALL(vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr));
+      LOGCALL(vkDestroyFence(device, inFlightFences[i], nullptr));
+    }
+
+    LOGCALL(vkDestroyCommandPool(device, commandPool, nullptr));
+
+    LOGCALL(vkDestroyDevice(device, nullptr));
+
+    if (enableValidationLayers) {
+      DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+    }
+
+    LOGCALL(vkDestroySurfaceKHR(instance, surface, nullptr));
+
+    LOGCALL(vkDestroyInstance(instance, nullptr));
+
+    LOGCALL(glfwDestroyWindow(window));
+    LOGCALL(glfwTerminate());
+  }
+
+#pragma endregion APP
+
+#pragma region VARIABLES
+  Options options;
+
+  GLFWwindow* window = nullptr;
+
+  VkInstance instance{};
+  VkDebugUtilsMessengerEXT debugMessenger;
+
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+
+  VkDevice device;
+  VkQueue graphicsQueue;
+  // Second queue of the graphics family when there is one, otherwise graphicsQueue. Only used from the main thread.
+  VkQueue uploadQueue;
+
+  VkSurfaceKHR surface;
+  VkQueue presentQueue;
+
+  VkSwapchainKHR swapChain;
+  std::vector<VkImage> swapChainImages;
+  VkFormat swapChainImageFormat;
+  VkExtent2D swapChainExtent;
+
+  std::vector<VkImageView> swapChainImageViews;
+
+  VkRenderPass renderPass;
+  // Dynamic rendering path, see beginRendering. No render pass or framebuffer objects, the pipelines name the formats
+  // of their attachments and the command buffer transitions the attachments itself.
+  bool dynamicRenderingPath = false;
+  PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+  PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+  // Time spent in recreateSwapChain, reported next to the frame times
+  uint32_t swapChainRecreateCount = 0;
+  double swapChainRecreateTimeSum = 0.0;
+
+  VkDescriptorPool descriptorPool;
+  VkDescriptorSetLayout descriptorSetLayout;
+  // Render sets, see renderSet. One for every frame, the frame picks its slices of the uniform and instance rings with
+  // dynamic offsets. Update after bind layouts cannot hold dynamic buffers, so the bindless path has one set per frame
+  // in flight with its slices written in.
+  std::vector<VkDescriptorSet> descriptorSets;
+  // Bindless path, see createDescriptorSetLayout. Binding 1 becomes an array of bindlessTextureCount textures, binding
+  // 3 the per-object data.
+  bool bindlessPath = false;
+  uint32_t bindlessTextureCount = 1;
+  VkBuffer objectBuffer;
+  VkDeviceMemory objectBufferMemory;
+
+  VkPipelineLayout pipelineLayout;
+
+  VkPipeline graphicsPipeline;
+
+  std::vector<VkFramebuffer> swapChainFrameBuffers;
+
+  VkCommandPool commandPool;
+  std::vector<VkCommandBuffer> commandBuffers;
+
+  uint32_t mipLevels;
+  // VK_FORMAT_R8G8B8A8_SRGB unless loadTextureCache found a better one
+  VkFormat textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+  VkImage textureImage;
+  VkDeviceMemory textureImageMemory;
+  // View of the resident levels, textureLevelViews[residentMipLevel]
+  VkImageView textureImageView;
+  VkSampler textureSampler;
+
+  // Texture streaming, see startTextureStreaming. Levels [residentMipLevel, mipLevels) are in the shader read layout,
+  // the loader thread has written levels [loadedMipLevel, mipLevels) into the staging buffer.
+  bool textureStreaming = false;
+  uint32_t residentMipLevel = 0;
+  std::atomic<uint32_t> loadedMipLevel{0};
+  std::atomic<bool> stopTextureLoader{false};
+  std::future<void> textureLoader;
+  // One view per base level, views stay alive until cleanup since older frames may still sample them
+  std::vector<VkImageView> textureLevelViews;
+  // Base level the texture descriptor of the render set points at
+  uint32_t descriptorSetMipLevel = 0;
+  std::vector<VkBufferImageCopy> textureStreamRegions;
+  VkBuffer textureStagingBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory textureStagingBufferMemory = VK_NULL_HANDLE;
+  VkCommandBuffer uploadCommandBuffer;
+  VkFence uploadFence;
+  // Signaled by every upload, the next frame waits on it before sampling the new levels
+  VkSemaphore uploadSemaphore;
+  bool uploadInFlight = false;
+  bool uploadWaitPending = false;
+
+  std::chrono::high_resolution_clock::time_point startTime;
+  bool firstFramePresented = false;
+
+  std::vector<VkSemaphore> imageAvailableSemaphores;
+  std::vector<VkSemaphore> renderFinishedSemaphores;
+  std::vector<VkFence> inFlightFences;
+
+  std::vector<Vertex> vertices;
+  // Every level of detail, the full mesh first
+  std::vector<uint32_t> indices;
+  std::vector<MeshLod> lods;
+  VkBuffer vertexBuffer;
+  VkDeviceMemory vertexBufferMemory;
+  VkBuffer indexBuffer;
+  VkDeviceMemory indexBufferMemory;
+
+  // Ring of UniformBufferObjects, one slice per frame in flight, persistently mapped
+  VkBuffer uniformBuffer;
+  VkDeviceMemory uniformBufferMemory;
+  char* uniformBufferMapped = nullptr;
+  VkDeviceSize uniformSliceSize = 0;
+
+  // Persistently mapped ring with one slice of options.instances model matrices per frame in flight
+  VkBuffer instanceBuffer;
+  VkDeviceMemory instanceBufferMemory;
+  char* instanceBufferMapped;
+  VkDeviceSize instanceSliceSize;
+  uint32_t instanceGridSide;
+  // Model space bounding sphere of the mesh, xyz center and w radius
+  glm::vec4 modelBoundingSphere;
+
+  // Meshlets of the mesh, see buildMeshlets. Only uploaded for meshlet culling, the vertices and triangles of every
+  // meshlet only for the mesh shader path.
+  std::vector<Meshlet> meshlets;
+  std::vector<uint32_t> meshletVertices;
+  std::vector<uint32_t> meshletTriangles;
+  VkBuffer meshletBuffer;
+  VkDeviceMemory meshletBufferMemory;
+  VkBuffer meshletVertexBuffer;
+  VkDeviceMemory meshletVertexBufferMemory;
+  VkBuffer meshletTriangleBuffer;
+  VkDeviceMemory meshletTriangleBufferMemory;
+  // Mesh shader path of meshlet culling, see recordMeshletTasks. The meshlet set holds what meshlet.mesh reads on top
+  // of the render set.
+  bool meshShaderPath = false;
+  PFN_vkCmdDrawMeshTasksIndirectEXT cmdDrawMeshTasksIndirect = nullptr;
+  VkDescriptorSetLayout meshletDescriptorSetLayout;
+  std::vector<VkDescriptorSet> meshletDescriptorSets;
+  VkPipelineLayout meshPipelineLayout;
+  VkPipeline meshPipeline;
+  uint64_t visibleTriangleSum = 0;
+  uint64_t backfacingMeshletSum = 0;
+  // Visible instances drawn at every level of detail, see selectLod in instance_cull.comp
+  std::array<uint64_t, MESH_MAX_LODS> lodInstanceSums{};
+
+  // GPU frustum culling, see recordInstanceCull. Per frame in flight: the cull uniforms, the indirect draws and the
+  // host visible draw count, which is read back for the report once the frame's fence has signaled.
+  bool multiDrawIndirectSupported = false;
+  bool drawIndirectCountSupported = false;
+  VkDescriptorSetLayout cullDescriptorSetLayout;
+  std::vector<VkDescriptorSet> cullDescriptorSets;
+  VkPipelineLayout cullPipelineLayout;
+  // One pipeline per phase, see instance_cull.comp. Only occlusion culling has a second phase.
+  std::array<VkPipeline, 2> cullPipelines{};
+  std::vector<VkBuffer> cullUniformBuffers;
+  std::vector<VkDeviceMemory> cullUniformBuffersMemory;
+  std::vector<void*> cullUniformBuffersMapped;
+  std::vector<VkBuffer> indirectDrawBuffers;
+  std::vector<VkDeviceMemory> indirectDrawBuffersMemory;
+  std::vector<VkBuffer> drawCountBuffers;
+  std::vector<VkDeviceMemory> drawCountBuffersMemory;
+  std::vector<void*> cullCountersMapped;
+  std::vector<bool> drawCountWritten;
+  // Visible meshlets with meshlet culling
+  uint64_t visibleInstanceSum = 0;
+  uint64_t culledFrameCount = 0;
+  float lastInstanceTime = 0.0f;
+  glm::mat4 lastViewProj;
+  glm::vec3 lastCameraPosition;
+
+  // Occlusion culling, see recordOcclusionPass. The second render pass continues on the first one's attachments. The
+  // depth pyramid is rebuilt from the first pass's depth and shared by the frames in flight, since they run in order.
+  VkRenderPass occlusionRenderPass;
+  std::vector<VkBuffer> candidateBuffers;
+  std::vector<VkDeviceMemory> candidateBuffersMemory;
+  VkDescriptorSetLayout depthPyramidDescriptorSetLayout;
+  VkDescriptorSet depthPyramidDescriptorSet;
+  VkPipelineLayout depthPyramidPipelineLayout;
+  VkPipeline depthPyramidPipeline;
+  VkSampler depthPyramidSampler;
+  VkBuffer depthPyramidCounterBuffer;
+  VkDeviceMemory depthPyramidCounterBufferMemory;
+  VkImage depthPyramid;
+  VkDeviceMemory depthPyramidMemory;
+  VkImageView depthPyramidView;
+  std::vector<VkImageView> depthPyramidLevelViews;
+  VkExtent2D depthPyramidExtent;
+  uint32_t depthPyramidLevels;
+  // Whether a recorded frame built the pyramid, and the camera it was built with
+  bool depthPyramidBuilt = false;
+  glm::mat4 depthPyramidViewProj;
+  // Phase 0 of the frame being recorded tests against the pyramid
+  bool testDepthPyramid = false;
+  std::vector<bool> occlusionTested;
+  uint64_t occludedInstanceSum = 0;
+  uint64_t occlusionFrameCount = 0;
+  // GPU frame times without [0] and with [1] the occlusion test, see occlusionTestEnabled
+  std::array<double, 2> occlusionGpuTimeSums{};  // ns
+  std::array<uint64_t, 2> occlusionGpuFrameCounts{};
+
+  // Two timestamps per frame in flight around the render pass, read once the frame's fence has signaled
+  bool timestampsSupported = false;
+  float timestampPeriod = 1.0f;
+  VkQueryPool timestampQueryPool;
+  std::vector<bool> frameTimestampsWritten;
+  double gpuFrameTimeSum = 0.0;  // ns
+  uint64_t gpuFrameCount = 0;
+  uint64_t frameCount = 0;
+
+  VkFormat depthFormat;
+  VkImage depthImage;
+  VkDeviceMemory depthImageMemory;
+  VkImageView depthImageView;
+
+  VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkImage colorImage;
+  VkDeviceMemory colorImageMemory;
+  VkImageView colorImageView;
+
+  // Footprint of a multisampled attachment, see reportAttachmentMemory. Lazily allocated memory only commits what the
+  // device ends up backing, which is nothing on tilers that keep the attachment in tile memory.
+  struct AttachmentMemory {
+    VkDeviceSize size = 0;
+    bool lazy = false;
+  };
+  AttachmentMemory colorAttachmentMemory;
+  AttachmentMemory depthAttachmentMemory;
+
+  bool framebbufferResized = false;
+
+  uint32_t currentFrame = 0;
+
+#pragma endregion VARIABLES
+
+#pragma region INSTANCE
+  void createInstance() {
+    LOGFN;
+    if (enableValidationLayers && !checkValidationLayerSupport()) {
+      throw std::runtime_error("validation layers requested, but not available!");
+    }
+
+    // Optional
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Hello Triangle";
+    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.pEngineName = "No Engine";
+    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.apiVersion = VK_API_VERSION_1_2;
+
+    //
+    LOGCALL(VkInstanceCreateInfo createInfo{});
+    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
 
     auto extensions = getRequiredExtensions();
     createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
@@ -567,6 +2463,17 @@ class App {
     return requiredExtensions.empty();
   }
 
+  bool isDeviceExtensionSupported(const char* name) {
+    LOGFN;
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    return std::any_of(availableExtensions.begin(), availableExtensions.end(), [name](const auto& extension) {
+      return strcmp(extension.extensionName, name) == 0;
+    });
+  }
+
   void pickPhysicalDevice() {
     LOGFN;
     uint32_t deviceCount = 0;
@@ -645,36 +2552,158 @@ class App {
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
-    float queuePriority = 1.0f;
+    LOG("A second graphics queue, if the family has one, uploads streamed texture levels next to the frames");
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    uint32_t graphicsQueueCount = std::min(queueFamilies[indices.graphicsFamily.value()].queueCount, 2u);
+
+    float queuePriorities[] = {1.0f, 1.0f};
     for (uint32_t queueFamily : uniqueQueueFamilies) {
       VkDeviceQueueCreateInfo queueCreateInfo{};
       queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
       queueCreateInfo.queueFamilyIndex = queueFamily;
-      queueCreateInfo.queueCount = 1;  // yo dawg, we only need one queue
+      queueCreateInfo.queueCount = queueFamily == indices.graphicsFamily.value() ? graphicsQueueCount : 1;
 
-      queueCreateInfo.pQueuePriorities = &queuePriority;
+      queueCreateInfo.pQueuePriorities = queuePriorities;
       queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.sampleRateShading = VK_TRUE;
+    LOG("Compressed texture formats for the texture cache, where available");
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    deviceFeatures.textureCompressionETC2 = supportedFeatures.textureCompressionETC2;
+
+    LOG("GPU culling draws every visible instance through firstInstance of its own indirect command");
+    if (options.gpuCulling && !supportedFeatures.drawIndirectFirstInstance) {
+      throw std::runtime_error("--gpu-culling needs drawIndirectFirstInstance!");
+    }
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect;
+
+    LOG("The depth pyramid build picks the storage view of each level by a loop index");
+    if (options.occlusionCulling) {
+      if (!supportedFeatures.shaderStorageImageArrayDynamicIndexing) {
+        throw std::runtime_error("--occlusion-culling needs shaderStorageImageArrayDynamicIndexing!");
+      }
+      deviceFeatures.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    LOG("Meshlet culling draws with mesh shaders where the device has VK_EXT_mesh_shader, which needs SPIR-V 1.4");
+    bool meshShaderExtension = options.meshletCulling && options.meshShaders &&
+                               properties.apiVersion >= VK_API_VERSION_1_2 &&
+                               isDeviceExtensionSupported(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    bool dynamicRenderingExtension = options.dynamicRendering && properties.apiVersion >= VK_API_VERSION_1_2 &&
+                                     isDeviceExtensionSupported(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    if (properties.apiVersion >= VK_API_VERSION_1_2) {
+      VkPhysicalDeviceMeshShaderFeaturesEXT supportedMeshShaderFeatures{};
+      supportedMeshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+      VkPhysicalDeviceDynamicRenderingFeaturesKHR supportedDynamicRenderingFeatures{};
+      supportedDynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+      supportedDynamicRenderingFeatures.pNext = meshShaderExtension ? &supportedMeshShaderFeatures : nullptr;
+      VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+      supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+      supportedVulkan12Features.pNext = dynamicRenderingExtension ? &supportedDynamicRenderingFeatures
+                                                                  : supportedDynamicRenderingFeatures.pNext;
+      VkPhysicalDeviceFeatures2 supportedFeatures2{};
+      supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      supportedFeatures2.pNext = &supportedVulkan12Features;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+
+      LOG("The indirect draw count lets the culling pass decide how many draws run");
+      drawIndirectCountSupported = supportedVulkan12Features.drawIndirectCount;
+      vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+
+      meshShaderPath = meshShaderExtension && supportedMeshShaderFeatures.meshShader;
+      meshShaderFeatures.meshShader = meshShaderPath ? VK_TRUE : VK_FALSE;
+
+      dynamicRenderingPath = dynamicRenderingExtension && supportedDynamicRenderingFeatures.dynamicRendering;
+      dynamicRenderingFeatures.dynamicRendering = dynamicRenderingPath ? VK_TRUE : VK_FALSE;
+
+      LOG("Descriptor indexing, core since Vulkan 1.2, for a partially bound texture array indexed per object");
+      bindlessPath = options.bindless && supportedVulkan12Features.runtimeDescriptorArray &&
+                     supportedVulkan12Features.descriptorBindingPartiallyBound &&
+                     supportedVulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+                     supportedVulkan12Features.descriptorBindingUpdateUnusedWhilePending &&
+                     supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing;
+      VkBool32 bindless = bindlessPath ? VK_TRUE : VK_FALSE;
+      vulkan12Features.runtimeDescriptorArray = bindless;
+      vulkan12Features.descriptorBindingPartiallyBound = bindless;
+      vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = bindless;
+      vulkan12Features.descriptorBindingUpdateUnusedWhilePending = bindless;
+      vulkan12Features.shaderSampledImageArrayNonUniformIndexing = bindless;
+    }
+    if (options.bindless) {
+      LOG("Descriptors:", bindlessPath ? "bindless" : "the fixed set, the device lacks descriptor indexing");
+    }
+    std::vector<const char*> extensions = deviceExtensions;
+    if (meshShaderPath) {
+      extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+      vulkan12Features.pNext = &meshShaderFeatures;
+    }
+    if (options.meshletCulling) {
+      LOG("Meshlets are drawn with", meshShaderPath ? "mesh shaders" : "indexed indirect draws");
+    }
+    if (dynamicRenderingPath) {
+      extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+      dynamicRenderingFeatures.pNext = vulkan12Features.pNext;
+      vulkan12Features.pNext = &dynamicRenderingFeatures;
+    }
+    if (options.dynamicRendering) {
+      LOG("Dynamic rendering is core in Vulkan 1.3, the 1.2 instance gets it from VK_KHR_dynamic_rendering");
+      LOG("Rendering:", dynamicRenderingPath ? "dynamic rendering" : "render passes, the device lacks it");
+    }
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    LOG("Vulkan 1.2 features can only be chained on a Vulkan 1.2 device");
+    createInfo.pNext = properties.apiVersion >= VK_API_VERSION_1_2 ? &vulkan12Features : nullptr;
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (LOGCALL(vkCreateDevice(physicalDevice, &createInfo, nullptr, &device)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create logical device!");
     }
 
+    if (meshShaderPath) {
+      LOG("Extension commands are not exported by the loader, fetch the one that launches the mesh workgroups");
+      cmdDrawMeshTasksIndirect = reinterpret_cast<PFN_vkCmdDrawMeshTasksIndirectEXT>(
+          vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksIndirectEXT"));
+      if (cmdDrawMeshTasksIndirect == nullptr) {
+        throw std::runtime_error("failed to load vkCmdDrawMeshTasksIndirectEXT!");
+      }
+    }
+    if (dynamicRenderingPath) {
+      cmdBeginRendering =
+          reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR"));
+      cmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR"));
+      if (cmdBeginRendering == nullptr || cmdEndRendering == nullptr) {
+        throw std::runtime_error("failed to load vkCmdBeginRenderingKHR!");
+      }
+    }
+
     // get device queue handle
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    vkGetDeviceQueue(device, indices.graphicsFamily.value(), graphicsQueueCount - 1, &uploadQueue);
   }
 #pragma endregion LOGICAL_DEVICE
 
@@ -848,6 +2877,15 @@ class App {
     LOGCALL(vkDestroyImage(device, depthImage, nullptr));
     LOGCALL(vkFreeMemory(device, depthImageMemory, nullptr));
 
+    if (options.occlusionCulling) {
+      for (auto view : depthPyramidLevelViews) {
+        LOGCALL(vkDestroyImageView(device, view, nullptr));
+      }
+      LOGCALL(vkDestroyImageView(device, depthPyramidView, nullptr));
+      LOGCALL(vkDestroyImage(device, depthPyramid, nullptr));
+      LOGCALL(vkFreeMemory(device, depthPyramidMemory, nullptr));
+    }
+
     for (auto framebuffer : swapChainFrameBuffers) {
       LOGCALL(vkDestroyFramebuffer(device, framebuffer, nullptr));
     }
@@ -860,29 +2898,50 @@ class App {
   void recreateSwapChain() {
     LOGFN;
 
+    LOG_ONCE("Only a minimized window waits for events, a recreation at the same size goes straight through");
     int width = 0, height = 0;
+    glfwGetFramebufferSize(window, &width, &height);
     while (width == 0 || height == 0) {
-      glfwGetFramebufferSize(window, &width, &height);
       glfwWaitEvents();
+      glfwGetFramebufferSize(window, &width, &height);
     }
 
     LOGCALL(vkDeviceWaitIdle(device));
 
     LOGCALL(vkDeviceWaitIdle(device));
 
+    auto recreateStart = std::chrono::high_resolution_clock::now();
     cleanupSwapChain();
 
     createSwapChain();
     createImageViews();
     createColorResources();
     createDepthResources();
-    createFrameBuffers();
+    if (!dynamicRenderingPath) {
+      createFrameBuffers();
+    }
+    if (options.occlusionCulling) {
+      writeDepthPyramidDescriptors();
+    }
+    swapChainRecreateTimeSum +=
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recreateStart).count();
+    swapChainRecreateCount++;
+  }
+
+  // Render pass and framebuffer objects the rendering path keeps, the framebuffers are rebuilt with every swap chain.
+  // The dynamic rendering path has none of either.
+  void reportRenderingObjects() {
+    uint32_t renderPasses = dynamicRenderingPath ? 0 : (options.occlusionCulling ? 2 : 1);
+    size_t framebuffers = dynamicRenderingPath ? 0 : swapChainFrameBuffers.size();
+    std::cout << renderPasses << " render pass objects, " << framebuffers << " framebuffers created per swap chain"
+              << std::endl;
   }
 
 #pragma endregion SWAPCHAIN
 
 #pragma region IMAGE_VIEW
-  VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) {
+  VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels,
+                              uint32_t baseMipLevel = 0) {
     LOGFN;
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -890,7 +2949,7 @@ class App {
     viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
     viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = aspectFlags;
-    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
     viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
@@ -919,9 +2978,9 @@ class App {
   void createGraphicsPipeline() {
     LOGFN;
 
-    LOG("Loading shaders");
-    auto vertShaderCode = readFile(VERTEX_SHADER_PATH);
-    auto fragShaderCode = readFile(FRAGMENT_SHADER_PATH);
+    LOG("Loading shaders, the bindless variants look up the texture of every object");
+    auto vertShaderCode = readFile(bindlessPath ? BINDLESS_VERTEX_SHADER_PATH : VERTEX_SHADER_PATH);
+    auto fragShaderCode = readFile(bindlessPath ? BINDLESS_FRAGMENT_SHADER_PATH : FRAGMENT_SHADER_PATH);
 
     LOGCALL(VkShaderModule vertShaderModule = createShaderModule(vertShaderCode));
     LOGCALL(VkShaderModule fragShaderModule = createShaderModule(fragShaderCode));
@@ -1067,8 +3126,13 @@ class App {
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = 1;
     LOGCALL(pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout);
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+    LOG("Push constant range of the per-draw constants, 16 bytes of the 128 every device has");
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawConstants);
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
     if (LOGCALL(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create pipeline layout!");
@@ -1095,6 +3159,21 @@ class App {
     pipelineInfo.renderPass = renderPass;
     pipelineInfo.subpass = 0;
 
+    VkFormat depthAttachmentFormat;
+    VkPipelineRenderingCreateInfoKHR renderingInfo{};
+    if (dynamicRenderingPath) {
+      depthAttachmentFormat = findDepthFormat();
+      LOG("Dynamic rendering: no render pass, the pipeline names the formats of the attachments it draws to");
+      renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+      renderingInfo.colorAttachmentCount = 1;
+      renderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+      renderingInfo.depthAttachmentFormat = depthAttachmentFormat;
+      LOG("The stencil of a combined format is never bound as an attachment");
+      renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+      pipelineInfo.pNext = &renderingInfo;
+      pipelineInfo.renderPass = VK_NULL_HANDLE;
+    }
+
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;  // Optional
     pipelineInfo.basePipelineIndex = -1;               // Optional
 
@@ -1103,17 +3182,49 @@ class App {
       throw std::runtime_error("failed to create graphics pipeline!");
     }
 
+    if (meshShaderPath) {
+      LOG("Mesh Pipeline, the same fixed function stages with the mesh shader in place of vertex input and shader");
+      std::array<VkDescriptorSetLayout, 2> meshSetLayouts = {descriptorSetLayout, meshletDescriptorSetLayout};
+      pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(meshSetLayouts.size());
+      pipelineLayoutInfo.pSetLayouts = meshSetLayouts.data();
+      if (LOGCALL(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &meshPipelineLayout)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create mesh pipeline layout!");
+      }
+
+      MappedFile meshShaderCode = readFile(bindlessPath ? MESHLET_BINDLESS_MESH_SHADER_PATH : MESHLET_MESH_SHADER_PATH);
+      VkShaderModule meshShaderModule = createShaderModule(meshShaderCode);
+      VkPipelineShaderStageCreateInfo meshShaderStageInfo = vertShaderStageInfo;
+      meshShaderStageInfo.stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+      meshShaderStageInfo.module = meshShaderModule;
+      VkPipelineShaderStageCreateInfo meshShaderStages[] = {meshShaderStageInfo, fragShaderStageInfo};
+
+      pipelineInfo.pStages = meshShaderStages;
+      pipelineInfo.pVertexInputState = nullptr;
+      pipelineInfo.pInputAssemblyState = nullptr;
+      pipelineInfo.layout = meshPipelineLayout;
+      if (LOGCALL(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &meshPipeline)) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to create mesh pipeline!");
+      }
+      LOGCALL(vkDestroyShaderModule(device, meshShaderModule, nullptr));
+    }
+
     // cleanup
     LOGCALL(vkDestroyShaderModule(device, vertShaderModule, nullptr));
     LOGCALL(vkDestroyShaderModule(device, fragShaderModule, nullptr));
   }
 
-  VkShaderModule createShaderModule(const std::vector<char>& code) {
+  VkShaderModule createShaderModule(const MappedFile& code) {
     LOGFN;
+    if (code.size() % sizeof(uint32_t) != 0) {
+      throw std::runtime_error("shader code is not a whole number of SPIR-V words!");
+    }
+
+    LOG("pCode points straight into the mapping, which is page aligned");
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    createInfo.pCode = code.data<uint32_t>();
 
     VkShaderModule shaderModule;
     if (LOGCALL(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule)) != VK_SUCCESS) {
@@ -1123,6 +3234,31 @@ class App {
     return shaderModule;
   }
 
+  VkPipeline createComputePipeline(const std::string& filename, VkPipelineLayout layout,
+                                   const VkSpecializationInfo* specializationInfo = nullptr) {
+    LOGFN;
+
+    MappedFile computeShaderCode = readFile(filename);
+    VkShaderModule computeShaderModule = createShaderModule(computeShaderCode);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = specializationInfo;
+    pipelineInfo.layout = layout;
+
+    VkPipeline pipeline;
+    if (LOGCALL(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline)) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create compute pipeline!");
+    }
+    LOGCALL(vkDestroyShaderModule(device, computeShaderModule, nullptr));
+
+    return pipeline;
+  }
 #pragma endregion PIPELINE
 
 #pragma region RENDER_PASS
@@ -1135,8 +3271,9 @@ class App {
     colorAttachment.samples = msaaSamples;
     LOG("clear the values to a constant at the start");
     LOGCALL(colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR);
-    LOG("store the values to memory for reading later");
-    LOGCALL(colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE);
+    LOG("the samples are resolved and dropped, unless the second render pass of occlusion culling loads them again");
+    LOGCALL(colorAttachment.storeOp =
+                options.occlusionCulling ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE);
     LOG("not using stencil buffer");
     LOGCALL(colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE);
     LOGCALL(colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE);
@@ -1157,14 +3294,16 @@ class App {
     depthAttachment.samples = msaaSamples;
     LOG("clear the values to a constant at the start");
     LOGCALL(depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR);
-    LOG("store the values to memory for reading later");
-    LOGCALL(depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE);
+    LOG("the depth is not needed after the render pass, unless occlusion culling builds its pyramid from it");
+    LOGCALL(depthAttachment.storeOp =
+                options.occlusionCulling ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE);
     LOG("not using stencil buffer");
     LOGCALL(depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE);
     LOGCALL(depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE);
     LOG("layout transition before and after render pass");
     LOGCALL(depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED);
-    LOGCALL(depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    LOGCALL(depthAttachment.finalLayout = options.occlusionCulling ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                                                   : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 
     VkAttachmentReference depthAttachmentRef{};
     LOG("which attachment to reference by its index in the attachment descriptions array");
@@ -1181,7 +3320,9 @@ class App {
     colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    LOG("with occlusion culling the second render pass presents, see createOcclusionRenderPass");
+    colorAttachmentResolve.finalLayout =
+        options.occlusionCulling ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentResolveRef{};
     colorAttachmentResolveRef.attachment = 2;
@@ -1210,6 +3351,23 @@ class App {
     LOGCALL(dependency.dstAccessMask =
                 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
 
+    if (options.occlusionCulling) {
+      LOG("Occlusion culling: the depth is cleared only after last frame's pyramid build has read it..");
+      LOGCALL(dependency.srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+    std::vector<VkSubpassDependency> dependencies = {dependency};
+    if (options.occlusionCulling) {
+      LOG("..and the pyramid build waits for the depth writes");
+      VkSubpassDependency depthReadDependency{};
+      depthReadDependency.srcSubpass = 0;
+      depthReadDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+      depthReadDependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+      depthReadDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      depthReadDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+      depthReadDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      dependencies.push_back(depthReadDependency);
+    }
+
     // Render pass
     LOG("Render Pass");
     std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve};
@@ -1219,12 +3377,61 @@ class App {
     renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
 
     if (LOGCALL(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create render pass!");
     }
+
+    if (options.occlusionCulling) {
+      createOcclusionRenderPass(attachments, subpass);
+    }
+  }
+
+  // Second render pass of occlusion culling, drawing the instances the depth pyramid of the first one let through.
+  // Same attachments as the first one, so it is compatible with its framebuffers and pipeline, but it loads them.
+  void createOcclusionRenderPass(std::array<VkAttachmentDescription, 3> attachments,
+                                 const VkSubpassDescription& subpass) {
+    LOGFN;
+
+    LOG("Continue with the color and depth the first render pass stored");
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    LOG("The resolve is written again as a whole and presented");
+    attachments[2].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[2].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    LOG("Wait for the first render pass and for the pyramid build to finish reading the depth");
+    VkSubpassDependency dependency{};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &dependency;
+
+    if (LOGCALL(vkCreateRenderPass(device, &renderPassInfo, nullptr, &occlusionRenderPass)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create occlusion render pass!");
+    }
   }
 
 #pragma endregion RENDER_PASS
@@ -1254,45 +3461,192 @@ class App {
 
 #pragma endregion FRAME_BUFFERS
 
-#pragma region VERTEX_BUFFERS
-
-  void loadModel() {
-    LOGFN;
+#pragma region DYNAMIC_RENDERING
+  VkImageMemoryBarrier attachmentBarrier(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout oldLayout,
+                                         VkImageLayout newLayout, VkAccessFlags srcAccessMask,
+                                         VkAccessFlags dstAccessMask) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = aspectMask;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = dstAccessMask;
+    return barrier;
+  }
 
-    LOG("Load Model");
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+  // Dynamic rendering counterpart of beginning renderPass, or occlusionRenderPass for the second pass of occlusion
+  // culling. The attachments are named here instead of in a framebuffer, and the layout transitions and external
+  // dependencies of those render passes become one barrier.
+  void beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool occlusionPass) {
+    LOGFN_ONCE;
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-      throw std::runtime_error(warn + err);
+    VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (hasStencilComponent(depthFormat)) {
+      depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+    VkPipelineStageFlags srcStages =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    std::array<VkImageMemoryBarrier, 3> barriers;
+    if (occlusionPass) {
+      LOG_ONCE("Continue with the color and depth of the first pass, once the pyramid build is done reading the depth");
+      srcStages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+      barriers[0] = attachmentBarrier(colorImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                                      VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+      barriers[1] = attachmentBarrier(depthImage, depthAspect, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 0,
+                                      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+      barriers[2] = attachmentBarrier(swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT,
+                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                                      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+    } else {
+      LOG_ONCE("Every attachment is cleared or written as a whole, their old contents are dropped");
+      if (options.occlusionCulling) {
+        LOG_ONCE("Occlusion culling: the depth is cleared only after last frame's pyramid build has read it");
+        srcStages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+      }
+      barriers[0] = attachmentBarrier(colorImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                                      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+      barriers[1] = attachmentBarrier(depthImage, depthAspect, VK_IMAGE_LAYOUT_UNDEFINED,
+                                      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                                      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+      LOG_ONCE("The swap chain image follows the acquire semaphore, which waits at color attachment output");
+      barriers[2] = attachmentBarrier(swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0,
+                                      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
     }
+    LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer, srcStages,
+                                      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                          VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                                      0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()),
+                                      barriers.data()));
+
+    LOG_ONCE("Multisampled color, resolved into the swap chain image at the end of the pass");
+    VkRenderingAttachmentInfoKHR colorAttachment{};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    colorAttachment.imageView = colorImageView;
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+    colorAttachment.resolveImageView = swapChainImageViews[imageIndex];
+    colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = occlusionPass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = options.occlusionCulling && !occlusionPass ? VK_ATTACHMENT_STORE_OP_STORE
+                                                                         : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.clearValue.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+    LOG_ONCE("The color samples and the depth are only kept between the passes of occlusion culling");
+    VkRenderingAttachmentInfoKHR depthAttachment{};
+    depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    depthAttachment.imageView = depthImageView;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+    depthAttachment.loadOp = occlusionPass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = options.occlusionCulling && !occlusionPass ? VK_ATTACHMENT_STORE_OP_STORE
+                                                                         : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.clearValue.depthStencil = {1.0f, 0};
+
+    VkRenderingInfoKHR renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+    renderingInfo.renderArea.offset = {0, 0};
+    renderingInfo.renderArea.extent = swapChainExtent;
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
+    renderingInfo.pDepthAttachment = &depthAttachment;
+    LOGCALL_ONCE(cmdBeginRendering(commandBuffer, &renderingInfo));
+  }
 
-    LOG("Vertex Count in model: ", attrib.vertices.size() / 3);
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+  // Ends a pass begun by beginRendering. The first pass of occlusion culling hands its depth to the pyramid build,
+  // the last pass hands the swap chain image to presentation.
+  void endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool occlusionPass) {
+    LOGFN_ONCE;
+    LOGCALL_ONCE(cmdEndRendering(commandBuffer));
 
-    for (const auto& shape : shapes) {
-      for (const auto& index : shape.mesh.indices) {
-        Vertex vertex{};
-        vertex.pos = {attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1],
-                      attrib.vertices[3 * index.vertex_index + 2]};
+    if (options.occlusionCulling && !occlusionPass) {
+      VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+      if (hasStencilComponent(depthFormat)) {
+        depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+      }
+      LOG_ONCE("The pyramid build waits for the depth writes");
+      VkImageMemoryBarrier barrier = attachmentBarrier(
+          depthImage, depthAspect, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+          VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+          VK_ACCESS_SHADER_READ_BIT);
+      LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier));
+      return;
+    }
 
-        vertex.texCoord = {attrib.texcoords[2 * index.texcoord_index + 0],
-                           1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+    LOG_ONCE("The present semaphore follows the resolve writes");
+    VkImageMemoryBarrier barrier = attachmentBarrier(
+        swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0);
+    LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier));
+  }
+#pragma endregion DYNAMIC_RENDERING
 
-        vertex.color = {1.0f, 1.0f, 1.0f};
+#pragma region VERTEX_BUFFERS
 
-        if (uniqueVertices.count(vertex) == 0) {
-          uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-          vertices.push_back(vertex);
-        }
+  // Maps the mesh cache of MODEL_PATH when there is a valid one. Otherwise parses the OBJ, and builds the meshlets at
+  // startup when meshlet culling needs them.
+  void loadModel() {
+    LOGFN;
 
-        indices.push_back(uniqueVertices[vertex]);
+    Mesh mesh;
+    bool cached = false;
+    std::string cachePath = meshCachePath(MODEL_PATH);
+    if (options.meshCache && std::ifstream(cachePath, std::ios::binary).is_open()) {
+      LOG("Load the mesh from its cache, vertices, indices, LODs and meshlets are stored the way they are uploaded");
+      try {
+        MappedFile file = readFile(cachePath);
+        mesh = parseMeshCache(file);
+        cached = true;
+      } catch (const std::exception& e) {
+        LOG("[WARNING] Rejected the mesh cache:", e.what(), "Loading the OBJ instead");
+      }
+    }
+    if (!cached) {
+      LOG("No usable mesh cache, run with --build-mesh-cache", MODEL_PATH, "to build one");
+      mesh = loadObjMesh(MODEL_PATH);
+      if (options.meshletCulling) {
+        buildMeshlets(mesh);
       }
+      if (options.lod) {
+        LOG("Simplify it into levels of detail at startup, the mesh cache has them ready");
+        buildLods(mesh);
+      }
+    }
+    if (options.meshletCulling && mesh.meshlets.empty()) {
+      throw std::runtime_error("--meshlet-culling needs a mesh with meshlets!");
+    }
+    if (options.lod && mesh.lods.size() < 2) {
+      LOG("[WARNING] The mesh could not be simplified, every instance is drawn in full");
     }
 
-    LOG("Unique Vertex Count: ", vertices.size());
+    vertices = std::move(mesh.vertices);
+    indices = std::move(mesh.indices);
+    lods = std::move(mesh.lods);
+    modelBoundingSphere = mesh.boundingSphere;
+    meshlets = std::move(mesh.meshlets);
+    meshletVertices = std::move(mesh.meshletVertices);
+    meshletTriangles = std::move(mesh.meshletTriangles);
+    LOG("Vertices:", vertices.size(), "triangles:", lods[0].indexCount / 3, "levels of detail:", lods.size(),
+        "meshlets:", meshlets.size());
   }
   void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,  //
                     VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
@@ -1344,9 +3698,12 @@ class App {
     LOGCALL(memcpy(data, vertices.data(), (size_t)bufferSize));
     LOGCALL(vkUnmapMemory(device, stagingBufferMemory));
 
-    LOG("Create Device Local Vertex Buffer");
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+    LOG("Create Device Local Vertex Buffer, the mesh shader reads it as a storage buffer");
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    if (meshShaderPath) {
+      usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    }
+    createBuffer(bufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
 
     LOG("Copy Vertex Data to Staging Buffer");
     copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
@@ -1384,6 +3741,30 @@ class App {
     LOGCALL(vkFreeMemory(device, stagingBufferMemory, nullptr));
   }
 
+  // Device local buffer holding `size` bytes of `data`, uploaded through a staging buffer like the vertex buffer
+  void createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer,
+                               VkDeviceMemory& bufferMemory) {
+    LOGFN;
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
+                 stagingBufferMemory);
+
+    void* mapped;
+    LOGCALL(vkMapMemory(device, stagingBufferMemory, 0, size, 0, &mapped));
+    LOGCALL(memcpy(mapped, data, static_cast<size_t>(size)));
+    LOGCALL(vkUnmapMemory(device, stagingBufferMemory));
+
+    createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer,
+                 bufferMemory);
+    copyBuffer(stagingBuffer, buffer, size);
+
+    LOGCALL(vkDestroyBuffer(device, stagingBuffer, nullptr));
+    LOGCALL(vkFreeMemory(device, stagingBufferMemory, nullptr));
+  }
+
   void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
     LOGFN;
 
@@ -1413,54 +3794,140 @@ class App {
     throw std::runtime_error("failed to find suitable memory type!");
   }
 
+  bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+      if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+        return true;
+      }
+    }
+    return false;
+  }
+
 #pragma endregion VERTEX_BUFFERS
 
 #pragma region UNIFORM_BUFFERS
 
+  // The model matrices are per instance, see createInstanceBuffer
   struct UniformBufferObject {
-    alignas(16) glm::mat4 model;
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 proj;
   };
 
+  // Small per-draw data, pushed with the draws instead of living in a buffer. Keep in sync with shader.frag.
+  struct DrawConstants {
+    glm::vec4 tint;
+  };
+
   void createDescriptorSetLayout() {
     LOGFN;
 
-    LOG("Uniform Buffer Object");
+    LOG("Uniform Buffer Object, dynamic: the frame's slice of the uniform ring is picked when the set is bound");
+    LOG("The bindless layout allows updates after bind, which rules out dynamic buffers");
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType =
+        bindlessPath ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    LOG("The mesh shader takes the place of the vertex shader on the mesh shader path");
+    VkShaderStageFlags geometryStages =
+        VK_SHADER_STAGE_VERTEX_BIT | (meshShaderPath ? VK_SHADER_STAGE_MESH_BIT_EXT : VkShaderStageFlags(0));
+    uboLayoutBinding.stageFlags = geometryStages;
     uboLayoutBinding.pImmutableSamplers = nullptr;  // Optional
 
-    LOG("Texture Sampler");
+    LOG("Texture Sampler, an array of every texture on the bindless path");
+    if (bindlessPath) {
+      bindlessTextureCount = bindlessTextureCapacity();
+      LOG("Bindless texture slots:", bindlessTextureCount);
+    }
     VkDescriptorSetLayoutBinding samplerLayoutBinding{};
     samplerLayoutBinding.binding = 1;
-    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.descriptorCount = bindlessTextureCount;
     samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerLayoutBinding.pImmutableSamplers = nullptr;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+    LOG("Instance Buffer, dynamic like the uniforms");
+    VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+    instanceLayoutBinding.binding = 2;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.descriptorType =
+        bindlessPath ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
+    instanceLayoutBinding.stageFlags = geometryStages;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {uboLayoutBinding, samplerLayoutBinding,
+                                                          instanceLayoutBinding};
+    std::vector<VkDescriptorBindingFlags> bindingFlags(bindings.size(), 0);
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    if (bindlessPath) {
+      LOG("Bindless: texture slots may stay empty, and the ones no frame in flight samples can be filled meanwhile");
+      bindingFlags[1] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+      LOG("Object Buffer, the per-object data indexed by instance");
+      VkDescriptorSetLayoutBinding objectLayoutBinding = instanceLayoutBinding;
+      objectLayoutBinding.binding = 3;
+      objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings.push_back(objectLayoutBinding);
+      bindingFlags.push_back(0);
+      bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+      bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+      layoutInfo.pNext = &bindingFlagsInfo;
+      layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    }
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
     layoutInfo.pBindings = bindings.data();
 
     if (LOGCALL(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create descriptor set layout!");
     }
+
+    if (meshShaderPath) {
+      createMeshletDescriptorSetLayout();
+    }
+  }
+
+  // Texture slots of the bindless array, BINDLESS_MAX_TEXTURES or whatever fewer the update after bind limits allow.
+  // Combined image samplers count as samplers and as sampled images.
+  uint32_t bindlessTextureCapacity() {
+    LOGFN;
+    VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+    vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &vulkan12Properties;
+    LOGCALL(vkGetPhysicalDeviceProperties2(physicalDevice, &properties2));
+    return std::min({BINDLESS_MAX_TEXTURES, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                     vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                     vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers,
+                     vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages});
   }
 
   void createDescriptorPool() {
     LOGFN;
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    LOG("Room for the render sets, the cull and meshlet sets of every frame and the depth pyramid set");
+    uint32_t frames = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    uint32_t renderSets = renderSetCount();
+    std::vector<VkDescriptorPoolSize> poolSizes(4);
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[0].descriptorCount = frames + (bindlessPath ? renderSets : 0);
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[1].descriptorCount = bindlessTextureCount * renderSets + frames + 1;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = frames * 10 + 1 + (bindlessPath ? renderSets * 2 : 0);
+    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[3].descriptorCount = HIZ_MAX_LEVELS;
+    if (!bindlessPath) {
+      LOG("The dynamic buffers of the render set, never in the update after bind pool of the bindless path");
+      poolSizes.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, renderSets});
+      poolSizes.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, renderSets});
+    }
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -1468,7 +3935,9 @@ class App {
     // poolInfo.pPoolSizes = &poolSize;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.maxSets = renderSets + frames * 2 + 1;
+    LOG("The bindless render sets need a pool that allows updates after bind, the other sets do not mind");
+    poolInfo.flags = bindlessPath ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0;
 
     if (LOGCALL(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create descriptor pool!");
@@ -1477,36 +3946,51 @@ class App {
 
   void createDescriptorSets() {
     LOGFN;
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+    uint32_t renderSets = renderSetCount();
+    std::vector<VkDescriptorSetLayout> layouts(renderSets, descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.descriptorSetCount = renderSets;
     allocInfo.pSetLayouts = layouts.data();
 
-    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    LOG("One render set, the dynamic bindings cover one slice of their ring and are offset to the frame's slice");
+    LOG("The bindless path has a set per frame in flight, each bound to the slices of its frame");
+    descriptorSets.resize(renderSets);
     if (LOGCALL(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data())) != VK_SUCCESS) {
       throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    LOG("The model texture goes into slot 0, the only one the bindless array fills so far");
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = textureImageView;
+    imageInfo.sampler = textureSampler;
+
+    VkDescriptorBufferInfo objectInfo{};
+    objectInfo.buffer = objectBuffer;
+    objectInfo.offset = 0;
+    objectInfo.range = VK_WHOLE_SIZE;
+
+    for (uint32_t i = 0; i < renderSets; i++) {
       VkDescriptorBufferInfo bufferInfo{};
-      bufferInfo.buffer = uniformBuffers[i];
-      bufferInfo.offset = 0;
+      bufferInfo.buffer = uniformBuffer;
+      bufferInfo.offset = uniformSliceSize * i;
       bufferInfo.range = sizeof(UniformBufferObject);
 
-      VkDescriptorImageInfo imageInfo{};
-      imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-      imageInfo.imageView = textureImageView;
-      imageInfo.sampler = textureSampler;
+      VkDescriptorBufferInfo instanceInfo{};
+      instanceInfo.buffer = instanceBuffer;
+      instanceInfo.offset = instanceSliceSize * i;
+      instanceInfo.range = sizeof(glm::mat4) * options.instances;
 
-      std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+      std::vector<VkWriteDescriptorSet> descriptorWrites(bindlessPath ? 4 : 3);
 
       descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
       descriptorWrites[0].dstSet = descriptorSets[i];
       descriptorWrites[0].dstBinding = 0;
       descriptorWrites[0].dstArrayElement = 0;
-      descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      descriptorWrites[0].descriptorType =
+          bindlessPath ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
       descriptorWrites[0].descriptorCount = 1;
       descriptorWrites[0].pBufferInfo = &bufferInfo;
 
@@ -1518,56 +4002,897 @@ class App {
       descriptorWrites[1].descriptorCount = 1;
       descriptorWrites[1].pImageInfo = &imageInfo;
 
-      LOGCALL(vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
-                                     nullptr));
+      descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrites[2].dstSet = descriptorSets[i];
+      descriptorWrites[2].dstBinding = 2;
+      descriptorWrites[2].dstArrayElement = 0;
+      descriptorWrites[2].descriptorType =
+          bindlessPath ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+      descriptorWrites[2].descriptorCount = 1;
+      descriptorWrites[2].pBufferInfo = &instanceInfo;
+
+      if (bindlessPath) {
+        descriptorWrites[3] = descriptorWrites[2];
+        descriptorWrites[3].dstBinding = 3;
+        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[3].pBufferInfo = &objectInfo;
+      }
+
+      LOGCALL(vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(),
+                                     0, nullptr));
+    }
+    descriptorSetMipLevel = residentMipLevel;
+
+    if (options.gpuCulling) {
+      createCullDescriptorSets();
+    }
+    if (meshShaderPath) {
+      createMeshletDescriptorSets();
+    }
+  }
+
+  // One buffer for the uniforms of every frame in flight instead of one each, like the instance ring
+  void createUniformBuffers() {
+    LOGFN;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+
+    LOG("One slice per frame in flight, each starting at a valid dynamic uniform buffer offset");
+    uniformSliceSize = (sizeof(UniformBufferObject) + alignment - 1) / alignment * alignment;
+    VkDeviceSize bufferSize = uniformSliceSize * MAX_FRAMES_IN_FLIGHT;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer,
+                 uniformBufferMemory);
+
+    LOG("Persistently map the buffer memory for uniforms");
+    LOG("This is a one time operation, and the memory is mapped for the lifetime of the buffer");
+    void* data;
+    LOGCALL(vkMapMemory(device, uniformBufferMemory, 0, bufferSize, 0, &data));
+    uniformBufferMapped = static_cast<char*>(data);
+  }
+
+  uint32_t renderSetCount() const { return bindlessPath ? static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) : 1; }
+
+  // The render set `frame` binds, with renderSetOffsets
+  VkDescriptorSet renderSet(uint32_t frame) const { return descriptorSets[bindlessPath ? frame : 0]; }
+
+  // Dynamic offsets of the render set for `frame`, in binding order: its uniform slice and its instance slice. The
+  // bindless sets have their slices written in and take none.
+  std::vector<uint32_t> renderSetOffsets(uint32_t frame) const {
+    if (bindlessPath) {
+      return {};
+    }
+    return {static_cast<uint32_t>(uniformSliceSize * frame), static_cast<uint32_t>(instanceSliceSize * frame)};
+  }
+
+  void updateUniformBuffer(uint32_t currentImage) {
+    LOGFN_ONCE;
+
+    static auto startTime = std::chrono::high_resolution_clock::now();
+
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+    LOG_ONCE("Pull the camera back far enough to see the whole instance grid");
+    float distance = (1.0f + (instanceGridSide - 1) * INSTANCE_SPACING * 0.5f) / options.zoom;
+    glm::vec3 eye = glm::vec3(2.0f, 2.0f, 2.0f) * distance;
+    glm::vec3 target(0.0f, 0.0f, 0.0f);
+    if (options.occlusionScene) {
+      LOG_ONCE("Occlusion scene: look across the grid from its edge at the height of the models");
+      eye = glm::vec3(-distance, 0.0f, 0.3f);
+      target = glm::vec3(distance, 0.0f, 0.3f);
+    }
+
+    LOGCALL_ONCE(UniformBufferObject ubo{});
+    LOGCALL_ONCE(ubo.view = glm::lookAt(eye, target, glm::vec3(0.0f, 0.0f, 1.0f)));
+    LOGCALL_ONCE(ubo.proj = glm::perspective(glm::radians(CAMERA_FOV),
+                                             swapChainExtent.width / (float)swapChainExtent.height, 0.1f,
+                                             10.0f * distance));
+    LOG_ONCE("flip the y axis, as glm was designed for OpenGL");
+    LOGCALL_ONCE(ubo.proj[1][1] *= -1);
+
+    LOGCALL_ONCE(memcpy(uniformBufferMapped + uniformSliceSize * currentImage, &ubo, sizeof(ubo)));
+
+    updateInstanceBuffer(currentImage, time);
+    if (options.gpuCulling) {
+      updateCullUniforms(currentImage, ubo.proj * ubo.view, eye);
+    }
+  }
+
+  void createInstanceBuffer() {
+    LOGFN;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+
+    LOG("One slice per frame in flight, each starting at a valid storage buffer offset");
+    instanceSliceSize = (sizeof(glm::mat4) * options.instances + alignment - 1) / alignment * alignment;
+    instanceGridSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(options.instances))));
+    VkDeviceSize bufferSize = instanceSliceSize * MAX_FRAMES_IN_FLIGHT;
+
+    createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBuffer,
+                 instanceBufferMemory);
+
+    LOG("Persistently map the instance ring, a frame only writes the slice its fence has released");
+    void* data;
+    LOGCALL(vkMapMemory(device, instanceBufferMemory, 0, bufferSize, 0, &data));
+    instanceBufferMapped = static_cast<char*>(data);
+    LOG("Instances:", options.instances, "grid:", instanceGridSide, "x", instanceGridSide, "bytes:", bufferSize);
+  }
+
+  // Writes the model matrix of every instance into the frame's slice of the instance ring. Each instance spins at
+  // its own phase so the copies stay distinguishable, a single instance matches the original rotating model.
+  void updateInstanceBuffer(uint32_t currentImage, float time) {
+    LOGFN_ONCE;
+
+    glm::mat4* models = reinterpret_cast<glm::mat4*>(instanceBufferMapped + instanceSliceSize * currentImage);
+    parallelFor(options.instances, INSTANCES_PER_THREAD, [=](size_t i) { models[i] = instanceModel(i, time); });
+    lastInstanceTime = time;
+  }
+
+  // Per-object data of the bindless path, keep in sync with ObjectData in shader.vert and meshlet.mesh
+  struct ObjectData {
+    glm::vec4 tint;
+    uint32_t textureIndex;  // slot in the bindless texture array
+    uint32_t reserved[3];
+  };
+
+  // The data the bindless shaders look up by instance. It does not change from frame to frame, so one device local
+  // copy serves every frame in flight.
+  void createObjectBuffer() {
+    LOGFN;
+    LOG("Every instance samples the model texture in slot 0, untinted");
+    std::vector<ObjectData> objects(options.instances, ObjectData{glm::vec4(1.0f), 0, {}});
+    createDeviceLocalBuffer(objects.data(), sizeof(ObjectData) * objects.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                            objectBuffer, objectBufferMemory);
+  }
+
+  glm::mat4 instanceModel(size_t i, float time) const {
+    float center = (instanceGridSide - 1) * 0.5f;
+    glm::vec3 position((i % instanceGridSide - center) * INSTANCE_SPACING,
+                       (i / instanceGridSide - center) * INSTANCE_SPACING, 0.0f);
+    float angle = time * glm::radians(90.0f) + i * 0.37f;
+    return glm::rotate(glm::translate(glm::mat4(1.0f), position), angle, glm::vec3(0.0f, 0.0f, 1.0f));
+  }
+
+#pragma endregion UNIFORM_BUFFERS
+
+#pragma region CULLING
+  // Keep in sync with CullUniforms in instance_cull.comp and meshlet_cull.comp
+  struct CullUniforms {
+    glm::vec4 planes[6];
+    glm::mat4 viewProj;
+    glm::mat4 pyramidViewProj;
+    glm::vec4 boundingSphere;
+    glm::vec2 pyramidSize;
+    uint32_t instanceCount;
+    uint32_t indexCount;
+    uint32_t compact;
+    uint32_t testPyramid;
+    uint32_t pyramidLevels;
+    uint32_t meshletCount;
+    glm::vec4 cameraPosition;
+    MeshLod lods[MESH_MAX_LODS];
+    uint32_t lodCount;
+    // Distance at which an error of one model unit projects to the error threshold
+    float lodErrorScale;
+  };
+
+  // Keep in sync with CullCounters in instance_cull.comp, meshlet_cull.comp and meshlet.mesh
+  struct CullCounters {
+    uint32_t drawCount[2];
+    uint32_t candidateCount;
+    uint32_t occludedCount;
+    uint32_t triangleCount;
+    uint32_t backfacingCount;
+    VkDrawMeshTasksIndirectCommandEXT meshTasks;
+    uint32_t lodInstanceCount[MESH_MAX_LODS];
+  };
+
+  // Draws one phase of the cull can write: one per instance, or one per meshlet of every instance
+  uint32_t cullDrawCapacity() const {
+    return options.instances * (options.meshletCulling ? static_cast<uint32_t>(meshlets.size()) : 1);
+  }
+
+  // Workgroups of the largest mesh task launch the cull can write: full rows of MESH_TASKS_PER_ROW as soon as there
+  // is more than one row, the tasks past the visible count return right away
+  uint64_t meshTaskLaunchCapacity() const {
+    uint64_t rows = (uint64_t(cullDrawCapacity()) + MESH_TASKS_PER_ROW - 1) / MESH_TASKS_PER_ROW;
+    return rows > 1 ? rows * MESH_TASKS_PER_ROW : cullDrawCapacity();
+  }
+
+  static VkDescriptorType cullDescriptorType(uint32_t binding) {
+    return binding == 0   ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+           : binding == 5 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                          : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  }
+
+  void createCullResources() {
+    LOGFN;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uint64_t meshletCount = options.meshletCulling ? meshlets.size() : 1;
+    if (uint64_t(options.instances) * meshletCount >
+        uint64_t(properties.limits.maxComputeWorkGroupCount[0]) * CULL_GROUP_SIZE) {
+      throw std::runtime_error("more instances and meshlets than one cull dispatch can take!");
+    }
+    LOG("maxDrawIndirectCount only limits a call issuing every draw, not the fallback's one draw per call");
+    bool drawsInOneCall = drawIndirectCountSupported || multiDrawIndirectSupported;
+    if (meshShaderPath) {
+      VkPhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties{};
+      meshShaderProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT;
+      VkPhysicalDeviceProperties2 properties2{};
+      properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+      properties2.pNext = &meshShaderProperties;
+      vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+      LOG("Every visible meshlet is a mesh workgroup of a single launch, rounded up to whole rows");
+      uint64_t rows = (uint64_t(cullDrawCapacity()) + MESH_TASKS_PER_ROW - 1) / MESH_TASKS_PER_ROW;
+      if (meshTaskLaunchCapacity() > meshShaderProperties.maxMeshWorkGroupTotalCount ||
+          rows > meshShaderProperties.maxMeshWorkGroupCount[1]) {
+        throw std::runtime_error("more meshlets than one mesh task launch of the device can take!");
+      }
+    } else if (drawsInOneCall && cullDrawCapacity() > properties.limits.maxDrawIndirectCount) {
+      throw std::runtime_error("more draws than the device's maxDrawIndirectCount!");
+    }
+    LOG("Indirect draws:", drawIndirectCountSupported ? "vkCmdDrawIndexedIndirectCount"
+                           : multiDrawIndirectSupported ? "vkCmdDrawIndexedIndirect"
+                                                        : "one vkCmdDrawIndexedIndirect per instance");
+
+    LOG("Cull set: uniforms, this frame's instance slice, indirect draws and counters");
+    LOG("Occlusion culling adds the candidates of phase 1 and the depth pyramid, meshlet culling the meshlets");
+    std::vector<VkDescriptorSetLayoutBinding> bindings(options.occlusionCulling ? 6 : options.meshletCulling ? 5 : 4);
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+      bindings[i].binding = i;
+      bindings[i].descriptorType = cullDescriptorType(i);
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (LOGCALL(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullDescriptorSetLayout)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cull descriptor set layout!");
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+    if (LOGCALL(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cull pipeline layout!");
+    }
+
+    LOG("Both phases of occlusion culling run the same shader, the phase is specialization constant 0");
+    uint32_t phaseCount = options.occlusionCulling ? 2 : 1;
+    std::string shaderPath = options.occlusionCulling ? OCCLUSION_CULL_SHADER_PATH
+                             : !options.meshletCulling ? CULL_SHADER_PATH
+                             : meshShaderPath          ? MESHLET_CULL_MESH_SHADER_PATH
+                                                       : MESHLET_CULL_SHADER_PATH;
+    for (uint32_t phase = 0; phase < phaseCount; phase++) {
+      VkSpecializationMapEntry mapEntry{0, 0, sizeof(uint32_t)};
+      VkSpecializationInfo specializationInfo{1, &mapEntry, sizeof(uint32_t), &phase};
+      cullPipelines[phase] = createComputePipeline(shaderPath, cullPipelineLayout, &specializationInfo);
+    }
+
+    cullUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    cullUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    cullUniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    indirectDrawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    indirectDrawBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    drawCountBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    drawCountBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    cullCountersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    drawCountWritten.assign(MAX_FRAMES_IN_FLIGHT, false);
+    candidateBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    candidateBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    occlusionTested.assign(MAX_FRAMES_IN_FLIGHT, false);
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      createBuffer(sizeof(CullUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cullUniformBuffers[i],
+                   cullUniformBuffersMemory[i]);
+      LOGCALL(vkMapMemory(device, cullUniformBuffersMemory[i], 0, sizeof(CullUniforms), 0,
+                          &cullUniformBuffersMapped[i]));
+
+      LOG("Occlusion culling keeps the draws of its second phase after the ones of the first");
+      LOG("The mesh shader path lists the visible meshlets in there instead, in less room than their draws");
+      createBuffer(sizeof(VkDrawIndexedIndirectCommand) * cullDrawCapacity() * phaseCount,
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectDrawBuffers[i], indirectDrawBuffersMemory[i]);
+
+      LOG("The counters stay host visible, the report reads them back");
+      createBuffer(sizeof(CullCounters),
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, drawCountBuffers[i],
+                   drawCountBuffersMemory[i]);
+      LOGCALL(vkMapMemory(device, drawCountBuffersMemory[i], 0, sizeof(CullCounters), 0, &cullCountersMapped[i]));
+
+      if (options.occlusionCulling) {
+        createBuffer(sizeof(uint32_t) * options.instances, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, candidateBuffers[i], candidateBuffersMemory[i]);
+      }
+    }
+
+    if (options.occlusionCulling) {
+      createDepthPyramidResources();
+    }
+  }
+
+  // Everything of the depth pyramid build that does not follow the swap chain, see createDepthPyramid for the rest
+  void createDepthPyramidResources() {
+    LOGFN;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if ((properties.limits.sampledImageDepthSampleCounts & msaaSamples) == 0) {
+      throw std::runtime_error("the device cannot sample the multisampled depth for the depth pyramid!");
+    }
+
+    LOG("The shaders only fetch texels, a nearest sampler over all levels will do");
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (LOGCALL(vkCreateSampler(device, &samplerInfo, nullptr, &depthPyramidSampler)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid sampler!");
+    }
+
+    LOG("Pyramid set: the depth attachment, a storage view per level and the count of finished workgroups");
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    bindings[0] = {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr};
+    bindings[1] = {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, HIZ_MAX_LEVELS, VK_SHADER_STAGE_COMPUTE_BIT, nullptr};
+    bindings[2] = {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr};
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (LOGCALL(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &depthPyramidDescriptorSetLayout)) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid descriptor set layout!");
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &depthPyramidDescriptorSetLayout;
+    if (LOGCALL(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &depthPyramidPipelineLayout)) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+    }
+    depthPyramidPipeline =
+        createComputePipeline(msaaSamples != VK_SAMPLE_COUNT_1_BIT ? DEPTH_PYRAMID_MS_SHADER_PATH
+                                                                   : DEPTH_PYRAMID_SHADER_PATH,
+                              depthPyramidPipelineLayout);
+
+    LOG("The count of finished workgroups starts at zero, the last workgroup of every build resets it");
+    createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 depthPyramidCounterBuffer, depthPyramidCounterBufferMemory);
+    void* data;
+    LOGCALL(vkMapMemory(device, depthPyramidCounterBufferMemory, 0, sizeof(uint32_t), 0, &data));
+    memset(data, 0, sizeof(uint32_t));
+    LOGCALL(vkUnmapMemory(device, depthPyramidCounterBufferMemory));
+  }
+
+  void createCullDescriptorSets() {
+    LOGFN;
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, cullDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.pSetLayouts = layouts.data();
+
+    cullDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    if (LOGCALL(vkAllocateDescriptorSets(device, &allocInfo, cullDescriptorSets.data())) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate cull descriptor sets!");
+    }
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+      bufferInfos[0] = {cullUniformBuffers[i], 0, sizeof(CullUniforms)};
+      bufferInfos[1] = {instanceBuffer, instanceSliceSize * i, sizeof(glm::mat4) * options.instances};
+      bufferInfos[2] = {indirectDrawBuffers[i], 0, VK_WHOLE_SIZE};
+      bufferInfos[3] = {drawCountBuffers[i], 0, VK_WHOLE_SIZE};
+      bufferInfos[4] = {options.meshletCulling ? meshletBuffer : candidateBuffers[i], 0, VK_WHOLE_SIZE};
+
+      LOG("The depth pyramid binding follows the swap chain, see writeDepthPyramidDescriptors");
+      std::vector<VkWriteDescriptorSet> descriptorWrites(options.occlusionCulling || options.meshletCulling ? 5 : 4);
+      for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+        descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[binding].dstSet = cullDescriptorSets[i];
+        descriptorWrites[binding].dstBinding = binding;
+        descriptorWrites[binding].dstArrayElement = 0;
+        descriptorWrites[binding].descriptorType = cullDescriptorType(binding);
+        descriptorWrites[binding].descriptorCount = 1;
+        descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+      }
+      LOGCALL(vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+                                     nullptr));
+    }
+
+    if (options.occlusionCulling) {
+      allocInfo.descriptorSetCount = 1;
+      allocInfo.pSetLayouts = &depthPyramidDescriptorSetLayout;
+      if (LOGCALL(vkAllocateDescriptorSets(device, &allocInfo, &depthPyramidDescriptorSet)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate depth pyramid descriptor set!");
+      }
+      writeDepthPyramidDescriptors();
+    }
+  }
+
+  // Points the pyramid build at the depth attachment and the pyramid levels, and the cull sets at the pyramid. All of
+  // them follow the swap chain, so this runs again after it is recreated.
+  void writeDepthPyramidDescriptors() {
+    LOGFN;
+
+    VkDescriptorImageInfo depthInfo{depthPyramidSampler, depthImageView,
+                                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    LOG("Storage views past the last level repeat it, the build never gets to them");
+    std::array<VkDescriptorImageInfo, HIZ_MAX_LEVELS> levelInfos{};
+    for (uint32_t level = 0; level < HIZ_MAX_LEVELS; level++) {
+      levelInfos[level] = {VK_NULL_HANDLE, depthPyramidLevelViews[std::min(level, depthPyramidLevels - 1)],
+                           VK_IMAGE_LAYOUT_GENERAL};
+    }
+    VkDescriptorBufferInfo counterInfo{depthPyramidCounterBuffer, 0, VK_WHOLE_SIZE};
+    VkDescriptorImageInfo pyramidInfo{depthPyramidSampler, depthPyramidView, VK_IMAGE_LAYOUT_GENERAL};
+
+    std::vector<VkWriteDescriptorSet> descriptorWrites(3 + MAX_FRAMES_IN_FLIGHT);
+    for (auto& write : descriptorWrites) {
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.descriptorCount = 1;
+    }
+    descriptorWrites[0].dstSet = depthPyramidDescriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[0].pImageInfo = &depthInfo;
+    descriptorWrites[1].dstSet = depthPyramidDescriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrites[1].descriptorCount = HIZ_MAX_LEVELS;
+    descriptorWrites[1].pImageInfo = levelInfos.data();
+    descriptorWrites[2].dstSet = depthPyramidDescriptorSet;
+    descriptorWrites[2].dstBinding = 2;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[2].pBufferInfo = &counterInfo;
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      descriptorWrites[3 + i].dstSet = cullDescriptorSets[i];
+      descriptorWrites[3 + i].dstBinding = 5;
+      descriptorWrites[3 + i].descriptorType = cullDescriptorType(5);
+      descriptorWrites[3 + i].pImageInfo = &pyramidInfo;
+    }
+    LOGCALL(vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+                                   nullptr));
+  }
+
+  // The six planes bounding the clip volume of `viewProj`, normals pointing inside and normalized so plane distances
+  // are world space distances. Depth runs from 0 to 1 (GLM_FORCE_DEPTH_ZERO_TO_ONE), so near is just the third row.
+  static std::array<glm::vec4, 6> frustumPlanes(const glm::mat4& viewProj) {
+    glm::mat4 rows = glm::transpose(viewProj);
+    std::array<glm::vec4, 6> planes = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                                       rows[3] - rows[1], rows[2],           rows[3] - rows[2]};
+    for (auto& plane : planes) {
+      plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+  }
+
+  CullUniforms cullUniforms(const glm::mat4& viewProj, const glm::vec3& cameraPosition) const {
+    CullUniforms uniforms{};
+    std::array<glm::vec4, 6> planes = frustumPlanes(viewProj);
+    std::copy(planes.begin(), planes.end(), uniforms.planes);
+    uniforms.boundingSphere = modelBoundingSphere;
+    uniforms.instanceCount = options.instances;
+    uniforms.indexCount = lods[0].indexCount;
+    uniforms.compact = drawIndirectCountSupported ? 1 : 0;
+    uniforms.viewProj = viewProj;
+    uniforms.meshletCount = static_cast<uint32_t>(meshlets.size());
+    uniforms.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+    // Without --lod there is only the full mesh to pick
+    uniforms.lodCount = options.lod ? static_cast<uint32_t>(lods.size()) : 1;
+    std::copy(lods.begin(), lods.begin() + uniforms.lodCount, uniforms.lods);
+    float pixelsPerUnit = swapChainExtent.height * 0.5f / std::tan(glm::radians(CAMERA_FOV) * 0.5f);
+    uniforms.lodErrorScale = pixelsPerUnit / options.lodThreshold;
+    if (options.occlusionCulling) {
+      uniforms.pyramidViewProj = depthPyramidViewProj;
+      uniforms.pyramidSize = glm::vec2(depthPyramidExtent.width, depthPyramidExtent.height);
+      uniforms.testPyramid = testDepthPyramid ? 1 : 0;
+      uniforms.pyramidLevels = depthPyramidLevels;
+    }
+    return uniforms;
+  }
+
+  // Runs after the frame is recorded, so a frame that built the depth pyramid hands its camera on to the next ones
+  void updateCullUniforms(uint32_t currentImage, const glm::mat4& viewProj, const glm::vec3& cameraPosition) {
+    LOGFN_ONCE;
+    CullUniforms uniforms = cullUniforms(viewProj, cameraPosition);
+    LOGCALL_ONCE(memcpy(cullUniformBuffersMapped[currentImage], &uniforms, sizeof(uniforms)));
+    lastViewProj = viewProj;
+    lastCameraPosition = cameraPosition;
+    if (options.occlusionCulling && occlusionTested[currentImage]) {
+      depthPyramidViewProj = viewProj;
+    }
+  }
+
+  // Culls the instances into the frame's indirect draws of `phase`, before the render pass drawing them. Phase 0
+  // clears the frame's counters first. Phase 1 only runs with occlusion culling, after recordDepthPyramid.
+  void recordInstanceCull(VkCommandBuffer commandBuffer, uint32_t phase) {
+    LOGFN_ONCE;
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    if (phase == 0) {
+      LOGCALL_ONCE(vkCmdFillBuffer(commandBuffer, drawCountBuffers[currentFrame], 0, VK_WHOLE_SIZE, 0));
+      LOG_ONCE("The cull also waits for the depth pyramid built by the frame before");
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr));
+      testDepthPyramid = options.occlusionCulling && depthPyramidBuilt;
+    }
+
+    LOGCALL_ONCE(vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelines[phase]));
+    LOGCALL_ONCE(vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1,
+                                         &cullDescriptorSets[currentFrame], 0, nullptr));
+    LOGCALL_ONCE(vkCmdDispatch(commandBuffer, (cullDrawCapacity() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1));
+
+    LOG_ONCE("The draws and their count are read by the indirect draw stage");
+    LOG_ONCE("On the mesh shader path the mesh shader reads the visible meshlets too");
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    if (meshShaderPath) {
+      barrier.dstAccessMask |= VK_ACCESS_SHADER_READ_BIT;
+      dstStages |= VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+    }
+    LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 1, &barrier,
+                                      0, nullptr, 0, nullptr));
+    drawCountWritten[currentFrame] = true;
+  }
+
+  // Draws what recordInstanceCull left in the frame's indirect draws of `phase`, inside the render pass
+  void recordInstanceDraws(VkCommandBuffer commandBuffer, uint32_t phase) {
+    LOGFN_ONCE;
+
+    VkBuffer drawBuffer = indirectDrawBuffers[currentFrame];
+    uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t drawCapacity = cullDrawCapacity();
+    VkDeviceSize firstDraw = VkDeviceSize(stride) * drawCapacity * phase;
+    if (drawIndirectCountSupported) {
+      LOG_ONCE("The GPU reads how many of the compacted draws to run from the count buffer");
+      VkDeviceSize countOffset = offsetof(CullCounters, drawCount) + sizeof(uint32_t) * phase;
+      LOGCALL_ONCE(vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, firstDraw, drawCountBuffers[currentFrame],
+                                                 countOffset, drawCapacity, stride));
+    } else if (multiDrawIndirectSupported) {
+      LOG_ONCE("No indirect count, run one draw per instance or meshlet, culled ones have no instances");
+      LOGCALL_ONCE(vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, firstDraw, drawCapacity, stride));
+    } else {
+      for (uint32_t i = 0; i < drawCapacity; i++) {
+        vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, firstDraw + VkDeviceSize(stride) * i, 1, stride);
+      }
+    }
+  }
+
+  // The first half of a run with --frames skips the occlusion test, as the baseline the report compares against
+  bool occlusionTestEnabled() const { return options.frameLimit == 0 || frameCount >= options.frameLimit / 2; }
+
+  // Second half of a frame with occlusion culling, after the first render pass: rebuild the depth pyramid from its
+  // depth, test the candidates of phase 0 against it and draw the ones that show up. The second render pass always
+  // runs, it is the one that leaves the swap chain image ready to present.
+  void recordOcclusionPass(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    LOGFN_ONCE;
+
+    bool tested = occlusionTestEnabled();
+    if (tested) {
+      recordDepthPyramid(commandBuffer);
+      recordInstanceCull(commandBuffer, 1);
+    }
+    occlusionTested[currentFrame] = tested;
+
+    if (dynamicRenderingPath) {
+      beginRendering(commandBuffer, imageIndex, true);
+    } else {
+      VkRenderPassBeginInfo renderPassInfo{};
+      renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      renderPassInfo.renderPass = occlusionRenderPass;
+      renderPassInfo.framebuffer = swapChainFrameBuffers[imageIndex];
+      renderPassInfo.renderArea.offset = {0, 0};
+      renderPassInfo.renderArea.extent = swapChainExtent;
+      LOGCALL_ONCE(vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE));
+    }
+
+    LOG_ONCE("Pipeline, buffers, descriptor sets and dynamic state of the first render pass are still bound");
+    if (tested) {
+      recordInstanceDraws(commandBuffer, 1);
+    }
+    if (dynamicRenderingPath) {
+      endRendering(commandBuffer, imageIndex, true);
+    } else {
+      LOGCALL_ONCE(vkCmdEndRenderPass(commandBuffer));
+    }
+  }
+
+  // Rebuilds the depth pyramid from the depth of the first render pass, between the two phases of the cull. The
+  // render pass's own dependency makes the depth visible, the barriers here order the compute passes around it.
+  void recordDepthPyramid(VkCommandBuffer commandBuffer) {
+    LOGFN_ONCE;
+
+    LOG_ONCE("Phase 0 is done with the old pyramid and its candidates are written");
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr));
+
+    LOGCALL_ONCE(vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipeline));
+    LOGCALL_ONCE(vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipelineLayout, 0,
+                                         1, &depthPyramidDescriptorSet, 0, nullptr));
+    LOG_ONCE("One workgroup per tile of level 0, the last one to finish reduces the small levels");
+    LOGCALL_ONCE(vkCmdDispatch(commandBuffer, (depthPyramidExtent.width + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE,
+                               (depthPyramidExtent.height + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE, 1));
+
+    LOG_ONCE("Phase 1 reads the new pyramid");
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr));
+    depthPyramidBuilt = true;
+  }
+
+  // Adds the counters of `frame` to the cull report, the caller has waited for the frame's fence
+  void readDrawCount(uint32_t frame) {
+    if (!options.gpuCulling || !drawCountWritten[frame]) {
+      return;
+    }
+    const auto* counters = static_cast<const CullCounters*>(cullCountersMapped[frame]);
+    visibleInstanceSum += counters->drawCount[0] + counters->drawCount[1];
+    visibleTriangleSum += counters->triangleCount;
+    backfacingMeshletSum += counters->backfacingCount;
+    for (uint32_t i = 0; i < MESH_MAX_LODS; i++) {
+      lodInstanceSums[i] += counters->lodInstanceCount[i];
+    }
+    culledFrameCount++;
+    if (options.occlusionCulling && occlusionTested[frame]) {
+      occludedInstanceSum += counters->occludedCount;
+      occlusionFrameCount++;
+    }
+    drawCountWritten[frame] = false;
+  }
+
+  // Prints how much the GPU pass culled and what the same test costs on a single CPU thread, the CPU time the pass
+  // saves every frame. The reference culls the last frame's instances.
+  void reportCulling() {
+    LOGFN;
+    if (culledFrameCount == 0) {
+      return;
+    }
+    if (options.meshletCulling) {
+      reportMeshletCulling();
+      return;
+    }
+
+    double visible = static_cast<double>(visibleInstanceSum) / culledFrameCount;
+    std::cout << "GPU culling ("
+              << (drawIndirectCountSupported ? "indirect count" : "indirect, one draw per instance")
+              << "): " << visible << " of " << options.instances << " instances visible per frame, "
+              << 100.0 * (1.0 - visible / options.instances) << "% culled" << std::endl;
+    if (options.lod) {
+      reportLodSelection();
+    }
+
+    std::vector<glm::mat4> models(options.instances);
+    for (size_t i = 0; i < models.size(); i++) {
+      models[i] = instanceModel(i, lastInstanceTime);
+    }
+    CullUniforms uniforms = cullUniforms(lastViewProj, lastCameraPosition);
+    uint32_t cpuVisible = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t repeat = 0; repeat < CPU_CULL_REPEATS; repeat++) {
+      cpuVisible = 0;
+      for (const auto& model : models) {
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(uniforms.boundingSphere), 1.0f));
+        float scale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])),
+                                glm::length(glm::vec3(model[2]))});
+        float radius = uniforms.boundingSphere.w * scale;
+        bool inside = true;
+        for (const auto& plane : uniforms.planes) {
+          inside = inside && glm::dot(glm::vec3(plane), center) + plane.w >= -radius;
+        }
+        cpuVisible += inside ? 1 : 0;
+      }
+    }
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+    double cpuMs = std::chrono::duration<double, std::milli>(elapsed).count() / CPU_CULL_REPEATS;
+    std::cout << "Culling on one CPU thread would take " << cpuMs << " ms per frame (" << cpuVisible
+              << " visible in the last frame), saved by the GPU pass" << std::endl;
+
+    if (options.occlusionCulling) {
+      reportOcclusionCulling();
+    }
+  }
+
+  // Prints how many triangles the levels of detail saved against drawing every visible instance in full, and which
+  // levels the visible instances got
+  void reportLodSelection() {
+    LOGFN;
+    double frames = static_cast<double>(culledFrameCount);
+    double fullTriangles = visibleInstanceSum / frames * (lods[0].indexCount / 3);
+    double triangles = visibleTriangleSum / frames;
+    std::cout << "LOD selection (at most " << options.lodThreshold << " pixels of error): " << triangles << " of "
+              << fullTriangles << " triangles drawn per frame, " << fullTriangles - triangles << " saved, "
+              << 100.0 * (1.0 - triangles / std::max(fullTriangles, 1.0)) << "%" << std::endl;
+    for (size_t i = 0; i < lods.size(); i++) {
+      std::cout << "  LOD " << i << ": " << lods[i].indexCount / 3 << " triangles, error " << lods[i].error << ", "
+                << lodInstanceSums[i] / frames << " instances per frame" << std::endl;
+    }
+  }
+
+  // Prints what the occlusion test rejected and, for runs with --frames, the GPU frame time of the first half of the
+  // frames without the test against the second half with it. Both halves pay for the split into two render passes.
+  void reportOcclusionCulling() {
+    LOGFN;
+    if (occlusionFrameCount > 0) {
+      double occluded = static_cast<double>(occludedInstanceSum) / occlusionFrameCount;
+      std::cout << "Occlusion culling: " << occluded << " instances, " << occluded * (lods[0].indexCount / 3)
+                << " triangles rejected per frame" << std::endl;
+    }
+    if (occlusionGpuFrameCounts[0] > 0 && occlusionGpuFrameCounts[1] > 0) {
+      double without = occlusionGpuTimeSums[0] / 1.0e6 / occlusionGpuFrameCounts[0];
+      double with = occlusionGpuTimeSums[1] / 1.0e6 / occlusionGpuFrameCounts[1];
+      std::cout << "GPU time per frame: " << without << " ms without the occlusion test, " << with
+                << " ms with it, " << without - with << " ms saved" << std::endl;
     }
   }
+#pragma endregion CULLING
 
-  void createUniformBuffers() {
+#pragma region MESHLETS
+  void createMeshletBuffers() {
     LOGFN;
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    LOG("Bounds and ranges of every meshlet, for the cull");
+    createDeviceLocalBuffer(meshlets.data(), sizeof(Meshlet) * meshlets.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                            meshletBuffer, meshletBufferMemory);
+    if (meshShaderPath) {
+      LOG("The vertices and triangles of every meshlet, for the mesh shader");
+      createDeviceLocalBuffer(meshletVertices.data(), sizeof(uint32_t) * meshletVertices.size(),
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletVertexBuffer, meshletVertexBufferMemory);
+      createDeviceLocalBuffer(meshletTriangles.data(), sizeof(uint32_t) * meshletTriangles.size(),
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletTriangleBuffer, meshletTriangleBufferMemory);
+    }
+  }
+
+  void createMeshletDescriptorSetLayout() {
+    LOGFN;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-      createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i],
-                   uniformBuffersMemory[i]);
+    LOG("Meshlet set: vertices, meshlets, their vertices and triangles, this frame's visible meshlets and counters");
+    std::array<VkDescriptorSetLayoutBinding, 6> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+      bindings[i] = {i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_MESH_BIT_EXT, nullptr};
+    }
 
-      LOG("Persistently map the buffer memory for uniforms");
-      LOG("This is a one time operation, and the memory is mapped for the lifetime of the buffer");
-      LOGCALL(vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]));
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (LOGCALL(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &meshletDescriptorSetLayout)) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create meshlet descriptor set layout!");
     }
   }
 
-  void updateUniformBuffer(uint32_t currentImage) {
-    LOGFN_ONCE;
+  void createMeshletDescriptorSets() {
+    LOGFN;
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, meshletDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.pSetLayouts = layouts.data();
 
-    static auto startTime = std::chrono::high_resolution_clock::now();
+    meshletDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    if (LOGCALL(vkAllocateDescriptorSets(device, &allocInfo, meshletDescriptorSets.data())) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate meshlet descriptor sets!");
+    }
 
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      std::array<VkDescriptorBufferInfo, 6> bufferInfos{};
+      bufferInfos[0] = {vertexBuffer, 0, VK_WHOLE_SIZE};
+      bufferInfos[1] = {meshletBuffer, 0, VK_WHOLE_SIZE};
+      bufferInfos[2] = {meshletVertexBuffer, 0, VK_WHOLE_SIZE};
+      bufferInfos[3] = {meshletTriangleBuffer, 0, VK_WHOLE_SIZE};
+      bufferInfos[4] = {indirectDrawBuffers[i], 0, VK_WHOLE_SIZE};
+      bufferInfos[5] = {drawCountBuffers[i], 0, VK_WHOLE_SIZE};
+
+      std::array<VkWriteDescriptorSet, 6> descriptorWrites{};
+      for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+        descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[binding].dstSet = meshletDescriptorSets[i];
+        descriptorWrites[binding].dstBinding = binding;
+        descriptorWrites[binding].dstArrayElement = 0;
+        descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[binding].descriptorCount = 1;
+        descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+      }
+      LOGCALL(vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+                                     nullptr));
+    }
+  }
 
-    LOGCALL_ONCE(UniformBufferObject ubo{});
-    LOGCALL_ONCE(ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
-    LOGCALL_ONCE(
-        ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
-    LOGCALL_ONCE(ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height,
-                                             0.1f, 10.0f));
-    LOG_ONCE("flip the y axis, as glm was designed for OpenGL");
-    LOGCALL_ONCE(ubo.proj[1][1] *= -1);
+  // Draws the meshlets recordInstanceCull left visible with one mesh workgroup each, inside the render pass. The cull
+  // wrote how many workgroups to launch next to its other counters.
+  void recordMeshletTasks(VkCommandBuffer commandBuffer) {
+    LOGFN_ONCE;
 
-    LOGCALL_ONCE(memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo)));
+    LOGCALL_ONCE(vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline));
+    std::array<VkDescriptorSet, 2> sets = {renderSet(currentFrame), meshletDescriptorSets[currentFrame]};
+    std::vector<uint32_t> dynamicOffsets = renderSetOffsets(currentFrame);
+    LOGCALL_ONCE(vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout, 0,
+                                         static_cast<uint32_t>(sets.size()), sets.data(),
+                                         static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data()));
+    LOGCALL_ONCE(cmdDrawMeshTasksIndirect(commandBuffer, drawCountBuffers[currentFrame],
+                                          offsetof(CullCounters, meshTasks), 1,
+                                          sizeof(VkDrawMeshTasksIndirectCommandEXT)));
   }
 
-#pragma endregion UNIFORM_BUFFERS
+  // Prints how many meshlets and triangles survived the cull, and how many meshlets the normal cones rejected on top
+  // of the frustum test
+  void reportMeshletCulling() {
+    LOGFN;
+    double frames = static_cast<double>(culledFrameCount);
+    double meshletCount = static_cast<double>(cullDrawCapacity());
+    double triangleCount = static_cast<double>(options.instances) * (lods[0].indexCount / 3);
+    double visible = visibleInstanceSum / frames;
+    double triangles = visibleTriangleSum / frames;
+    std::cout << "Meshlet culling (" << (meshShaderPath ? "mesh shaders" : "indexed indirect draws") << "): " << visible
+              << " of " << meshletCount << " meshlets visible per frame, " << backfacingMeshletSum / frames
+              << " rejected by their normal cone" << std::endl;
+    std::cout << triangles << " of " << triangleCount << " triangles drawn per frame, "
+              << 100.0 * (1.0 - triangles / triangleCount) << "% culled" << std::endl;
+  }
+#pragma endregion MESHLETS
 
 #pragma region TEXTURE
   void createTextureImageView() {
     LOGFN;
-    textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+    textureLevelViews.assign(mipLevels, VK_NULL_HANDLE);
+    textureImageView = textureViewForLevel(residentMipLevel);
+  }
+
+  // View of levels [baseMipLevel, mipLevels), created on first use
+  VkImageView textureViewForLevel(uint32_t baseMipLevel) {
+    if (textureLevelViews[baseMipLevel] == VK_NULL_HANDLE) {
+      VkImageViewCreateInfo viewInfo{};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.image = textureImage;
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = textureFormat;
+      viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+      viewInfo.subresourceRange.levelCount = mipLevels - baseMipLevel;
+      viewInfo.subresourceRange.baseArrayLayer = 0;
+      viewInfo.subresourceRange.layerCount = 1;
+
+      if (vkCreateImageView(device, &viewInfo, nullptr, &textureLevelViews[baseMipLevel]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture level view!");
+      }
+    }
+    return textureLevelViews[baseMipLevel];
   }
 
   void createTextureSampler() {
@@ -1611,8 +4936,11 @@ class App {
 
     LOG("Load Image");
 
+    LOG("Decode straight from a mapping of the file");
+    MappedFile image = readFile(TEXTURE_PATH);
     int texWidth, texHeight, texChannels;
-    LOGCALL(stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha));
+    LOGCALL(stbi_uc* pixels = stbi_load_from_memory(image.data<stbi_uc>(), static_cast<int>(image.size()), &texWidth,
+                                                    &texHeight, &texChannels, STBI_rgb_alpha));
     VkDeviceSize imageSize = texWidth * texHeight * 4;
 
     if (!pixels) {
@@ -1621,6 +4949,20 @@ class App {
 
     mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
+    if (options.cpuMipmaps || !supportsLinearBlit(VK_FORMAT_R8G8B8A8_SRGB)) {
+      LOG("Build the mips on the CPU, gamma correct and without the linear blit requirement");
+      auto start = std::chrono::high_resolution_clock::now();
+      std::vector<TextureLevel> levels = generateMipChain(pixels, static_cast<uint32_t>(texWidth),
+                                                          static_cast<uint32_t>(texHeight), options.mipFilter);
+      double milliseconds =
+          std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+      LOG("CPU mip chain:", levels.size(), "levels in", milliseconds, "ms");
+      LOGCALL(stbi_image_free(pixels));
+
+      uploadMipChain(levels);
+      return;
+    }
+
     LOG("Create Host Visible Staging Buffer");
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
@@ -1659,6 +5001,366 @@ class App {
     LOGCALL(vkFreeMemory(device, stagingBufferMemory, nullptr));
   }
 
+  bool isTextureFormatSupported(VkFormat format) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    VkFormatFeatureFlags required =
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & required) == required;
+  }
+
+  // Uploads the first KTX2 cache of TEXTURE_PATH, in TEXTURE_CACHE_FORMATS order, that exists, that the device can
+  // sample and that parseKtx2 accepts. The mips come from the file, so there is no decode and no blit. Returns false
+  // if there is none.
+  bool loadTextureCache() {
+    LOGFN;
+
+    for (const auto& format : TEXTURE_CACHE_FORMATS) {
+      std::string path = textureCachePath(TEXTURE_PATH, format);
+      if (!std::ifstream(path, std::ios::binary).is_open()) {
+        continue;
+      }
+      if (!isTextureFormatSupported(format.format)) {
+        LOG("Skipping", path, ", the device cannot sample", format.name);
+        continue;
+      }
+
+      LOG("Mapping the file only touches the pages of the header and level index up front");
+      std::shared_ptr<MappedFile> file;
+      Ktx2Texture texture;
+      try {
+        file = std::make_shared<MappedFile>(readFile(path));
+        texture = parseKtx2(format, file->data(), file->size(), file->size());
+      } catch (const std::exception& e) {
+        LOG("[WARNING] Rejected", path, ":", e.what());
+        continue;
+      }
+
+      if (options.textureStreaming) {
+        startTextureStreaming(path, file, texture);
+        return true;
+      }
+
+      uint32_t width = texture.header.pixelWidth;
+      uint32_t height = texture.header.pixelHeight;
+      mipLevels = static_cast<uint32_t>(texture.levels.size());
+      textureFormat = format.format;
+
+      LOG("Levels are packed in the file, stage them with a single copy");
+      auto [dataBegin, dataEnd] = ktx2DataRange(texture);
+      VkDeviceSize imageSize = dataEnd - dataBegin;
+
+      VkBuffer stagingBuffer;
+      VkDeviceMemory stagingBufferMemory;
+      createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
+                   stagingBufferMemory);
+
+      void* data;
+      LOGCALL(vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data));
+      memcpy(data, file->data() + dataBegin, static_cast<size_t>(imageSize));
+      LOGCALL(vkUnmapMemory(device, stagingBufferMemory));
+
+      createImage(width, height, mipLevels, VK_SAMPLE_COUNT_1_BIT, textureFormat, VK_IMAGE_TILING_OPTIMAL,
+                  VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  textureImage, textureImageMemory);
+
+      uploadTextureLevels(stagingBuffer, textureImage, mipLevels, textureCacheRegions(texture, dataBegin));
+
+      LOGCALL(vkDestroyBuffer(device, stagingBuffer, nullptr));
+      LOGCALL(vkFreeMemory(device, stagingBufferMemory, nullptr));
+
+      LOG("Loaded", path, width, "x", height, "levels:", mipLevels, "bytes:", imageSize);
+      return true;
+    }
+
+    LOG("No usable texture cache, run with --compress-texture", TEXTURE_PATH, "to build one");
+    return false;
+  }
+
+  // One copy region per level, with buffer offsets relative to the start of the level data
+  std::vector<VkBufferImageCopy> textureCacheRegions(const Ktx2Texture& texture, uint64_t dataBegin) {
+    std::vector<VkBufferImageCopy> regions(texture.levels.size());
+    for (uint32_t i = 0; i < regions.size(); i++) {
+      regions[i] = {};
+      regions[i].bufferOffset = texture.levels[i].byteOffset - dataBegin;
+      regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      regions[i].imageSubresource.mipLevel = i;
+      regions[i].imageSubresource.layerCount = 1;
+      regions[i].imageExtent = {std::max(texture.header.pixelWidth >> i, 1u),
+                                std::max(texture.header.pixelHeight >> i, 1u), 1};
+    }
+    return regions;
+  }
+
+  // Creates textureImage from the KTX2 cache mapped in `file` with only its mip tail resident. The levels up to
+  // MIP_TAIL_SIZE are read and uploaded before the first frame, which costs the same whatever the texture size. A
+  // loader thread reads the larger levels into a persistently mapped staging buffer, smallest first, and
+  // streamTextureLevels uploads whatever it has read between frames.
+  void startTextureStreaming(const std::string& path, std::shared_ptr<MappedFile> file, const Ktx2Texture& texture) {
+    LOGFN;
+
+    uint32_t width = texture.header.pixelWidth;
+    uint32_t height = texture.header.pixelHeight;
+    mipLevels = static_cast<uint32_t>(texture.levels.size());
+    textureFormat = static_cast<VkFormat>(texture.header.vkFormat);
+
+    auto [dataBegin, dataEnd] = ktx2DataRange(texture);
+    VkDeviceSize imageSize = dataEnd - dataBegin;
+    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, textureStagingBuffer,
+                 textureStagingBufferMemory);
+    void* data;
+    LOGCALL(vkMapMemory(device, textureStagingBufferMemory, 0, imageSize, 0, &data));
+    char* staging = static_cast<char*>(data);
+    textureStreamRegions = textureCacheRegions(texture, dataBegin);
+
+    createImage(width, height, mipLevels, VK_SAMPLE_COUNT_1_BIT, textureFormat, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                textureImage, textureImageMemory);
+
+    LOG("Reading a level copies it from the mapping into the staging buffer, its pages fault in on the way");
+    auto readLevel = [file, levels = texture.levels, staging, begin = dataBegin](uint32_t level) {
+      memcpy(staging + (levels[level].byteOffset - begin), file->data() + levels[level].byteOffset,
+             static_cast<size_t>(levels[level].byteLength));
+    };
+
+    uint32_t tailLevel = mipLevels - 1;
+    while (tailLevel > 0 && std::max(width >> (tailLevel - 1), height >> (tailLevel - 1)) <= MIP_TAIL_SIZE) {
+      tailLevel--;
+    }
+    for (uint32_t level = mipLevels; level-- > tailLevel;) {
+      readLevel(level);
+    }
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    recordTextureLevelUpload(commandBuffer, textureStagingBuffer, textureImage, tailLevel, mipLevels - tailLevel,
+                             textureStreamRegions.data());
+    endSingleTimeCommands(commandBuffer);
+
+    residentMipLevel = tailLevel;
+    loadedMipLevel = tailLevel;
+    textureStreaming = true;
+    LOG("Resident", path, "levels", tailLevel, "to", mipLevels - 1, "of", width, "x", height);
+    if (tailLevel == 0) {
+      finishTextureStreaming();
+      return;
+    }
+
+    LOG("Stream the remaining levels on a loader thread");
+    stopTextureLoader = false;
+    textureLoader = std::async(std::launch::async, [this, readLevel, tailLevel]() {
+      for (uint32_t level = tailLevel; level-- > 0 && !stopTextureLoader;) {
+        readLevel(level);
+        loadedMipLevel = level;
+      }
+    });
+  }
+
+  // Called every frame before recording. Uploads the levels the loader thread has read since the last upload on
+  // uploadQueue, at most one upload in flight, and makes the new levels visible once the upload is submitted.
+  void streamTextureLevels() {
+    LOGFN_ONCE;
+
+    if (uploadInFlight) {
+      if (vkGetFenceStatus(device, uploadFence) == VK_NOT_READY) {
+        return;
+      }
+      uploadInFlight = false;
+    }
+    if (textureLoader.valid() && textureLoader.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      LOG_ONCE("Texture loader finished, get() rethrows anything it threw");
+      textureLoader.get();
+    }
+
+    uint32_t loaded = loadedMipLevel;
+    if (loaded < residentMipLevel) {
+      LOGCALL_ONCE(vkResetFences(device, 1, &uploadFence));
+      LOGCALL_ONCE(vkResetCommandBuffer(uploadCommandBuffer, 0));
+
+      VkCommandBufferBeginInfo beginInfo{};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      if (vkBeginCommandBuffer(uploadCommandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording upload command buffer!");
+      }
+      recordTextureLevelUpload(uploadCommandBuffer, textureStagingBuffer, textureImage, loaded,
+                               residentMipLevel - loaded, textureStreamRegions.data());
+      if (vkEndCommandBuffer(uploadCommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record upload command buffer!");
+      }
+
+      LOG_ONCE("The next frame waits on uploadSemaphore before its fragment shader samples the new levels");
+      VkSubmitInfo submitInfo{};
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &uploadCommandBuffer;
+      submitInfo.signalSemaphoreCount = 1;
+      submitInfo.pSignalSemaphores = &uploadSemaphore;
+      if (LOGCALL_ONCE(vkQueueSubmit(uploadQueue, 1, &submitInfo, uploadFence)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit texture upload!");
+      }
+      uploadInFlight = true;
+      uploadWaitPending = true;
+      residentMipLevel = loaded;
+      textureImageView = textureViewForLevel(residentMipLevel);
+    } else if (residentMipLevel == 0 && !uploadInFlight) {
+      finishTextureStreaming();
+    }
+  }
+
+  void finishTextureStreaming() {
+    LOGFN;
+    LOGCALL(vkUnmapMemory(device, textureStagingBufferMemory));
+    LOGCALL(vkDestroyBuffer(device, textureStagingBuffer, nullptr));
+    LOGCALL(vkFreeMemory(device, textureStagingBufferMemory, nullptr));
+    textureStagingBuffer = VK_NULL_HANDLE;
+    textureStagingBufferMemory = VK_NULL_HANDLE;
+    textureStreaming = false;
+
+    auto elapsed = std::chrono::high_resolution_clock::now() - startTime;
+    std::cout << "Texture fully resident after "
+              << std::chrono::duration<double, std::milli>(elapsed).count() << " ms" << std::endl;
+  }
+
+  // Stops the loader thread and drops the staging buffer if the window closes before the texture is resident, the
+  // caller has already waited for the device to be idle
+  void stopTextureStreaming() {
+    LOGFN;
+    stopTextureLoader = true;
+    if (textureLoader.valid()) {
+      textureLoader.wait();
+    }
+    LOGCALL(vkUnmapMemory(device, textureStagingBufferMemory));
+    LOGCALL(vkDestroyBuffer(device, textureStagingBuffer, nullptr));
+    LOGCALL(vkFreeMemory(device, textureStagingBufferMemory, nullptr));
+    textureStreaming = false;
+  }
+
+  // Points the texture descriptor of the render sets at the resident levels. The other frames in flight still use the
+  // set, or their own bindless one, so this waits for them, a short stall each time streaming makes a larger level
+  // resident.
+  void updateTextureDescriptor(uint32_t frame) {
+    LOGFN_ONCE;
+    if (descriptorSetMipLevel == residentMipLevel) {
+      return;
+    }
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      if (i != frame) {
+        LOGCALL_ONCE(vkWaitForFences(device, 1, &inFlightFences[i], VK_TRUE, UINT64_MAX));
+      }
+    }
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = textureImageView;
+    imageInfo.sampler = textureSampler;
+
+    for (VkDescriptorSet set : descriptorSets) {
+      VkWriteDescriptorSet descriptorWrite{};
+      descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrite.dstSet = set;
+      descriptorWrite.dstBinding = 1;
+      descriptorWrite.dstArrayElement = 0;
+      descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      descriptorWrite.descriptorCount = 1;
+      descriptorWrite.pImageInfo = &imageInfo;
+      LOGCALL_ONCE(vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr));
+    }
+    descriptorSetMipLevel = residentMipLevel;
+  }
+
+  // Copies all regions and makes every level readable by the fragment shader, in one command buffer
+  void uploadTextureLevels(VkBuffer buffer, VkImage image, uint32_t mipLevels,
+                           const std::vector<VkBufferImageCopy>& regions) {
+    LOGFN;
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    recordTextureLevelUpload(commandBuffer, buffer, image, 0, mipLevels, regions.data());
+    endSingleTimeCommands(commandBuffer);
+  }
+
+  // Moves levels [baseMipLevel, baseMipLevel + levelCount) to the transfer layout, copies regions[level] into each
+  // and moves them on to the shader read layout
+  void recordTextureLevelUpload(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint32_t baseMipLevel,
+                                uint32_t levelCount, const VkBufferImageCopy* regions) {
+    LOGFN_ONCE;
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = baseMipLevel;
+    barrier.subresourceRange.levelCount = levelCount;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                      0, 0, nullptr, 0, nullptr, 1, &barrier));
+
+    LOGCALL_ONCE(vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount,
+                                        regions + baseMipLevel));
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    LOGCALL_ONCE(vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier));
+  }
+
+  // Uploads an RGBA8 mip chain built on the CPU into textureImage, all levels in one staging buffer and one copy
+  void uploadMipChain(const std::vector<TextureLevel>& levels) {
+    LOGFN;
+
+    VkDeviceSize imageSize = 0;
+    for (const auto& level : levels) {
+      imageSize += level.pixels.size();
+    }
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
+                 stagingBufferMemory);
+
+    LOG("Pack the levels back to back, RGBA8 keeps every offset 4 byte aligned");
+    void* data;
+    LOGCALL(vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data));
+    std::vector<VkBufferImageCopy> regions(levels.size());
+    VkDeviceSize offset = 0;
+    for (uint32_t i = 0; i < levels.size(); i++) {
+      memcpy(static_cast<char*>(data) + offset, levels[i].pixels.data(), levels[i].pixels.size());
+      regions[i] = {};
+      regions[i].bufferOffset = offset;
+      regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      regions[i].imageSubresource.mipLevel = i;
+      regions[i].imageSubresource.layerCount = 1;
+      regions[i].imageExtent = {levels[i].width, levels[i].height, 1};
+      offset += levels[i].pixels.size();
+    }
+    LOGCALL(vkUnmapMemory(device, stagingBufferMemory));
+
+    mipLevels = static_cast<uint32_t>(levels.size());
+    createImage(levels[0].width, levels[0].height, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
+                VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+    uploadTextureLevels(stagingBuffer, textureImage, mipLevels, regions);
+
+    LOGCALL(vkDestroyBuffer(device, stagingBuffer, nullptr));
+    LOGCALL(vkFreeMemory(device, stagingBufferMemory, nullptr));
+  }
+
+  bool supportsLinearBlit(VkFormat format) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    return formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  }
+
   void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
     LOGFN;
 
@@ -1766,6 +5468,12 @@ class App {
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device, image, &memRequirements);
 
+    LOG("Lazily allocated memory is a preference, transient attachments fall back to plain memory without it");
+    if ((properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) &&
+        !hasMemoryType(memRequirements.memoryTypeBits, properties)) {
+      properties &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    }
+
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
@@ -1823,6 +5531,12 @@ class App {
 
       sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
       destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    } else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_GENERAL) {
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+      sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+      destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
     } else {
       throw std::invalid_argument("unsupported layout transition!");
     }
@@ -1893,10 +5607,60 @@ class App {
 
     VkFormat colorFormat = swapChainImageFormat;
 
+    LOG("The samples only live until the resolve, unless the second pass of occlusion culling loads them again");
+    bool transient = !options.occlusionCulling;
     createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemory);
+                transientAttachmentUsage(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, transient),
+                transientAttachmentMemory(transient), colorImage, colorImageMemory);
     colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    colorAttachmentMemory = attachmentMemory(colorImage, transient);
+  }
+
+  VkImageUsageFlags transientAttachmentUsage(VkImageUsageFlags usage, bool transient) const {
+    return transient ? usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : usage;
+  }
+
+  VkMemoryPropertyFlags transientAttachmentMemory(bool transient) const {
+    return transient ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+                     : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  }
+
+  // Size of the attachment as a plain allocation and whether createImage found lazily allocated memory for it
+  AttachmentMemory attachmentMemory(VkImage image, bool transient) {
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+    AttachmentMemory memory;
+    memory.size = memRequirements.size;
+    memory.lazy = transient && hasMemoryType(memRequirements.memoryTypeBits, transientAttachmentMemory(true));
+    return memory;
+  }
+
+  // Prints what the multisampled attachments take as plain allocations against what the device committed for them,
+  // at the current swap chain size. The caller has waited for the device, the commitment can grow while rendering.
+  void reportAttachmentMemory() {
+    VkDeviceSize allocated = 0;
+    VkDeviceSize committed = 0;
+    std::array<std::pair<VkDeviceMemory, AttachmentMemory>, 2> attachments = {
+        std::make_pair(colorImageMemory, colorAttachmentMemory),
+        std::make_pair(depthImageMemory, depthAttachmentMemory)};
+    for (const auto& attachment : attachments) {
+      allocated += attachment.second.size;
+      if (attachment.second.lazy) {
+        VkDeviceSize bytes = 0;
+        vkGetDeviceMemoryCommitment(device, attachment.first, &bytes);
+        committed += bytes;
+      } else {
+        committed += attachment.second.size;
+      }
+    }
+
+    const double mib = 1024.0 * 1024.0;
+    std::cout << msaaSamples << "x MSAA attachments at " << swapChainExtent.width << "x" << swapChainExtent.height
+              << ": " << allocated / mib << " MiB as plain allocations, " << committed / mib << " MiB committed, "
+              << (allocated - committed) / mib << " MiB saved (color "
+              << (colorAttachmentMemory.lazy ? "lazily allocated" : "allocated") << ", depth "
+              << (depthAttachmentMemory.lazy ? "lazily allocated" : "allocated") << ")" << std::endl;
   }
 #pragma endregion MSAA
 
@@ -1930,6 +5694,12 @@ class App {
     if (LOGCALL(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data())) != VK_SUCCESS) {
       throw std::runtime_error("failed to allocate command buffers!");
     }
+
+    LOG("Texture streaming records its uploads into a command buffer of its own");
+    allocInfo.commandBufferCount = 1;
+    if (LOGCALL(vkAllocateCommandBuffers(device, &allocInfo, &uploadCommandBuffer)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate command buffers!");
+    }
   }
 
   void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
@@ -1944,23 +5714,38 @@ class App {
       throw std::runtime_error("failed to begin recording command buffer!");
     }
 
+    if (timestampsSupported) {
+      LOG_ONCE("Time the culling pass and the render pass, the frame's two queries are reset first");
+      LOGCALL_ONCE(vkCmdResetQueryPool(commandBuffer, timestampQueryPool, currentFrame * 2, 2));
+      LOGCALL_ONCE(vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool,
+                                       currentFrame * 2));
+    }
+
+    if (options.gpuCulling) {
+      recordInstanceCull(commandBuffer, 0);
+    }
+
     LOG_ONCE("Start Render Pass");
-    LOGCALL_ONCE(VkRenderPassBeginInfo renderPassInfo{});
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFrameBuffers[imageIndex];
+    if (dynamicRenderingPath) {
+      beginRendering(commandBuffer, imageIndex, false);
+    } else {
+      LOGCALL_ONCE(VkRenderPassBeginInfo renderPassInfo{});
+      renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      renderPassInfo.renderPass = renderPass;
+      renderPassInfo.framebuffer = swapChainFrameBuffers[imageIndex];
 
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
+      renderPassInfo.renderArea.offset = {0, 0};
+      renderPassInfo.renderArea.extent = swapChainExtent;
 
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-    clearValues[1].depthStencil = {1.0f, 0};
+      std::array<VkClearValue, 2> clearValues{};
+      clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+      clearValues[1].depthStencil = {1.0f, 0};
 
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
+      renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+      renderPassInfo.pClearValues = clearValues.data();
 
-    LOGCALL_ONCE(vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE));
+      LOGCALL_ONCE(vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE));
+    }
 
     LOG_ONCE("Bind Pipeline");
     LOGCALL_ONCE(vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline));
@@ -1988,16 +5773,45 @@ class App {
     scissor.extent = swapChainExtent;
     LOGCALL_ONCE(vkCmdSetScissor(commandBuffer, 0, 1, &scissor));
 
-    LOG_ONCE("Bind Descriptor Sets");
-    LOGCALL_ONCE(vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
-                                         &descriptorSets[currentFrame], 0, nullptr));
+    LOG_ONCE("Bind Descriptor Sets, the dynamic offsets pick this frame's uniforms and instances");
+    VkDescriptorSet set = renderSet(currentFrame);
+    std::vector<uint32_t> dynamicOffsets = renderSetOffsets(currentFrame);
+    LOGCALL_ONCE(vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &set,
+                                         static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data()));
+
+    LOG_ONCE("Push the per-draw constants, the mesh pipeline layout has the same push constant range");
+    DrawConstants drawConstants{glm::vec4(1.0f)};
+    LOGCALL_ONCE(vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                                    sizeof(drawConstants), &drawConstants));
 
     LOG_ONCE("FINALLY DRAW!!!");
     // LOGCALL_ONCE(vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0));
-    LOGCALL_ONCE(vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0));
+    if (meshShaderPath) {
+      recordMeshletTasks(commandBuffer);
+    } else if (options.gpuCulling) {
+      recordInstanceDraws(commandBuffer, 0);
+    } else {
+      LOG_ONCE("One instanced draw, the vertex shader picks its model matrix by gl_InstanceIndex");
+      LOGCALL_ONCE(
+          vkCmdDrawIndexed(commandBuffer, lods[0].indexCount, options.instances, 0, 0, 0));
+    }
 
     LOG_ONCE("End Render Pass");
-    LOGCALL_ONCE(vkCmdEndRenderPass(commandBuffer));
+    if (dynamicRenderingPath) {
+      endRendering(commandBuffer, imageIndex, false);
+    } else {
+      LOGCALL_ONCE(vkCmdEndRenderPass(commandBuffer));
+    }
+
+    if (options.occlusionCulling) {
+      recordOcclusionPass(commandBuffer, imageIndex);
+    }
+
+    if (timestampsSupported) {
+      LOGCALL_ONCE(vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool,
+                                       currentFrame * 2 + 1));
+      frameTimestampsWritten[currentFrame] = true;
+    }
 
     if (LOGCALL_ONCE(vkEndCommandBuffer(commandBuffer)) != VK_SUCCESS) {
       throw std::runtime_error("failed to record command buffer!");
@@ -2064,8 +5878,13 @@ class App {
 
   VkFormat findDepthFormat() {
     LOGFN;
+    LOG("Occlusion culling samples the depth to build its pyramid");
+    VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if (options.occlusionCulling) {
+      features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    }
     return findSupportedFormats({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-                                VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+                                VK_IMAGE_TILING_OPTIMAL, features);
   }
 
   bool hasStencilComponent(VkFormat format) {
@@ -2075,15 +5894,63 @@ class App {
   void createDepthResources() {
     LOGFN;
 
-    VkFormat depthFormat = findDepthFormat();
+    depthFormat = findDepthFormat();
 
+    LOG("The depth is dropped after the render pass, unless occlusion culling stores and samples it for its pyramid");
+    bool transient = !options.occlusionCulling;
+    VkImageUsageFlags usage = transientAttachmentUsage(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, transient);
+    if (options.occlusionCulling) {
+      usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
     createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage,
-                depthImageMemory);
+                usage, transientAttachmentMemory(transient), depthImage, depthImageMemory);
     depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+    depthAttachmentMemory = attachmentMemory(depthImage, transient);
 
     transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED,
                           VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+
+    if (options.occlusionCulling) {
+      createDepthPyramid();
+    }
+  }
+
+  // The depth pyramid follows the size of the depth attachment. It stays in the general layout, hiz_build.comp
+  // writes it through one storage view per level and instance_cull.comp reads it through a view of all levels.
+  void createDepthPyramid() {
+    LOGFN;
+
+    LOG("Level 0 is the largest power of two that fits the depth, so every level halves the one before exactly");
+    auto floorPowerOfTwo = [](uint32_t value) {
+      uint32_t power = 1;
+      while (power * 2 <= value) {
+        power *= 2;
+      }
+      return power;
+    };
+    depthPyramidExtent = {floorPowerOfTwo(swapChainExtent.width), floorPowerOfTwo(swapChainExtent.height)};
+    depthPyramidLevels =
+        static_cast<uint32_t>(std::floor(std::log2(std::max(depthPyramidExtent.width, depthPyramidExtent.height)))) + 1;
+    if (depthPyramidLevels > HIZ_MAX_LEVELS) {
+      throw std::runtime_error("depth pyramid has more levels than HIZ_MAX_LEVELS!");
+    }
+    LOG("Depth pyramid:", depthPyramidExtent.width, "x", depthPyramidExtent.height, "levels:", depthPyramidLevels);
+
+    createImage(depthPyramidExtent.width, depthPyramidExtent.height, depthPyramidLevels, VK_SAMPLE_COUNT_1_BIT,
+                VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                depthPyramid, depthPyramidMemory);
+    depthPyramidView =
+        createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, depthPyramidLevels);
+    depthPyramidLevelViews.resize(depthPyramidLevels);
+    for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+      depthPyramidLevelViews[level] =
+          createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, level);
+    }
+
+    transitionImageLayout(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                          VK_IMAGE_ASPECT_COLOR_BIT, depthPyramidLevels);
+    depthPyramidBuilt = false;
   }
 #pragma endregion DEPTH_BUFFERING
 
@@ -2116,6 +5983,56 @@ class App {
         throw std::runtime_error("failed to create synchronization objects for a frame!");
       }
     }
+
+    LOG("The texture upload fence starts unsignaled, streamTextureLevels only waits on it after a submit");
+    fenceInfo.flags = 0;
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &uploadSemaphore) != VK_SUCCESS ||
+        vkCreateFence(device, &fenceInfo, nullptr, &uploadFence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create synchronization objects for texture uploads!");
+    }
+  }
+
+  void createTimestampQueryPool() {
+    LOGFN;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampsSupported = properties.limits.timestampComputeAndGraphics;
+    frameTimestampsWritten.assign(MAX_FRAMES_IN_FLIGHT, false);
+    if (!timestampsSupported) {
+      LOG("No timestamp queries on the graphics queue, only CPU frame times are reported");
+      return;
+    }
+    LOG("Timestamps tick every", properties.limits.timestampPeriod, "ns");
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * MAX_FRAMES_IN_FLIGHT;
+
+    if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create timestamp query pool!");
+    }
+  }
+
+  // Adds the render pass time of `frame` to gpuFrameTimeSum, the caller has waited for the frame's fence
+  void readFrameTimestamps(uint32_t frame) {
+    if (!frameTimestampsWritten[frame]) {
+      return;
+    }
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(device, timestampQueryPool, frame * 2, 2, sizeof(timestamps), timestamps,
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      double frameTime = (timestamps[1] - timestamps[0]) * timestampPeriod;
+      gpuFrameTimeSum += frameTime;
+      gpuFrameCount++;
+      if (options.occlusionCulling) {
+        occlusionGpuTimeSums[occlusionTested[frame]] += frameTime;
+        occlusionGpuFrameCounts[occlusionTested[frame]]++;
+      }
+    }
+    frameTimestampsWritten[frame] = false;
   }
 #pragma endregion SYNCHRONISATION
 
@@ -2133,6 +6050,8 @@ class App {
 
     LOG_ONCE("Wait for the previous frame to be finished");
     LOGCALL_ONCE(vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX));
+    readFrameTimestamps(currentFrame);
+    readDrawCount(currentFrame);
 
     LOG_ONCE("Acquire an image from the swap chain");
     uint32_t imageIndex;
@@ -2150,6 +6069,11 @@ class App {
     // Only reset the fence if we are submitting work
     LOGCALL_ONCE(vkResetFences(device, 1, &inFlightFences[currentFrame]));
 
+    if (textureStreaming) {
+      streamTextureLevels();
+    }
+    updateTextureDescriptor(currentFrame);
+
     LOGCALL_ONCE(vkResetCommandBuffer(commandBuffers[currentFrame], 0));
     LOG_ONCE("Record a command buffer which draws the scene onto the image.");
     recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
@@ -2161,10 +6085,13 @@ class App {
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
     LOG_ONCE("Wait for the imageAvailableSemaphore..");
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], uploadSemaphore};
     LOG_ONCE("Wait till the color attachment is ready for writing..");
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT};
+    LOG_ONCE("..and for the texture upload, if one was submitted since the last frame");
+    submitInfo.waitSemaphoreCount = uploadWaitPending ? 2 : 1;
+    uploadWaitPending = false;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
@@ -2204,16 +6131,113 @@ class App {
       throw std::runtime_error("failed to present swap chain image!");
     }
 
+    if (!firstFramePresented) {
+      firstFramePresented = true;
+      auto elapsed = std::chrono::high_resolution_clock::now() - startTime;
+      std::cout << "First frame presented after " << std::chrono::duration<double, std::milli>(elapsed).count()
+                << " ms" << std::endl;
+    }
+
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
   }
 #pragma endregion DRAW_FRAMES
 };
 
 #pragma region MAIN
-int main() {
+Options parseOptions(int argc, char** argv) {
+  Options options;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--compress-texture" && i + 1 < argc) {
+      options.compressTexture = argv[++i];
+    } else if (arg == "--no-texture-cache") {
+      options.textureCache = false;
+    } else if (arg == "--no-texture-streaming") {
+      options.textureStreaming = false;
+    } else if (arg == "--cpu-mipmaps") {
+      options.cpuMipmaps = true;
+    } else if (arg == "--instances" && i + 1 < argc) {
+      options.instances = static_cast<uint32_t>(std::stoul(argv[++i]));
+      if (options.instances == 0) {
+        throw std::runtime_error("--instances must be at least 1");
+      }
+    } else if (arg == "--frames" && i + 1 < argc) {
+      options.frameLimit = std::stoull(argv[++i]);
+    } else if (arg == "--recreate-benchmark" && i + 1 < argc) {
+      options.recreateBenchmark = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--zoom" && i + 1 < argc) {
+      options.zoom = std::stof(argv[++i]);
+      if (options.zoom <= 0.0f) {
+        throw std::runtime_error("--zoom must be positive");
+      }
+    } else if (arg == "--gpu-culling") {
+      options.gpuCulling = true;
+    } else if (arg == "--occlusion-culling") {
+      options.gpuCulling = true;
+      options.occlusionCulling = true;
+    } else if (arg == "--occlusion-scene") {
+      options.occlusionScene = true;
+    } else if (arg == "--build-mesh-cache" && i + 1 < argc) {
+      options.buildMeshCache = argv[++i];
+    } else if (arg == "--no-mesh-cache") {
+      options.meshCache = false;
+    } else if (arg == "--meshlet-culling") {
+      options.gpuCulling = true;
+      options.meshletCulling = true;
+    } else if (arg == "--no-mesh-shaders") {
+      options.meshShaders = false;
+    } else if (arg == "--bindless") {
+      options.bindless = true;
+    } else if (arg == "--dynamic-rendering") {
+      options.dynamicRendering = true;
+    } else if (arg == "--lod") {
+      options.gpuCulling = true;
+      options.lod = true;
+    } else if (arg == "--lod-threshold" && i + 1 < argc) {
+      options.lodThreshold = std::stof(argv[++i]);
+      if (options.lodThreshold <= 0.0f) {
+        throw std::runtime_error("--lod-threshold must be positive");
+      }
+    } else if (arg == "--mip-filter" && i + 1 < argc) {
+      std::string filter = argv[++i];
+      if (filter == "box") {
+        options.mipFilter = MipFilter::Box;
+      } else if (filter == "kaiser") {
+        options.mipFilter = MipFilter::Kaiser;
+      } else if (filter == "lanczos") {
+        options.mipFilter = MipFilter::Lanczos;
+      } else {
+        throw std::runtime_error("unknown mip filter: " + filter);
+      }
+    } else {
+      throw std::runtime_error("unknown argument: " + arg);
+    }
+  }
+  if (options.meshletCulling && options.occlusionCulling) {
+    throw std::runtime_error("--meshlet-culling and --occlusion-culling cannot be combined");
+  }
+  if (options.meshletCulling && options.lod) {
+    throw std::runtime_error("--meshlet-culling and --lod cannot be combined, the meshlets only cover the full mesh");
+  }
+
+  return options;
+}
+
+int main(int argc, char** argv) {
   LOG("Illiterate Vulkan!");
-  App app;
   try {
+    Options options = parseOptions(argc, argv);
+    if (!options.compressTexture.empty()) {
+      compressTexture(options.compressTexture, options.mipFilter);
+      return EXIT_SUCCESS;
+    }
+    if (!options.buildMeshCache.empty()) {
+      buildMeshCache(options.buildMeshCache);
+      return EXIT_SUCCESS;
+    }
+
+    App app(options);
     app.run();
   } catch (const std::exception& e) {
     LOG("[ERROR]", __FUNCTION__, e.what());
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only mapping of a whole file, mmap on POSIX and a file mapping object on Windows. The bytes are paged in on
+// first access and never copied to the heap. The mapping starts on a page boundary, so data<T>() can hand out SPIR-V
+// words or file headers directly. Move-only, the destructor unmaps, so the file stays mapped for exactly as long as
+// its consumer keeps the MappedFile around.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename) {
+#ifdef _WIN32
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      throw std::runtime_error("failed to open file!");
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+      release();
+      throw std::runtime_error("failed to get file size!");
+    }
+    length = static_cast<size_t>(fileSize.QuadPart);
+    if (length > 0) {
+      mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      bytes = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+      if (!bytes) {
+        release();
+        throw std::runtime_error("failed to map file!");
+      }
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open file!");
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      close(fd);
+      throw std::runtime_error("failed to get file size!");
+    }
+    length = static_cast<size_t>(status.st_size);
+    if (length > 0) {
+      void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (address == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("failed to map file!");
+      }
+      bytes = static_cast<const char*>(address);
+    }
+    // The mapping keeps its own reference to the file
+    close(fd);
+#endif
+  }
+
+  ~MappedFile() { release(); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept { swap(other); }
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      release();
+      swap(other);
+    }
+    return *this;
+  }
+
+  const char* data() const { return bytes; }
+  size_t size() const { return length; }
+
+  // The bytes at `offset` as an array of T, `offset` has to keep T aligned since nothing is copied
+  template <typename T>
+  const T* data(size_t offset = 0) const {
+    if (offset > length || reinterpret_cast<uintptr_t>(bytes + offset) % alignof(T) != 0) {
+      throw std::runtime_error("mapped file data is out of range or misaligned!");
+    }
+    return reinterpret_cast<const T*>(bytes + offset);
+  }
+
+ private:
+  void release() {
+#ifdef _WIN32
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (bytes) munmap(const_cast<char*>(bytes), length);
+#endif
+    bytes = nullptr;
+    length = 0;
+  }
+
+  void swap(MappedFile& other) noexcept {
+    std::swap(bytes, other.bytes);
+    std::swap(length, other.length);
+#ifdef _WIN32
+    std::swap(file, other.file);
+    std::swap(mapping, other.mapping);
+#endif
+  }
+
+  const char* bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#endif
+};
+
+// Lets stream based parsers (tinyobjloader) read a mapped file in place
+class MappedFileStreamBuf : public std::streambuf {
+ public:
+  explicit MappedFileStreamBuf(const MappedFile& file) {
+    char* begin = const_cast<char*>(file.data());
+    setg(begin, begin, begin + file.size());
+  }
+};
@@ -1,4 +1,7 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "particle.glsl"
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec4 inColor;
@@ -7,7 +10,7 @@ layout(location = 0) out vec3 fragColor;
 
 void main() {
 
-    gl_PointSize = 14.0;
+    gl_PointSize = ubo.particleSize * inColor.a;
     gl_Position = vec4(inPosition.xy, 1.0, 1.0);
     fragColor = inColor.rgb;
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+// Shared by the particle compute shaders, included with GL_GOOGLE_include_directive.
+
+struct Particle {
+    vec2 position;
+    vec2 velocity;
+    vec4 color;  // rgb color, a is the size relative to ubo.particleSize
+};
+
+// How the state is stored. Kernels read and write it through loadParticle(buffer[i]) and storeParticle(buffer[i],
+// particle), so all arithmetic stays fp32 whatever the format. With PARTICLE_HALF every value is stored as a half
+// float, 16 instead of 32 bytes per particle, keep in sync with HalfParticle in src/compute.cpp. PARTICLE_STORAGE16
+// declares the halves as 16-bit types (storageBuffer16BitAccess, the including shader enables
+// GL_EXT_shader_16bit_storage), without it they are packed into uints with the same layout.
+#if defined(PARTICLE_HALF) && defined(PARTICLE_STORAGE16)
+struct StoredParticle {
+    f16vec2 position;
+    f16vec2 velocity;
+    f16vec4 color;
+};
+
+// 16-bit storage alone only allows 16-bit values as buffer members, converted right where they are loaded or stored.
+// No shaderFloat16 means no 16-bit function parameters, return values or temporaries, hence macros that touch the
+// members in place. storeParticle expands to several statements, use it as a statement of its own.
+#define loadParticle(stored) Particle(vec2((stored).position), vec2((stored).velocity), vec4((stored).color))
+#define storeParticle(stored, particle)               \
+    (stored).position = f16vec2((particle).position); \
+    (stored).velocity = f16vec2((particle).velocity); \
+    (stored).color = f16vec4((particle).color)
+#elif defined(PARTICLE_HALF)
+struct StoredParticle {
+    uint position;
+    uint velocity;
+    uvec2 color;
+};
+
+Particle loadParticle(StoredParticle particle) {
+    return Particle(unpackHalf2x16(particle.position), unpackHalf2x16(particle.velocity),
+                    vec4(unpackHalf2x16(particle.color.x), unpackHalf2x16(particle.color.y)));
+}
+
+void storeParticle(out StoredParticle stored, Particle particle) {
+    stored = StoredParticle(packHalf2x16(particle.position), packHalf2x16(particle.velocity),
+                            uvec2(packHalf2x16(particle.color.xy), packHalf2x16(particle.color.zw)));
+}
+#else
+#define StoredParticle Particle
+
+Particle loadParticle(Particle particle) {
+    return particle;
+}
+
+void storeParticle(out Particle stored, Particle particle) {
+    stored = particle;
+}
+#endif
+
+layout (binding = 0) uniform ParameterUBO {
+    float deltaTime;
+    uint particleCount;
+    uint gridDim;
+    float cellSize;
+    float theta;
+    float particleSize;  // pixels, scaled per particle by color.a
+    vec2 viewportSize;
+} ubo;
+
+// Short-range interaction constants, keep in sync with src/compute.cpp
+const float INTERACTION_REPULSION = 4.0e-6;
+const float INTERACTION_PRESSURE = 2.0e-7;
+const float INTERACTION_COHESION = 1.0e-6;
+const float MAX_SPEED = 1.0e-3;
+
+// N-body gravity constants, the total mass is 1 and shared equally by all particles
+const float NBODY_GRAVITY = 1.5e-8;
+const float NBODY_SOFTENING = 0.01;
+
+// Cells cover the [-1, 1] simulation domain, anything past the border is clamped into the edge cells
+ivec2 cellCoord(vec2 position) {
+    ivec2 coord = ivec2(floor((position + 1.0) / ubo.cellSize));
+    return clamp(coord, ivec2(0), ivec2(int(ubo.gridDim) - 1));
+}
+
+uint cellIndex(vec2 position) {
+    ivec2 coord = cellCoord(position);
+    return uint(coord.y) * ubo.gridDim + uint(coord.x);
+}
+
+// Unscaled pull of a unit mass at `other`, multiply by NBODY_GRAVITY and the particle mass
+vec2 gravityAcceleration(vec2 position, vec2 other) {
+    vec2 d = other - position;
+    float invDistance = inversesqrt(dot(d, d) + NBODY_SOFTENING * NBODY_SOFTENING);
+    return d * (invDistance * invDistance * invDistance);
+}
+
+// Flip movement at window border
+vec2 reflectAtBorder(vec2 position, vec2 velocity) {
+    if ((position.x <= -1.0) || (position.x >= 1.0)) {
+        velocity.x = -velocity.x;
+    }
+    if ((position.y <= -1.0) || (position.y >= 1.0)) {
+        velocity.y = -velocity.y;
+    }
+    return velocity;
+}
+
+// Half the side of a particle's quad in normalized device coordinates
+vec2 particleHalfExtent(Particle particle) {
+    return ubo.particleSize * particle.color.a / ubo.viewportSize;
+}
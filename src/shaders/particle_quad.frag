@@ -0,0 +1,15 @@
+#version 450
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+
+    float alpha = 0.5 - length(fragCoord);
+    if (alpha <= 0.0) {
+        discard;
+    }
+    outColor = vec4(fragColor, alpha);
+}
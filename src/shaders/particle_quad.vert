@@ -0,0 +1,31 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#ifdef PARTICLE_STORAGE16
+#extension GL_EXT_shader_16bit_storage : require
+#endif
+
+#include "particle.glsl"
+
+// One instance per particle that survived particle_cull.comp, four vertices drawn as a triangle strip
+layout(std140, binding = 1) readonly buffer ParticleSSBO {
+   StoredParticle particles[ ];
+};
+
+layout(std430, binding = 2) readonly buffer VisibleIndices {
+   uint visibleIndices[ ];
+};
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragCoord;
+
+const vec2 corners[4] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
+void main() {
+    Particle particle = loadParticle(particles[visibleIndices[gl_InstanceIndex]]);
+    vec2 corner = corners[gl_VertexIndex];
+
+    gl_Position = vec4(particle.position + corner * particleHalfExtent(particle), 1.0, 1.0);
+    fragColor = particle.color.rgb;
+    // Same range as gl_PointCoord - 0.5 in compute.frag
+    fragCoord = corner * 0.5;
+}
@@ -0,0 +1,59 @@
+// Shared by the particle statistics reductions, included after particle.glsl.
+//
+// Both variants reduce the current state in two phases without any atomics:
+//   0: every workgroup reduces a grid-stride share of the particles into one partial
+//   1: a single workgroup reduces the partials and writes the result to the frame's host-visible stats buffer
+// The number of phase 0 workgroups is capped at STATS_MAX_GROUPS, so phase 1 is a single pass over the partials.
+
+// Keep in sync with ParticleStats and the STATS_* constants in src/compute.cpp
+struct ParticleStats {
+    vec2 boundsMin;
+    vec2 boundsMax;
+    float kineticEnergy;
+    uint liveCount;  // particles inside the [-1, 1] domain
+};
+
+#define STATS_GROUP_SIZE 256
+#define STATS_MAX_GROUPS 256
+
+layout (constant_id = 0) const uint STATS_PHASE = 0;
+
+layout(std140, binding = 2) readonly buffer ParticleSSBO {
+   Particle particles[ ];
+};
+
+layout(std430, binding = 16) buffer StatsPartials {
+   ParticleStats partials[ ];
+};
+
+layout(std430, binding = 17) writeonly buffer StatsResult {
+   ParticleStats result;
+};
+
+layout (local_size_x = STATS_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+uint statsGroupCount() {
+    return min((ubo.particleCount + STATS_GROUP_SIZE - 1) / STATS_GROUP_SIZE, STATS_MAX_GROUPS);
+}
+
+ParticleStats emptyStats() {
+    const float FLT_MAX = 3.402823466e38;
+    return ParticleStats(vec2(FLT_MAX), vec2(-FLT_MAX), 0.0, 0);
+}
+
+ParticleStats combineStats(ParticleStats a, ParticleStats b) {
+    return ParticleStats(min(a.boundsMin, b.boundsMin), max(a.boundsMax, b.boundsMax),
+                         a.kineticEnergy + b.kineticEnergy, a.liveCount + b.liveCount);
+}
+
+bool isLive(vec2 position) {
+    return all(lessThanEqual(abs(position), vec2(1.0)));
+}
+
+// Adds one particle, every particle has mass 1 / particleCount. The live count is left to the caller.
+ParticleStats addParticle(ParticleStats stats, Particle particle) {
+    stats.boundsMin = min(stats.boundsMin, particle.position);
+    stats.boundsMax = max(stats.boundsMax, particle.position);
+    stats.kineticEnergy += 0.5 * dot(particle.velocity, particle.velocity) / float(ubo.particleCount);
+    return stats;
+}
@@ -0,0 +1,40 @@
+// Shared by the radix sort shaders, included after particle.glsl.
+//
+// Sorts ubo.particleCount (key, value) pairs, RADIX_BITS per pass. The key and value buffers hold two halves of
+// ubo.particleCount entries each, every pass reads one half and writes the other, so after an even number of passes
+// the result is back in the lower half. The host writes the pass state with vkCmdUpdateBuffer before each pass.
+//
+// Block-local positions use the subgroup numbering instead of gl_LocalInvocationID, so the subgroup ballots and scans
+// see the keys of a block in order. This needs full subgroups, which a workgroup of RADIX_BLOCK_SIZE gives for every
+// power-of-two subgroup size up to RADIX_BLOCK_SIZE. Including shaders enable GL_KHR_shader_subgroup_basic.
+
+// Keep in sync with src/compute.cpp
+#define RADIX_BITS 4
+#define RADIX_DIGITS (1 << RADIX_BITS)
+#define RADIX_BLOCK_SIZE 256
+
+layout(std430, binding = 10) buffer SortKeys {
+   uint sortKeys[ ];
+};
+
+layout(std430, binding = 11) buffer SortValues {
+   uint sortValues[ ];
+};
+
+// Per-block digit counts, digit major: histogram[digit * blockCount + block]. Scanned in place into scatter offsets.
+layout(std430, binding = 12) buffer SortHistogram {
+   uint histogram[ ];
+};
+
+layout(std430, binding = 14) readonly buffer SortState {
+   uint shift;      // lowest key bit of this pass
+   uint inputHalf;  // 0: read the lower half and write the upper one, 1: the other way round
+} sortState;
+
+uint radixBlockCount() {
+    return (ubo.particleCount + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+}
+
+uint blockLocalIndex() {
+    return gl_SubgroupID * gl_SubgroupSize + gl_SubgroupInvocationID;
+}
@@ -1,15 +1,36 @@
 #version 450
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) in vec3 fragColor; 
 layout(location = 1) in vec2 fragTexCoord;
+#ifdef BINDLESS
+layout(location = 2) flat in uint fragTextureIndex;
+#endif
 
 layout(location = 0) out vec4 outColor;
 
+#ifdef BINDLESS
+// Every texture of the scene, partially bound. Objects in one draw can pick different ones, hence nonuniformEXT.
+layout(binding = 1) uniform sampler2D textures[];
+#else
 layout(binding = 1) uniform sampler2D texSampler;
+#endif
+
+// Per-draw data pushed with the draw, keep in sync with DrawConstants in src/main.cpp
+layout(push_constant) uniform DrawConstants {
+    vec4 tint;
+} draw;
 
 void main() {
     // outColor = vec4(fragTexCoord, 0.0, 1.0);
-    outColor = texture(texSampler, fragTexCoord);
+#ifdef BINDLESS
+    outColor = vec4(fragColor, 1.0) * texture(textures[nonuniformEXT(fragTextureIndex)], fragTexCoord) *
+               draw.tint;
+#else
+    outColor = texture(texSampler, fragTexCoord) * draw.tint;
+#endif
     // outColor = texture(texSampler, fragTexCoord * 2.0);
     // outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
 }
\ No newline at end of file
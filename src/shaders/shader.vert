@@ -1,20 +1,45 @@
 #version 450
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
 } ubo;
 
+// Model matrix of every instance, this frame's slice of the instance ring in src/main.cpp
+layout(std430, binding = 2) readonly buffer InstanceBuffer {
+    mat4 models[];
+} instances;
+
+#ifdef BINDLESS
+// Keep in sync with ObjectData in src/main.cpp
+struct ObjectData {
+    vec4 tint;
+    uint textureIndex;
+};
+
+// Per-object data of the bindless path, indexed like the model matrices
+layout(std430, binding = 3) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+};
+#endif
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+#ifdef BINDLESS
+layout(location = 2) flat out uint fragTextureIndex;
+#endif
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);    
+    gl_Position = ubo.proj * ubo.view * instances.models[gl_InstanceIndex] * vec4(inPosition, 1.0);    
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+#ifdef BINDLESS
+    ObjectData object = objects[gl_InstanceIndex];
+    fragColor *= object.tint.rgb;
+    fragTextureIndex = object.textureIndex;
+#endif
 }
\ No newline at end of file